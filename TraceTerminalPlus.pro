@@ -4,33 +4,85 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++17
 
+# LZ4 and zstd libraries: liblz4-dev and libzstd-dev found with pkg-config, lz4 and zstd of vcpkg on Windows
+unix: CONFIG += link_pkgconfig
+unix: PKGCONFIG += liblz4 libzstd
+win32: LIBS += -llz4 -lzstd
+
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
     src/advancedsearchitem.cpp \
+    src/compressedblocks.cpp \
     src/customhighlightdialog.cpp \
+    src/headlesscapture.cpp \
+    src/htmltraceloader.cpp \
+    src/htmltraceparser.cpp \
+    src/ingestendpoint.cpp \
+    src/journalloader.cpp \
+    src/lineframer.cpp \
+    src/linearchive.cpp \
+    src/linestore.cpp \
     src/livetraceview.cpp \
+    src/lz4framedecoder.cpp \
     src/mainwindow.cpp \
+    src/mappedtracefile.cpp \
+    src/overloadpolicy.cpp \
     src/searchdock.cpp \
+    src/serialreceiver.cpp \
+    src/sessionjournal.cpp \
+    src/slabring.cpp \
+    src/streamreceiver.cpp \
+    src/timestampcolumn.cpp \
+    src/tracedictionary.cpp \
     src/tracehighlighter.cpp \
+    src/traceloader.cpp \
     src/tracemanager.cpp \
+    src/tracereceiver.cpp \
+    src/tracereplayer.cpp \
     src/traceserver.cpp \
     src/traceview.cpp \
+    src/udpreceiver.cpp \
     src/main.cpp
 
 HEADERS += \
     inc/advancedsearchitem.h \
+    inc/compressedblocks.h \
     inc/constants.h \
     inc/customhighlightdialog.h \
+    inc/headlesscapture.h \
+    inc/htmltraceloader.h \
+    inc/htmltraceparser.h \
+    inc/ingestendpoint.h \
+    inc/journalloader.h \
+    inc/lineframer.h \
+    inc/linearchive.h \
+    inc/linestore.h \
     inc/livetraceview.h \
+    inc/lz4framedecoder.h \
     inc/mainwindow.h \
+    inc/mappedtracefile.h \
+    inc/overloadpolicy.h \
+    inc/recordframer.h \
     inc/searchdock.h \
+    inc/serialreceiver.h \
+    inc/sessionjournal.h \
+    inc/slabring.h \
+    inc/streamreceiver.h \
+    inc/timestampcolumn.h \
+    inc/traceclock.h \
+    inc/tracedictionary.h \
     inc/tracehighlighter.h \
+    inc/traceloader.h \
+    inc/traceline.h \
     inc/tracemanager.h \
+    inc/tracereceiver.h \
+    inc/tracereplayer.h \
     inc/traceserver.h \
-    inc/traceview.h
+    inc/traceview.h \
+    inc/udpreceiver.h
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -2,14 +2,12 @@
 #define ADVANCEDSEARCHITEM_H
 
 #include <QListWidgetItem>
-#include <QTextCursor>
-
-Q_DECLARE_METATYPE(QTextCursor);
+#include "linestore.h"
 
 class AdvancedSearchItem : public QListWidgetItem
 {
 public:
-    AdvancedSearchItem(QTextCursor cursor);
+    AdvancedSearchItem(const TextRange& match, const QString& lineText);
 
     bool operator<(const QListWidgetItem& other) const override;
 };
@@ -0,0 +1,82 @@
+#ifndef COMPRESSEDBLOCKS_H
+#define COMPRESSEDBLOCKS_H
+
+#include <QFuture>
+#include <QList>
+#include "linestore.h"
+
+///
+/// \brief The CompressedBlocks class keeps the older blocks of a line store in memory,
+///        compressed with zstd. A block is compressed by a worker thread and stays readable
+///        as is until then. The last blocks read are kept decompressed.
+///        All the blocks are full, only the first one can have lines removed.
+///
+class CompressedBlocks
+{
+public:
+    CompressedBlocks() = default;
+    ~CompressedBlocks();
+
+    void append(LineBlock* block, int skip);
+    LineBlock* takeFirst(int& skip, int& lines);
+    int dropFirst();
+    void removeFirst(int);
+    const LineBlock* blockAt(int line, int& index);
+    void collect();
+
+    inline int size() const;
+    qint64 memoryUsage() const;
+    inline qint64 compressedSize() const;
+    inline qint64 uncompressedSize() const;
+
+    CompressedBlocks(const CompressedBlocks&) = delete;
+    CompressedBlocks& operator=(const CompressedBlocks&) = delete;
+
+private:
+    struct Entry
+    {
+        qint64     number;      // Of the block since the creation, identifies it in the cache
+        int        skip;        // Lines removed from the start of the block
+        int        lines;       // Lines of the block, including the skipped ones
+        LineBlock* block;       // Until it is compressed
+        bool       pending;     // The block is being compressed
+        QFuture<QByteArray> compressing;
+        QByteArray data;        // Size of the serialized block, then the compressed block
+        qint64     blockMemory; // Memory used by the block before its compression
+    };
+    struct CachedBlock
+    {
+        qint64     number;
+        LineBlock* block;
+    };
+
+    LineBlock* decompress(const Entry&) const;
+    void release(Entry&);
+    void removeCached(qint64 number);
+
+    QList<Entry>       m_entries;
+    int                m_lines{0};
+    int                m_pendingBlocks{0};    // Being compressed
+    qint64             m_nextNumber{0};
+    qint64             m_blocksMemory{0};     // Blocks not compressed yet, and compressed data
+    qint64             m_compressedSize{0};
+    qint64             m_uncompressedSize{0}; // Memory used by the compressed blocks before
+    QList<CachedBlock> m_cache;               // Most recently read first
+};
+
+inline int CompressedBlocks::size() const
+{
+    return m_lines;
+}
+
+inline qint64 CompressedBlocks::compressedSize() const
+{
+    return m_compressedSize;
+}
+
+inline qint64 CompressedBlocks::uncompressedSize() const
+{
+    return m_uncompressedSize;
+}
+
+#endif // COMPRESSEDBLOCKS_H
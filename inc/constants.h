@@ -12,8 +12,27 @@ const QString CONFIG_DIR            = QStringLiteral("./TraceTerminalPlus.ini");
 const QString INTERFACE             = QStringLiteral("Server/interface");
 const QString PORT                  = QStringLiteral("Server/port");
 const QString REMOTE_ADDRESS        = QStringLiteral("Server/remoteAddress");
+const QString THREADED_RECEIVE      = QStringLiteral("Server/threadedReceive");
+const QString ENDPOINTS             = QStringLiteral("Server/endpoints");
+const QString RECEIVE_BUFFER_SIZE   = QStringLiteral("Server/receiveBufferSize");
+const QString SERIAL_PORT           = QStringLiteral("Serial/port");
+const QString SERIAL_BAUD_RATE      = QStringLiteral("Serial/baudRate");
+const QString DICTIONARY            = QStringLiteral("Binary/dictionary");
+const QString OVERLOAD_POLICY       = QStringLiteral("Overload/policy");
+const QString MAX_PENDING_LINES     = QStringLiteral("Overload/maxPendingLines");
+const QString PRINT_SAMPLING        = QStringLiteral("Overload/printSampling");
 const QString TRACEVIEW_AUTOSCROLL  = QStringLiteral("Traceview/autoscroll");
+const QString TRACEVIEW_TIMESTAMPS  = QStringLiteral("Traceview/timestamps");
 const QString HIGHLIGHTS            = QStringLiteral("Traceview/highlights");
+const QString RETENTION_MAX_LINES   = QStringLiteral("Retention/maxLines");
+const QString RETENTION_MAX_MEMORY  = QStringLiteral("Retention/maxMemoryMB");
+const QString RETENTION_SPILL       = QStringLiteral("Retention/spillToDisk");
+const QString RETENTION_MAX_DISK    = QStringLiteral("Retention/maxDiskMB");
+const QString RETENTION_COMPRESS    = QStringLiteral("Retention/compress");
+const QString JOURNAL_ENABLED       = QStringLiteral("Journal/enabled");
+const QString JOURNAL_DIRECTORY     = QStringLiteral("Journal/directory");
+const QString JOURNAL_MAX_SESSIONS  = QStringLiteral("Journal/maxSessions");
+const QString JOURNAL_MAX_SIZE      = QStringLiteral("Journal/maxSessionMB");
 const QString MAINWINDOW_GEOMETRY   = QStringLiteral("Mainwindow/geometry");
 const QString SEARCH_CASESENSITIVE  = QStringLiteral("Search/caseSensitive");
 const QString SEARCH_LOOPSEARCH     = QStringLiteral("Search/loopSearch");
@@ -0,0 +1,94 @@
+#ifndef HEADLESSCAPTURE_H
+#define HEADLESSCAPTURE_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+#include <QTextStream>
+#include "traceline.h"
+#include "overloadpolicy.h"
+
+QT_BEGIN_NAMESPACE
+struct IngestStats;
+class QThread;
+QT_END_NAMESPACE
+
+///
+/// \brief The HeadlessCapture class writes the traces to rotating files instead of the
+///        live view, for the captures without a display. It is run by the same binary
+///        with --headless, in a QCoreApplication, without creating any widget.
+///        The files are named <base>-<start time>-<index>.<suffix>, a new file is started
+///        once the current one reaches the maximum size, and the oldest files of the
+///        capture are removed beyond the maximum count.
+///        The send trace thread only formats the lines into a buffer, a writer thread
+///        writes it, so that a stall of the disk does not hold the framing of the traces.
+///
+class HeadlessCapture : public QObject
+{
+    Q_OBJECT
+public:
+    HeadlessCapture(const QString& outputPath, qint64 maxFileSize, int maxFiles);
+    ~HeadlessCapture();
+
+    static bool isRequested(int argc, char* argv[]);
+    static int run(int argc, char* argv[]);
+
+    bool open(QString& errorString);
+    void close();
+
+public slots:
+    void writeTraces(TraceLines);
+    void setSourceName(quint16, QString);
+    void onBindResult(QString, quint16, bool);
+    void onEndpointResult(QString, bool);
+    void onIngestStatsUpdated(const IngestStats&);
+    void onOverloadStatsChanged(OverloadStats);
+    void printSummary();
+
+signals:
+    void tracesWritten(int, qint64);
+
+private:
+    QString fileName(int index) const;
+    bool openNextFile();
+    void write();
+    void writeBatch();
+
+    // Shared with the send trace thread
+    QMutex       m_mutex;
+    QWaitCondition m_bufferReady;
+    QWaitCondition m_bufferWritten;
+    QByteArray   m_buffer;           // Formatted lines waiting for the writer
+    bool         m_open{false};
+    bool         m_closing{false};
+    QHash<quint16, QString> m_sourceNames;
+    QString      m_fileName;         // Of the current file, for the summary
+    QAtomicInteger<quint64> m_writtenLines{0};
+    QAtomicInteger<quint64> m_writtenBytes{0};
+
+    // Writer thread
+    QThread*     m_writer{nullptr};
+    QByteArray   m_batch;
+    QString      m_outputPath;
+    QDateTime    m_startTime;
+    qint64       m_maxFileSize{0};
+    int          m_maxFiles{0};      // 0 keeps all the files
+    int          m_fileIndex{0};
+    QFile        m_file;
+
+    // Summary, in the main thread
+    QTextStream  m_out;
+    quint64      m_kernelDrops{0};
+    quint64      m_ringDrops{0};
+    quint64      m_overloadDrops{0};
+    quint64      m_lastLines{0};
+    quint64      m_lastBytes{0};
+    QElapsedTimer m_summaryElapsed;
+};
+
+#endif // HEADLESSCAPTURE_H
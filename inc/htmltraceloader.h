@@ -0,0 +1,23 @@
+#ifndef HTMLTRACELOADER_H
+#define HTMLTRACELOADER_H
+
+#include "traceloader.h"
+
+///
+/// \brief The HtmlTraceLoader class reads and parses a saved html trace file in a worker
+///        thread, and hands its lines with their colors to its own thread part by part.
+///
+class HtmlTraceLoader : public TraceLoader
+{
+    Q_OBJECT
+public:
+    explicit HtmlTraceLoader(const QString& path);
+    ~HtmlTraceLoader();
+
+private:
+    void load() override;
+
+    QString m_path;
+};
+
+#endif // HTMLTRACELOADER_H
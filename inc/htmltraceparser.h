@@ -0,0 +1,36 @@
+#ifndef HTMLTRACEPARSER_H
+#define HTMLTRACEPARSER_H
+
+#include <QByteArray>
+#include <QVector>
+#include "linestore.h"
+
+///
+/// \brief The HtmlTraceParser class extracts the lines and their colors from the html
+///        files saved by the views, and by the former rich text views: one line per
+///        paragraph, one color run per colored span. The rest of the document is skipped.
+///        The document can be given in parts cut anywhere, a tag or an entity cut at the
+///        end of a part is kept for the next one.
+///
+class HtmlTraceParser
+{
+public:
+    void parse(const QByteArray& data, LineBlock& lines);
+    void finish(LineBlock& lines);
+
+private:
+    void parseTag(const char* tag, int size, LineBlock& lines);
+    void parseEntity(const char* entity, int size);
+    void appendText(const char* data, int size);
+    void appendCodePoint(uint);
+    void endLine(LineBlock& lines);
+
+    QByteArray   m_pending;             // Tag or entity cut at the end of the last part
+    bool         m_inParagraph{false};
+    QByteArray   m_text;                // UTF-8 text of the current line
+    int          m_column{0};           // Length of the current line once decoded
+    QVector<ColorSpan> m_spans;
+    QVector<QRgb> m_colors;             // Colors of the open spans
+};
+
+#endif // HTMLTRACEPARSER_H
@@ -0,0 +1,43 @@
+#ifndef INGESTENDPOINT_H
+#define INGESTENDPOINT_H
+
+#include <QString>
+
+///
+/// \brief Description of an ingest endpoint, written as text in the settings:
+///        "udp:<address>:<port>", "serial:<port name>[@<baud rate>]",
+///        "tcp:<address>:<port>" or "unix:<socket path>" (a named pipe on Windows)
+///
+struct IngestEndpoint
+{
+    enum Type
+    {
+        Invalid,
+        Udp,
+        Serial,
+        Tcp,
+        Local
+    };
+
+    Type    type{Invalid};
+    QString address;           // Host address, serial port name or local socket path
+    quint16 port{0};
+    qint32  baudRate{115200};
+
+    inline bool isValid() const;
+    inline bool isStream() const;
+    QString toString() const;
+    static IngestEndpoint fromString(const QString&);
+};
+
+inline bool IngestEndpoint::isValid() const
+{
+    return type != Invalid;
+}
+
+inline bool IngestEndpoint::isStream() const
+{
+    return type == Tcp || type == Local;
+}
+
+#endif // INGESTENDPOINT_H
@@ -0,0 +1,25 @@
+#ifndef JOURNALLOADER_H
+#define JOURNALLOADER_H
+
+#include "traceloader.h"
+
+///
+/// \brief The JournalLoader class reads the session journal of a capture in a worker
+///        thread, and hands its lines to its own thread part by part, the way the live
+///        view showed them. The records after the last checkpoint are checked, the
+///        reading of a segment stops at the first one which is torn or corrupted.
+///
+class JournalLoader : public TraceLoader
+{
+    Q_OBJECT
+public:
+    explicit JournalLoader(const QString& sessionPath);
+    ~JournalLoader();
+
+private:
+    void load() override;
+
+    QString m_path;
+};
+
+#endif // JOURNALLOADER_H
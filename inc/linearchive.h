@@ -0,0 +1,100 @@
+#ifndef LINEARCHIVE_H
+#define LINEARCHIVE_H
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QVector>
+#include <QList>
+#include "linestore.h"
+
+///
+/// \brief The LineArchive class keeps the blocks of lines which left the memory of a line
+///        store, in append-only segment files of a temporary directory, removed with it.
+///        Only one entry per block is kept in memory, the last blocks read are cached.
+///        Beyond the maximum disk usage, the oldest segments are removed with their lines.
+///
+class LineArchive
+{
+public:
+    LineArchive();
+    ~LineArchive();
+
+    inline bool isValid() const;
+    int append(const LineBlock& block, int skip);
+    void removeFirst(int);
+    const LineBlock* blockAt(int line, int& index);
+
+    inline int size() const;
+    inline qint64 diskUsage() const;
+    inline void setMaxDiskUsage(qint64);
+    qint64 memoryUsage() const;
+
+    LineArchive(const LineArchive&) = delete;
+    LineArchive& operator=(const LineArchive&) = delete;
+
+private:
+    // A block in a segment file, the lines are numbered since the creation of the archive
+    struct Entry
+    {
+        qint64 start;   // Number of the first line kept
+        int    skip;    // Lines of the block removed before it was archived
+        int    lines;   // Lines of the block, including the skipped ones
+        int    segment;
+        qint64 offset;
+        int    size;
+
+        inline qint64 end() const;
+    };
+    struct CachedBlock
+    {
+        qint64     start;
+        LineBlock* block;
+    };
+
+    QString segmentPath(int) const;
+    bool openNextSegment();
+    void removeSegmentsBefore(int);
+    int removeOldestSegment();
+    void clearCache();
+
+    QTemporaryDir   m_dir;
+    QVector<Entry>  m_entries;
+    QVector<qint64> m_segmentSizes;     // Sizes of the segments from m_firstSegment
+    int             m_firstSegment{0};
+    int             m_nextSegment{0};
+    QFile           m_writer;           // Last segment
+    QFile           m_reader;           // Segment of the last block read
+    int             m_readSegment{-1};
+    qint64          m_start{0};         // Number of the first line
+    qint64          m_end{0};
+    qint64          m_diskUsage{0};
+    qint64          m_maxDiskUsage{0};  // 0 is no limit
+    QList<CachedBlock> m_cache;         // Most recently read first
+};
+
+inline bool LineArchive::isValid() const
+{
+    return m_dir.isValid();
+}
+
+inline int LineArchive::size() const
+{
+    return int(m_end - m_start);
+}
+
+inline qint64 LineArchive::diskUsage() const
+{
+    return m_diskUsage;
+}
+
+inline void LineArchive::setMaxDiskUsage(qint64 maxDiskUsage)
+{
+    m_maxDiskUsage = maxDiskUsage;
+}
+
+inline qint64 LineArchive::Entry::end() const
+{
+    return start + lines - skip;
+}
+
+#endif // LINEARCHIVE_H
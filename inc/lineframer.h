@@ -0,0 +1,113 @@
+#ifndef LINEFRAMER_H
+#define LINEFRAMER_H
+
+#include <QByteArray>
+#include <QList>
+
+///
+/// \brief The LineFramer class splits the incoming raw bytes into lines.
+///        The chunks are kept as they are received (implicitly shared, not copied)
+///        and the complete lines are handed out as views into them. Only a line
+///        spanning several chunks is stitched into an internal carry buffer.
+///        Lines end with "\r\n" or a bare "\n", the terminator is not part of the line.
+///
+class LineFramer
+{
+public:
+    void append(const QByteArray& chunk);
+    void clear();
+
+    inline bool isEmpty() const;
+    inline int partialLineSize() const;
+    QByteArray takePartialLine();
+
+    // Call callback(const char* data, int size) for every complete line.
+    // The view is only valid during the call.
+    template <typename Callback>
+    int takeLines(Callback&& callback);
+
+    // Frame the given bytes right away, without queuing them. Only the incomplete
+    // line at the end is copied, to be completed by the next data.
+    template <typename Callback>
+    int feed(const char* data, int size, Callback&& callback);
+
+    static const char* findNewline(const char* begin, const char* end);
+
+private:
+    template <typename Callback>
+    int scan(const char* pos, const char* end, Callback& callback);
+
+    QList<QByteArray> m_chunks;
+    QByteArray        m_carry;  // Incomplete line waiting for the next chunk
+};
+
+inline bool LineFramer::isEmpty() const
+{
+    return m_chunks.isEmpty() && m_carry.isEmpty();
+}
+
+inline int LineFramer::partialLineSize() const
+{
+    int size = m_carry.size();
+    for (const auto& chunk : m_chunks)
+    {
+        size += chunk.size();
+    }
+    return size;
+}
+
+template <typename Callback>
+int LineFramer::takeLines(Callback&& callback)
+{
+    int count = 0;
+    for (const auto& chunk : qAsConst(m_chunks))
+    {
+        count += scan(chunk.constData(), chunk.constData() + chunk.size(), callback);
+    }
+    m_chunks.clear();
+    return count;
+}
+
+template <typename Callback>
+int LineFramer::feed(const char* data, int size, Callback&& callback)
+{
+    // Keep the order if some chunks are still queued
+    int count = takeLines(callback);
+    return count + scan(data, data + size, callback);
+}
+
+template <typename Callback>
+int LineFramer::scan(const char* pos, const char* end, Callback& callback)
+{
+    int count = 0;
+    while (pos < end)
+    {
+        const char* newline = findNewline(pos, end);
+        if (!newline)
+        {
+            m_carry.append(pos, int(end - pos));
+            break;
+        }
+
+        if (m_carry.isEmpty())
+        {
+            const char* lineEnd = (newline > pos && newline[-1] == '\r') ? newline - 1 : newline;
+            callback(pos, int(lineEnd - pos));
+        }
+        else
+        {
+            m_carry.append(pos, int(newline - pos));
+            if (m_carry.endsWith('\r'))
+            {
+                m_carry.chop(1);
+            }
+            callback(m_carry.constData(), m_carry.size());
+            m_carry.clear();
+        }
+        ++count;
+        pos = newline + 1;
+    }
+    return count;
+}
+
+#endif // LINEFRAMER_H
@@ -0,0 +1,278 @@
+#ifndef LINESTORE_H
+#define LINESTORE_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QColor>
+#include <QMetaType>
+#include "timestampcolumn.h"
+#include "traceline.h"
+#include "mappedtracefile.h"
+
+QT_BEGIN_NAMESPACE
+class LineArchive;
+class CompressedBlocks;
+QT_END_NAMESPACE
+
+///
+/// \brief The ColorSpan struct is a run of the color of a line, from its start column
+///        to the start of the next span or the end of the line. A color without alpha
+///        is the default color of the view.
+///
+struct ColorSpan
+{
+    int  start{0};
+    QRgb color{0};
+};
+
+///
+/// \brief The TextRange struct is a range of text in a line of the view, the columns
+///        are counted in the decoded line. A null range has no line.
+///
+struct TextRange
+{
+    int line{-1};
+    int start{0};
+    int length{0};
+
+    inline bool isNull() const;
+    inline int end() const;
+    inline bool operator==(const TextRange&) const;
+    inline bool operator!=(const TextRange&) const;
+    inline bool operator<(const TextRange&) const;
+    inline bool operator<=(const TextRange&) const;
+};
+
+Q_DECLARE_METATYPE(TextRange)
+
+///
+/// \brief The LineBlock struct holds up to LineStore::BLOCK_LINES consecutive lines: their
+///        UTF-8 text in one arena indexed by the offset of every line, the color runs of
+///        the colored lines, and the receive time of the lines if they have one.
+///        In a line store, the text refers to the tokens interned by the store.
+///        A binary line is a TraceDictionary record followed by the text shown before it,
+///        e.g. the endpoint tag: it is kept as received and formatted when it is read.
+///
+struct LineBlock
+{
+    QByteArray         text;           // UTF-8 text of the lines, without the line breaks
+    QVector<quint32>   offsets{0};     // Start of every line in text, then the end of the last line
+    QVector<ColorSpan> spans;          // Color runs of all the lines
+    QVector<quint32>   spanOffsets{0}; // First span of every line, then the end of the last spans
+    TimestampColumn    timestamps;     // Empty until a line has a timestamp
+    QVector<TraceLine::Encoding> encodings; // Empty until a line is binary
+    qint64             decodedSize{0}; // Size of the text once the interned tokens are expanded
+
+    inline int size() const;
+    void append(const char* data, int size, const ColorSpan* lineSpans, int spanCount, qint64 timestamp,
+                TraceLine::Encoding encoding = TraceLine::Text);
+    void removeLast();
+    QVector<ColorSpan> lineSpans(int) const;
+    inline qint64 timestamp(int) const;
+    inline TraceLine::Encoding encoding(int) const;
+    void squeeze();
+    qint64 memoryUsage() const;
+    QByteArray serialize(bool delta = false) const;
+    bool deserialize(const QByteArray&, bool delta = false);
+};
+
+///
+/// \brief The LineStore class keeps the lines of a view without any layout, in blocks of
+///        BLOCK_LINES lines. The lines are decoded only when they are painted, searched
+///        or saved.
+///        The first lines are removed by moving the first line index, a block is freed
+///        once all its lines are removed.
+///        With compression, the blocks beyond the last HOT_BLOCKS are compressed in memory.
+///        With a retention budget, the oldest blocks beyond it leave the memory: they are
+///        written to an archive on disk and read back when needed, or dropped.
+///        The lines of an opened file come first, read from the mapped file; nothing is
+///        appended before the file is indexed.
+///        The tokens recurring at the start of the lines, e.g. the endpoint and module
+///        tags or the level, are interned in a dictionary of the store: the line keeps a
+///        reference to them, and its text is rebuilt when it is read.
+///
+class LineStore
+{
+public:
+    ///
+    /// \brief The MemoryReport struct is the memory used by the lines of a store
+    ///
+    struct MemoryReport
+    {
+        int    lines{0};
+        int    linesOnDisk{0};
+        qint64 memoryUsage{0};
+        qint64 diskUsage{0};
+        qint64 textSize{0};        // Text of the uncompressed blocks, as stored
+        qint64 decodedTextSize{0}; // The same text with the interned tokens expanded
+        int    compressedLines{0};
+        qint64 compressedSize{0};
+        qint64 uncompressedSize{0}; // Memory used by the same lines before their compression
+        int    tokens{0};
+        qint64 dictionarySize{0};  // Memory used by the interned tokens
+    };
+
+    LineStore();
+    ~LineStore();
+
+    void append(const char* data, int size, const ColorSpan* spans = nullptr, int spanCount = 0,
+                qint64 timestamp = 0);
+    void append(const QByteArray& text, const QVector<ColorSpan>& spans = QVector<ColorSpan>(),
+                qint64 timestamp = 0);
+    void append(const QString& text, const QVector<ColorSpan>& spans = QVector<ColorSpan>(),
+                qint64 timestamp = 0);
+    void append(const LineBlock&);
+    void appendRecord(const char* record, int size, const QByteArray& tag = QByteArray(), qint64 timestamp = 0);
+    void removeFirst(int);
+    void removeLast();
+    void clear();
+    void setFile(MappedTraceFile*);
+
+    void setRetention(int maxLines, qint64 maxMemory, bool spillToDisk, qint64 maxDiskUsage);
+    void setCompression(bool);
+    int takeDroppedLines();
+
+    inline int size() const;
+    inline bool isEmpty() const;
+    inline bool isLoading() const;
+    QByteArray lineData(int) const;
+    QString line(int) const;
+    QVector<ColorSpan> spans(int) const;
+    qint64 timestamp(int) const;
+    inline int maxLineLength() const;
+    qint64 memoryUsage() const;
+    int linesOnDisk() const;
+    qint64 diskUsage() const;
+    MemoryReport memoryReport() const;
+
+    static constexpr int BLOCK_LINES = 4096;
+    static constexpr int HOT_BLOCKS = 16;
+
+    LineStore(const LineStore&) = delete;
+    LineStore& operator=(const LineStore&) = delete;
+
+private:
+    const LineBlock* blockAt(int line, int& index) const;
+    inline int fileLines() const;
+    inline int memoryLines() const;
+    LineBlock* growingBlock();
+    void appendBinary(const char* data, int size, qint64 timestamp);
+    void compressOldBlocks();
+    void applyRetention();
+    qint64 retainedMemory() const;
+    void releaseFirstBlock();
+    bool internTokens(const char* data, int size);
+    int tokenId(const char* token, int size);
+    QByteArray expandTokens(const char* data, int size) const;
+    qint64 dictionarySize() const;
+
+    MappedTraceFile*   m_file{nullptr};
+    int                m_fileFirst{0}; // Lines removed from the start of the file
+    QVector<LineBlock*> m_blocks;      // In memory, all full but the last one
+    int                m_first{0};     // Lines removed from the first block
+    int                m_maxLineLength{0};
+    qint64             m_fullBlocksMemory{0};
+    LineArchive*       m_archive{nullptr};
+    int                m_archivedLines{0};
+    int                m_droppedLines{0}; // Dropped by the retention, not taken by the view yet
+    CompressedBlocks*  m_compressed{nullptr};
+    int                m_compressedLines{0};
+    bool               m_compress{false};
+
+    // Interned tokens, a line refers to them by their index
+    QVector<QByteArray> m_tokens;
+    QHash<QByteArray, int> m_tokenIds;
+    qint64             m_tokenBytes{0};
+    QVector<uint>      m_seenTokens;    // Hash of the last candidate of every slot, interned on the second sight
+    QByteArray         m_encoded;       // Text of the line being appended, with its references
+
+    // Retention, 0 is no limit
+    int                m_maxLines{0};
+    qint64             m_maxMemory{0};
+    bool               m_spillToDisk{true};
+    qint64             m_maxDiskUsage{0};
+};
+
+inline int LineBlock::size() const
+{
+    return offsets.size() - 1;
+}
+
+inline qint64 LineBlock::timestamp(int index) const
+{
+    return index < timestamps.size() ? timestamps.at(index) : 0;
+}
+
+inline TraceLine::Encoding LineBlock::encoding(int index) const
+{
+    return index < encodings.size() ? encodings.at(index) : TraceLine::Text;
+}
+
+inline int LineStore::fileLines() const
+{
+    return m_file ? m_file->lineCount() - m_fileFirst : 0;
+}
+
+inline int LineStore::memoryLines() const
+{
+    if (m_blocks.isEmpty())
+    {
+        return 0;
+    }
+    return (m_blocks.size() - 1) * BLOCK_LINES + m_blocks.last()->size() - m_first;
+}
+
+inline int LineStore::size() const
+{
+    return fileLines() + m_archivedLines + m_compressedLines + memoryLines();
+}
+
+inline bool LineStore::isEmpty() const
+{
+    return size() == 0;
+}
+
+inline bool LineStore::isLoading() const
+{
+    return m_file && !m_file->isIndexed();
+}
+
+inline int LineStore::maxLineLength() const
+{
+    return m_file ? qMax(m_maxLineLength, m_file->maxLineLength()) : m_maxLineLength;
+}
+
+inline bool TextRange::isNull() const
+{
+    return line < 0;
+}
+
+inline int TextRange::end() const
+{
+    return start + length;
+}
+
+inline bool TextRange::operator==(const TextRange& other) const
+{
+    return line == other.line && start == other.start && length == other.length;
+}
+
+inline bool TextRange::operator!=(const TextRange& other) const
+{
+    return !(*this == other);
+}
+
+inline bool TextRange::operator<(const TextRange& other) const
+{
+    return line < other.line || (line == other.line && start < other.start);
+}
+
+inline bool TextRange::operator<=(const TextRange& other) const
+{
+    return !(other < *this);
+}
+
+#endif // LINESTORE_H
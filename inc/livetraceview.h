@@ -2,6 +2,12 @@
 #define LIVETRACEVIEW_H
 
 #include "traceview.h"
+#include "traceline.h"
+#include <QElapsedTimer>
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
 
 class LiveTraceView : public TraceView
 {
@@ -10,32 +16,84 @@ public:
     LiveTraceView();
 
     inline bool isAutoScrollEnabled() const override;
+    inline bool isTimestampShown() const;
     inline QString getRemoteAddress() const;
 
 signals:
     void interfaceChangeRequested(QString);
     void portChangeRequested(quint16);
+    void endpointsChangeRequested(QStringList);
+    void serialPortChangeRequested(QString, qint32);
+    void tracesDisplayed(int, qint64);
+    void displayLatencyMeasured(qint64);
+    void replayRequested(QString, double);
 
 public slots:
     void toggleAutoScroll();
+    void toggleTimestamps();
+    void clear() override;
     void promptAndSetRemoteInterface();
+    void promptAndSetEndpoints();
+    void promptAndSetSerialPort();
+    void promptAndLoadDictionary();
+    void promptAndReplay();
+    void onReplayFinished(QString, quint64, qint64, QString);
     void onSocketBindResult(QString, quint16, bool);
-    void onNewTracesReady(QStringList);
+    void onNewTracesReady(TraceLines);
+    void onEndpointResult(QString, bool);
+    void setSourceName(quint16, QString);
+
+protected:
+    void resizeEvent(QResizeEvent* event) override;
+    void writePlainText(QTextStream&) override;
 
 private:
+    friend class TimestampGutter;
+
     void createTraceActions(); // Not an override method due to calling in constructor
     void createNetworkActions(); // Not an override method due to calling in constructor
 
     void changeInterface(const QString&);
     void changePort();
+    void updateSerialPortAction();
+    void updateTimestampGutter();
+    void paintTimestamps(QPaintEvent*);
+    int timestampGutterWidth() const;
+    QString formatTimestamp(qint64) const;
+    void reportReplay();
 
     //! [Attr]
     bool         m_autoScroll{false};
+    bool         m_showTimestamps{false};
+    qint64       m_timeOrigin{0};      // Receive time of the first trace, shown as 0
+    QWidget*     m_timestampGutter{nullptr};
+
+    // Measure of the running replay, from its start to the display of its last line
+    struct ReplayStats
+    {
+        bool          active{false};
+        bool          readDone{false};
+        QString       path;
+        quint64       readLines{0};
+        qint64        readNs{0};
+        quint64       displayedLines{0};
+        qint64        displayedNs{0};
+        qint64        latencySumNs{0};
+        qint64        latencyMaxNs{0};
+        int           batches{0};
+        QElapsedTimer elapsed;
+    };
+    ReplayStats  m_replay;
+    QTimer*      m_replayDrainTimer{nullptr}; // Reports the replay if the view gets no more lines
 
     QAction*     m_lastSetItfAct{nullptr};
     QString      m_waitingStep{"oooo0"};
     quint16      m_currentPort{911}; // for context menu
     QString      m_remoteAddress{"192.168.137.1"}; // For context menu, managed on gui
+    QStringList  m_endpoints;                      // For context menu, managed on gui
+    QString      m_serialPortName;                 // For context menu, managed on gui
+    qint32       m_serialBaudRate{115200};         // For context menu, managed on gui
+    QHash<quint16, QString> m_sourceNames;         // Tag of the traces of additional endpoints
 };
 
 inline bool LiveTraceView::isAutoScrollEnabled() const
@@ -43,6 +101,11 @@ inline bool LiveTraceView::isAutoScrollEnabled() const
     return m_autoScroll;
 }
 
+inline bool LiveTraceView::isTimestampShown() const
+{
+    return m_showTimestamps;
+}
+
 inline QString LiveTraceView::getRemoteAddress() const
 {
     return m_remoteAddress;
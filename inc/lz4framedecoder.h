@@ -0,0 +1,79 @@
+#ifndef LZ4FRAMEDECODER_H
+#define LZ4FRAMEDECODER_H
+
+#include <QByteArray>
+#include <QString>
+
+///
+/// \brief The Lz4FrameDecoder class decompresses the LZ4 frame format incrementally,
+///        one block at a time, so that the caller can wait for room before decoding
+///        the next block. Concatenated and skippable frames are supported, the
+///        checksums are skipped (the transport already checks the data).
+///        The input and output buffers are allocated once and reused.
+///
+class Lz4FrameDecoder
+{
+public:
+    enum Status
+    {
+        Decoded,    // One block is decoded
+        NeedInput,  // The buffered input has no complete block
+        Error       // Corrupted input, reset() before reusing the decoder
+    };
+
+    Lz4FrameDecoder();
+    static inline bool isFrame(const char*, int);
+
+    void reset();
+    void append(const char*, int);
+    Status decodeBlock(const char*& output, int& outputSize);
+    inline int maxBlockSize() const;
+    inline bool isIdle() const;
+    inline QString errorString() const;
+
+    static constexpr quint32 MAGIC = 0x184D2204;
+    static constexpr int MAGIC_SIZE = 4;
+
+private:
+    enum State
+    {
+        FrameStart,
+        BlockStart
+    };
+    Status fail(const QString&);
+
+    QByteArray m_input;
+    int        m_inputOffset{0};
+    QByteArray m_window;             // History of the linked blocks, then the current block
+    int        m_historySize{0};
+    int        m_lastOutputSize{0};  // Moved into the history at the next call
+    State      m_state{FrameStart};
+    bool       m_linkedBlocks{false};
+    bool       m_blockChecksum{false};
+    bool       m_contentChecksum{false};
+    int        m_maxBlockSize{64 * 1024};
+    QString    m_errorString;
+};
+
+inline bool Lz4FrameDecoder::isFrame(const char* data, int size)
+{
+    return size >= 4 && uchar(data[0]) == 0x04 && uchar(data[1]) == 0x22
+            && uchar(data[2]) == 0x4D && uchar(data[3]) == 0x18;
+}
+
+inline int Lz4FrameDecoder::maxBlockSize() const
+{
+    return m_maxBlockSize;
+}
+
+inline bool Lz4FrameDecoder::isIdle() const
+{
+    return m_state == FrameStart && m_inputOffset == m_input.size();
+}
+
+inline QString Lz4FrameDecoder::errorString() const
+{
+    return m_errorString;
+}
+
+#endif // LZ4FRAMEDECODER_H
@@ -9,7 +9,9 @@ QT_BEGIN_NAMESPACE
 class QAction;
 class QActionGroup;
 class QMenu;
-class QTextEdit;
+class QLabel;
+struct IngestStats;
+struct OverloadStats;
 QT_END_NAMESPACE
 
 class MainWindow : public QMainWindow
@@ -22,6 +24,7 @@ public:
     inline bool isOccurrencesHighlighted() const;
     void hightlightAllOccurrences();
     void setCustomHighlights(const QStringList&);
+    void recoverSessions(const QStringList&);
 
 protected:
     void closeEvent(QCloseEvent* event) override;
@@ -38,6 +41,10 @@ public slots:
     void onCopyAvailable(bool);
     void showSearchDock(bool advanced = false);
     void onSearchDockHidden();
+    void onBacklogChanged(int);
+    void onDisplayLatencyMeasured(qint64);
+    void onIngestStatsUpdated(const IngestStats&);
+    void onOverloadStatsChanged(const OverloadStats&);
 
 signals:
     void highlightChanged();
@@ -52,9 +59,11 @@ private:
     void onSearchRequested(bool, bool);
     void normalSearch(bool);
     void advancedSearch();
-    void onSearchResultSelected(const QTextCursor);
+    void onSearchResultSelected(const TextRange);
 
     void openFile(const QString&);
+    void openJournal(const QString&);
+    TraceView* addOfflineView(const QString&);
     void clearOccurrencesHighlight();
 
     //! [Menus]
@@ -78,10 +87,13 @@ private:
     QTabWidget*    m_tabWidget {nullptr};
     LiveTraceView* m_liveView {nullptr};
     SearchDock*    m_searchDock {nullptr};
+    QLabel*        m_backlogLabel {nullptr};
+    QLabel*        m_latencyLabel {nullptr};
+    QLabel*        m_ingestLabel {nullptr};
+    QLabel*        m_overloadLabel {nullptr};
 
     //! [Attr]
     bool           m_isOccurrencesHighlighted {false};
-    QTextCursor    m_lastSearchCursor;
     TraceView*     m_viewInAdvSearch {nullptr};
     int            m_lastTabIndex {0};
 };
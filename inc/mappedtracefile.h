@@ -0,0 +1,96 @@
+#ifndef MAPPEDTRACEFILE_H
+#define MAPPEDTRACEFILE_H
+
+#include <QObject>
+#include <QFile>
+#include <QFuture>
+#include <QVector>
+#include <QAtomicInteger>
+
+///
+/// \brief The MappedTraceFile class opens a plain text trace file without reading it:
+///        the file is memory-mapped and its line breaks are indexed by a worker thread,
+///        which spreads the scan of its chunks over all the cores.
+///        Only the start of every INDEX_INTERVAL-th line is kept, a line is found by
+///        scanning from the previous indexed one, or from the last line read.
+///        The index grows in the thread of the object while the worker goes on, the lines
+///        indexed so far can already be read.
+///
+class MappedTraceFile : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MappedTraceFile(const QString& path);
+    ~MappedTraceFile();
+
+    bool open();
+    inline QString errorString() const;
+
+    inline qint64 size() const;
+    inline qint64 indexedSize() const;
+    inline bool isIndexed() const;
+    inline int lineCount() const;
+    inline int maxLineLength() const;
+    QByteArray lineData(int) const;
+    qint64 memoryUsage() const;
+
+    static constexpr int INDEX_INTERVAL = 64;
+
+signals:
+    void linesIndexed();
+
+private:
+    void buildIndex();
+    void onChunkIndexed(const QVector<qint64>& offsets, int lineCount, int maxLineLength,
+                        qint64 indexedSize, bool indexed);
+
+    QFile        m_file;
+    QString      m_errorString;
+    const char*  m_data{nullptr};
+    qint64       m_size{0};
+    QFuture<void> m_indexer;
+    QAtomicInteger<bool> m_stopIndexing{false};
+
+    // Index, only updated in the thread of the object
+    QVector<qint64> m_offsets;         // Start of the lines 0, INDEX_INTERVAL, 2 * INDEX_INTERVAL...
+    int          m_lineCount{0};
+    int          m_maxLineLength{0};
+    qint64       m_indexedSize{0};
+    bool         m_indexed{false};
+
+    // Last line read, the following lines are found from it
+    mutable int    m_lastLine{-1};
+    mutable qint64 m_lastLineEnd{0};
+};
+
+inline QString MappedTraceFile::errorString() const
+{
+    return m_errorString;
+}
+
+inline qint64 MappedTraceFile::size() const
+{
+    return m_size;
+}
+
+inline qint64 MappedTraceFile::indexedSize() const
+{
+    return m_indexedSize;
+}
+
+inline bool MappedTraceFile::isIndexed() const
+{
+    return m_indexed;
+}
+
+inline int MappedTraceFile::lineCount() const
+{
+    return m_lineCount;
+}
+
+inline int MappedTraceFile::maxLineLength() const
+{
+    return m_maxLineLength;
+}
+
+#endif // MAPPEDTRACEFILE_H
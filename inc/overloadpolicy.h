@@ -0,0 +1,110 @@
+#ifndef OVERLOADPOLICY_H
+#define OVERLOADPOLICY_H
+
+#include <QQueue>
+#include <QFile>
+#include <QMetaType>
+#include "traceline.h"
+
+QT_BEGIN_NAMESPACE
+class QTemporaryFile;
+QT_END_NAMESPACE
+
+///
+/// \brief Number of lines each overload policy acted on since the start
+///
+struct OverloadStats
+{
+    quint64 droppedLines{0};    // Oldest lines dropped to bound the queue
+    quint64 sampledLines{0};    // PRINT lines skipped by the 1-in-N sampling
+    quint64 spilledLines{0};    // Lines written to disk, displayed later
+    quint64 protectedLines{0};  // ERROR/PANIC lines kept while the lines around were dropped
+    int     linesOnDisk{0};     // Spilled lines not read back yet
+
+    inline bool operator==(const OverloadStats&) const;
+    inline bool operator!=(const OverloadStats&) const;
+};
+
+Q_DECLARE_METATYPE(OverloadStats)
+
+///
+/// \brief The OverloadPolicy class bounds the queue of the traces waiting for the view
+///        when the ingest rate exceeds the render rate:
+///        - Unbounded: the queue grows, as long as the memory allows.
+///        - DropOldest: above the maximum, the oldest lines are dropped, except ERROR/PANIC.
+///        - SpillToDisk: above the maximum, the new lines go to a temporary file and are
+///          read back in order once the view catches up. Nothing is dropped.
+///        In all modes, PRINT lines can be sampled 1-in-N once the queue is half full.
+///        Used in the send trace thread only.
+///
+class OverloadPolicy
+{
+public:
+    enum Mode
+    {
+        Unbounded,
+        DropOldest,
+        SpillToDisk
+    };
+
+    OverloadPolicy();
+    ~OverloadPolicy();
+
+    void enqueue(QQueue<TraceLine>& pending, const TraceLine& line);
+    void refill(QQueue<TraceLine>& pending);
+    inline Mode mode() const;
+    inline const OverloadStats& stats() const;
+
+    OverloadPolicy(const OverloadPolicy&) = delete;
+    OverloadPolicy& operator=(const OverloadPolicy&) = delete;
+
+private:
+    enum Level
+    {
+        OtherLevel,
+        PrintLevel,
+        ProtectedLevel  // ERROR and PANIC, never dropped nor sampled
+    };
+    static Level levelOf(const TraceLine&);
+    void trimOldest(QQueue<TraceLine>&);
+    void forgetTakenLines(const QQueue<TraceLine>&);
+    bool spill(const TraceLine&);
+    bool readSpilled(TraceLine&);
+
+    Mode            m_mode{DropOldest};
+    int             m_maxPendingLines{0};
+    int             m_printSampling{1};   // Keep 1 PRINT line out of N, 1 keeps them all
+    quint64         m_printCount{0};
+    int             m_queueSize{0};       // Size of the queue when the policy last changed it
+    int             m_keptLines{0};       // ERROR/PANIC lines at the front of the queue, kept by a trim
+
+    QTemporaryFile* m_spillFile{nullptr}; // Written at the end
+    QFile           m_spillReader;        // Read from the start, same file
+    QByteArray      m_spillRecord;        // Reused to serialize a line
+
+    OverloadStats   m_stats;
+};
+
+inline bool OverloadStats::operator==(const OverloadStats& other) const
+{
+    return droppedLines == other.droppedLines && sampledLines == other.sampledLines
+            && spilledLines == other.spilledLines && protectedLines == other.protectedLines
+            && linesOnDisk == other.linesOnDisk;
+}
+
+inline bool OverloadStats::operator!=(const OverloadStats& other) const
+{
+    return !(*this == other);
+}
+
+inline OverloadPolicy::Mode OverloadPolicy::mode() const
+{
+    return m_mode;
+}
+
+inline const OverloadStats& OverloadPolicy::stats() const
+{
+    return m_stats;
+}
+
+#endif // OVERLOADPOLICY_H
@@ -0,0 +1,69 @@
+#ifndef RECORDFRAMER_H
+#define RECORDFRAMER_H
+
+#include <QByteArray>
+#include "tracedictionary.h"
+
+///
+/// \brief The RecordFramer class splits the binary traces of a sender into records.
+///        The complete records are handed out as views into the received data, only
+///        a record spanning several reads or blocks is stitched into a carry buffer.
+///        The data must start at a record, i.e. after the magic.
+///
+class RecordFramer
+{
+public:
+    inline void clear();
+    inline bool isEmpty() const;
+
+    // Call callback(const char* data, int size) for every complete record.
+    // The view is only valid during the call.
+    template <typename Callback>
+    int feed(const char* data, int size, Callback&& callback);
+
+private:
+    QByteArray m_carry;  // Incomplete record waiting for the next data
+};
+
+inline void RecordFramer::clear()
+{
+    m_carry.clear();
+}
+
+inline bool RecordFramer::isEmpty() const
+{
+    return m_carry.isEmpty();
+}
+
+template <typename Callback>
+int RecordFramer::feed(const char* data, int size, Callback&& callback)
+{
+    int count = 0;
+    int offset = 0;
+    // Complete the record started in the previous data, its header first
+    while (!m_carry.isEmpty() && offset < size)
+    {
+        int wanted = m_carry.size() < TraceDictionary::RECORD_HEADER_SIZE
+                ? TraceDictionary::RECORD_HEADER_SIZE
+                : TraceDictionary::recordSize(m_carry.constData());
+        int taken = qMin(wanted - m_carry.size(), size - offset);
+        m_carry.append(data + offset, taken);
+        offset += taken;
+        if (m_carry.size() >= TraceDictionary::RECORD_HEADER_SIZE &&
+            m_carry.size() == TraceDictionary::recordSize(m_carry.constData()))
+        {
+            callback(m_carry.constData(), m_carry.size());
+            m_carry.clear();
+            ++count;
+        }
+    }
+
+    offset += TraceDictionary::forEachRecord(data + offset, size - offset, [&](const char* record, int length){
+        callback(record, length);
+        ++count;
+    });
+    m_carry.append(data + offset, size - offset);
+    return count;
+}
+
+#endif // RECORDFRAMER_H
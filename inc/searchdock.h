@@ -2,7 +2,7 @@
 #define SEARCHDOCK_H
 
 #include <QDockWidget>
-#include <QTextCursor>
+#include "linestore.h"
 
 QT_BEGIN_NAMESPACE
 class QLineEdit;
@@ -24,7 +24,7 @@ public:
     bool isCaseSensitiveChecked() const;
     bool isLoopSearchChecked() const;
 
-    void addAdvSearchResult(QTextCursor&);
+    void addAdvSearchResult(const TextRange&, const QString&);
     void show(bool advanced = false);
     void sortAdvSearchResult();
 
@@ -39,7 +39,7 @@ public slots:
 signals:
     void search(bool advanced = false, bool newSearch = true);
     void searchDockHidden();
-    void searchResultSelected(const QTextCursor);
+    void searchResultSelected(const TextRange);
     void clearHighlight();
 
 private:
@@ -0,0 +1,39 @@
+#ifndef SERIALRECEIVER_H
+#define SERIALRECEIVER_H
+
+#include "tracereceiver.h"
+
+QT_BEGIN_NAMESPACE
+class QSerialPort;
+class QTimer;
+QT_END_NAMESPACE
+
+///
+/// \brief The SerialReceiver class reads a serial port in its own thread
+///        and writes the received data into the ingest ring.
+///        The driver hands out small reads at high baud rates, they are
+///        gathered in the open slab and published by batch.
+///
+class SerialReceiver : public TraceReceiver
+{
+    Q_OBJECT
+public:
+    explicit SerialReceiver(SlabRing* ring, QObject* parent = nullptr);
+    ~SerialReceiver();
+
+    bool open(const IngestEndpoint&) override;
+    void close() override;
+
+private slots:
+    void onReadyRead();
+    void flushBatch();
+
+private:
+    QSerialPort* m_serial{nullptr};
+    QTimer*      m_flushTimer{nullptr};
+    QByteArray   m_buffer;        // Preallocated read buffer
+    int          m_pendingBytes{0}; // Written in the ring but not published yet
+    bool         m_continued{false}; // The first read after open tells the encoding
+};
+
+#endif // SERIALRECEIVER_H
@@ -0,0 +1,120 @@
+#ifndef SESSIONJOURNAL_H
+#define SESSIONJOURNAL_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include "traceline.h"
+
+QT_BEGIN_NAMESPACE
+class QThread;
+class QLockFile;
+QT_END_NAMESPACE
+
+///
+/// \brief The SessionJournal class writes every framed line of the live capture to an
+///        append-only journal, so that the traces of a session which did not end properly
+///        can be reopened.
+///        A session is a directory of segment files of records, each record is checked by
+///        its own checksum. The capture only copies the lines to a buffer, a writer thread
+///        checksums and commits the whole buffer in one write and one sync.
+///        Every second, a checkpoint with its own checksum is appended to the index of the
+///        session: the records before it were synced and are read without checking them.
+///        The last checkpoint of a session closed properly is marked closed.
+///
+class SessionJournal
+{
+public:
+    enum RecordKind : quint8
+    {
+        TextLine = TraceLine::Text,
+        BinaryLine = TraceLine::Binary,
+        SourceName = 0x80   // Name of an additional endpoint, the text is the name
+    };
+
+    struct Record
+    {
+        RecordKind  kind;
+        quint16     sourceId;
+        qint64      timestamp;
+        const char* text;
+        int         size;
+    };
+
+    struct Checkpoint
+    {
+        int    segment{0};
+        qint64 offset{0};  // End of the synced records of the segment
+        qint64 lines{0};   // Lines of the session until there
+        bool   closed{false};
+    };
+
+    explicit SessionJournal(const QString& directory);
+    ~SessionJournal();
+
+    bool open(qint64 maxSessionSize, int maxSessions);
+    void close();
+    void append(const TraceLines&);
+    void setSourceName(quint16, const QString&);
+    inline QString sessionPath() const;
+
+    static QStringList crashedSessions(const QString& directory);
+    static void markClosed(const QString& sessionPath);
+    static bool lastCheckpoint(const QString& sessionPath, Checkpoint&);
+    static int parseRecord(const char* data, qint64 available, bool verify, Record&);
+    static QString segmentFileName(int);
+
+    // Record: checksum of the rest of the record, size of the text, timestamp, source id, kind
+    static constexpr int RECORD_HEADER_SIZE = 4 + 4 + 8 + 2 + 1;
+    static constexpr int MAX_RECORD_SIZE = 16 * 1024 * 1024;
+
+    SessionJournal(const SessionJournal&) = delete;
+    SessionJournal& operator=(const SessionJournal&) = delete;
+
+private:
+    void write();
+    bool commit(QByteArray& batch, int lines);
+    bool openNextSegment();
+    bool writeCheckpoint(bool closed);
+    void removeOldSegments();
+    static void removeOldSessions(const QString& directory, int maxSessions);
+
+    QString        m_directory;
+    QString        m_sessionPath;
+    QLockFile*     m_lockFile{nullptr};  // Held while the session is written
+
+    // Shared with the capture
+    QMutex         m_mutex;
+    QWaitCondition m_bufferReady;
+    QByteArray     m_buffer;            // Records waiting for the writer, without their checksum
+    int            m_bufferLines{0};
+    QHash<quint16, QByteArray> m_sourceNames;  // Repeated at the start of every segment
+    bool           m_open{false};
+    bool           m_closing{false};
+    quint64        m_droppedLines{0};   // The writer did not keep up, or failed
+
+    // Writer thread
+    QThread*       m_writer{nullptr};
+    QByteArray     m_batch;
+    QFile          m_segment;
+    QFile          m_index;
+    int            m_firstSegment{0};
+    int            m_segmentNumber{-1};
+    qint64         m_segmentSize{0};
+    qint64         m_sessionSize{0};
+    qint64         m_maxSessionSize{0}; // 0 is no limit
+    qint64         m_lines{0};
+    QElapsedTimer  m_lastCheckpoint;
+};
+
+inline QString SessionJournal::sessionPath() const
+{
+    return m_sessionPath;
+}
+
+#endif // SESSIONJOURNAL_H
@@ -0,0 +1,153 @@
+#ifndef SLABRING_H
+#define SLABRING_H
+
+#include <QtGlobal>
+#include <QAtomicInteger>
+#include <QVector>
+#include <cstring>
+
+///
+/// \brief Header of one record (e.g. a datagram) written in a slab
+///
+struct IngestRecord
+{
+    enum Flag
+    {
+        // Continues the previous record of the same sender: next read of a stream, next
+        // block of a compressed datagram or next piece of a record larger than a slab
+        Continued = 0x1
+    };
+
+    quint32 size{0};       // Payload size in bytes
+    quint16 senderPort{0};
+    quint16 flags{0};
+    qint64  timestamp{0};  // Monotonic receive time in ns
+    quint8  sender[16]{};  // Sender address, IPv4 is mapped to IPv6. All zero for serial
+};
+
+///
+/// \brief The SlabRing class is a bounded single-producer/single-consumer ring
+///        of preallocated byte slabs. The producer packs records into the open
+///        slab and publishes it with flush(), the consumer reads the published
+///        slabs and gives them back to the producer.
+///        Nothing is allocated after construction. When the ring is full, the
+///        record is dropped and accounted in the overflow counters.
+///
+class SlabRing
+{
+public:
+    SlabRing(int slabCount, int slabCapacity);
+    ~SlabRing();
+
+    // Producer side
+    bool write(const IngestRecord&, const char*, int);
+    bool canWrite(int) const;
+    void flush();
+
+    // Consumer side. Call callback(const IngestRecord&, const char* payload) for every
+    // record of the published slabs. The payload is only valid during the call.
+    template <typename Callback>
+    int consume(Callback&& callback);
+
+    inline int slabCount() const;
+    inline int slabCapacity() const;
+    inline int usedSlabs() const;
+    inline quint64 writtenRecords() const;
+    inline quint64 overflowRecords() const;
+    inline quint64 overflowBytes() const;
+
+    SlabRing(const SlabRing&) = delete;
+    SlabRing& operator=(const SlabRing&) = delete;
+
+private:
+    static inline int alignedSize(int);
+    inline char* slab(quint32);
+    int neededSlabs(int) const;
+    void openSlab();
+
+    static constexpr int HEADER_SIZE = (sizeof(IngestRecord) + 7) & ~7;
+
+    char*             m_storage{nullptr};
+    QVector<int>      m_used;          // Bytes written in each slab, set before publishing
+    const int         m_slabCount;     // Power of two
+    const int         m_slabCapacity;
+    const quint32     m_mask;
+
+    // Producer only
+    bool              m_open{false};
+    int               m_writeOffset{0};
+
+    // Shared indexes, on their own cache line to avoid false sharing
+    alignas(64) QAtomicInteger<quint32> m_head{0};  // Published slabs
+    alignas(64) QAtomicInteger<quint32> m_tail{0};  // Released slabs
+
+    alignas(64) QAtomicInteger<quint64> m_writtenRecords{0};
+    QAtomicInteger<quint64> m_overflowRecords{0};
+    QAtomicInteger<quint64> m_overflowBytes{0};
+};
+
+inline int SlabRing::slabCount() const
+{
+    return m_slabCount;
+}
+
+inline int SlabRing::slabCapacity() const
+{
+    return m_slabCapacity;
+}
+
+inline int SlabRing::usedSlabs() const
+{
+    return int(m_head.loadAcquire() - m_tail.loadAcquire());
+}
+
+inline quint64 SlabRing::writtenRecords() const
+{
+    return m_writtenRecords.loadRelaxed();
+}
+
+inline quint64 SlabRing::overflowRecords() const
+{
+    return m_overflowRecords.loadRelaxed();
+}
+
+inline quint64 SlabRing::overflowBytes() const
+{
+    return m_overflowBytes.loadRelaxed();
+}
+
+inline int SlabRing::alignedSize(int size)
+{
+    return (size + 7) & ~7;
+}
+
+inline char* SlabRing::slab(quint32 index)
+{
+    return m_storage + size_t(index & m_mask) * size_t(m_slabCapacity);
+}
+
+template <typename Callback>
+int SlabRing::consume(Callback&& callback)
+{
+    int records = 0;
+    quint32 tail = m_tail.loadRelaxed();
+    const quint32 head = m_head.loadAcquire();
+    for (; tail != head; ++tail)
+    {
+        const char* data = slab(tail);
+        const int used = m_used.at(int(tail & m_mask));
+        for (int offset = 0; offset < used; )
+        {
+            IngestRecord record;
+            memcpy(&record, data + offset, sizeof(record));
+            callback(record, data + offset + HEADER_SIZE);
+            offset += alignedSize(HEADER_SIZE + int(record.size));
+            ++records;
+        }
+        // Give the slab back to the producer
+        m_tail.storeRelease(tail + 1);
+    }
+    return records;
+}
+
+#endif // SLABRING_H
@@ -0,0 +1,116 @@
+#ifndef STREAMRECEIVER_H
+#define STREAMRECEIVER_H
+
+#include "tracereceiver.h"
+#include "slabring.h"
+#include "lz4framedecoder.h"
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+class QTimer;
+class QThread;
+class QTcpServer;
+class QLocalServer;
+QT_END_NAMESPACE
+
+class StreamReceiver;
+
+///
+/// \brief The StreamConnection class reads one accepted TCP or local socket in its
+///        own thread and writes the data into its own ingest ring. When the ring is
+///        full, it stops reading and lets the flow control slow the sender down,
+///        nothing is dropped.
+///        A connection starting with an LZ4 frame is decompressed block by block.
+///
+class StreamConnection : public QObject
+{
+    Q_OBJECT
+public:
+    StreamConnection(IngestEndpoint::Type, qintptr, SlabRing*, StreamReceiver*);
+
+public slots:
+    void open();
+
+signals:
+    void finished();
+
+private slots:
+    void onReadyRead();
+    void onDisconnected();
+    void onTimeout();
+
+private:
+    enum Compression
+    {
+        Unknown,  // Less than a frame magic received yet
+        None,
+        Lz4
+    };
+    bool detectCompression();
+    bool readRaw();
+    bool readCompressed();
+    void flushBatch();
+
+    IngestEndpoint::Type m_type;
+    qintptr         m_socketDescriptor;
+    SlabRing*       m_ring;
+    StreamReceiver* m_owner;           // Accounts the statistics
+    QIODevice*      m_socket{nullptr};
+    QTimer*         m_timer{nullptr};  // Batch delay, or retry while the ring is full
+    QByteArray      m_buffer;          // Preallocated read buffer
+    IngestRecord    m_record;          // Sender of the connection, continued after the first read
+    int             m_pendingBytes{0}; // Written in the ring but not published yet
+    Compression     m_compression{Unknown};
+    Lz4FrameDecoder m_decoder;
+    bool            m_disconnected{false};
+    bool            m_finished{false};
+};
+
+///
+/// \brief The StreamReceiver class listens to a TCP port or a local socket and reads
+///        every accepted connection in a thread of its own, so that many producers
+///        are spread over the cores. Each connection has its own ring, registered
+///        and released through connectionOpened / connectionClosed.
+///
+class StreamReceiver : public TraceReceiver
+{
+    Q_OBJECT
+public:
+    explicit StreamReceiver(QObject* parent = nullptr);
+    ~StreamReceiver();
+
+    bool open(const IngestEndpoint&) override;
+    void close() override;
+    void addConnection(qintptr);
+    inline void countReceived(quint64);
+
+signals:
+    // Emitted in the listener thread, must be connected directly.
+    // The ring is registered before its first record and deleted once closed
+    void connectionOpened(SlabRing*);
+    void connectionClosed(SlabRing*);
+
+private:
+    struct Connection
+    {
+        quint64           id{0};
+        SlabRing*         ring{nullptr};
+        QThread*          thread{nullptr};
+        StreamConnection* reader{nullptr};
+    };
+    void removeConnection(quint64);
+
+    IngestEndpoint     m_endpoint;
+    QTcpServer*        m_tcpServer{nullptr};
+    QLocalServer*      m_localServer{nullptr};
+    QList<Connection*> m_connections;
+    quint64            m_lastConnectionId{0};
+};
+
+inline void StreamReceiver::countReceived(quint64 bytes)
+{
+    m_receivedDatagrams.fetchAndAddRelaxed(1);
+    m_receivedBytes.fetchAndAddRelaxed(bytes);
+}
+
+#endif // STREAMRECEIVER_H
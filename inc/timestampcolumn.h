@@ -0,0 +1,70 @@
+#ifndef TIMESTAMPCOLUMN_H
+#define TIMESTAMPCOLUMN_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QVector>
+
+///
+/// \brief The TimestampColumn class stores one 64-bit timestamp per line, delta encoded.
+///        Every CHECKPOINT_INTERVAL lines the full timestamp is kept in a checkpoint, the
+///        lines between are the zigzag varint difference with the previous line, which
+///        takes 2 to 4 bytes for lines received a few microseconds to seconds apart.
+///        A timestamp is read by decoding at most CHECKPOINT_INTERVAL - 1 deltas.
+///
+class TimestampColumn
+{
+public:
+    void append(qint64);
+    qint64 at(int) const;
+    void resize(int, qint64 value = 0);
+    void removeFirst(int);
+    void clear();
+    inline int size() const;
+    inline qint64 last() const;
+    inline qint64 memoryUsage() const;
+
+    static constexpr int CHECKPOINT_INTERVAL = 64;
+
+private:
+    struct Checkpoint
+    {
+        qint64 timestamp;
+        int    offset;     // Offset in m_deltas of the delta of the next line
+    };
+    static inline quint64 zigzag(qint64);
+    static inline qint64 unzigzag(quint64);
+    static qint64 readDelta(const char*& data);
+
+    QVector<Checkpoint> m_checkpoints;
+    QByteArray          m_deltas;
+    int                 m_size{0};
+    qint64              m_last{0};
+};
+
+inline int TimestampColumn::size() const
+{
+    return m_size;
+}
+
+inline qint64 TimestampColumn::last() const
+{
+    return m_last;
+}
+
+inline qint64 TimestampColumn::memoryUsage() const
+{
+    return qint64(m_checkpoints.size()) * qint64(sizeof(Checkpoint)) + m_deltas.size();
+}
+
+inline quint64 TimestampColumn::zigzag(qint64 value)
+{
+    return (quint64(value) << 1) ^ quint64(value >> 63);
+}
+
+inline qint64 TimestampColumn::unzigzag(quint64 value)
+{
+    return qint64(value >> 1) ^ -qint64(value & 1);
+}
+
+#endif // TIMESTAMPCOLUMN_H
@@ -0,0 +1,19 @@
+#ifndef TRACECLOCK_H
+#define TRACECLOCK_H
+
+#include <QtGlobal>
+#include <chrono>
+
+namespace TraceClock
+{
+///
+/// \brief Monotonic time in nanoseconds, comparable between all the receive threads
+///
+inline qint64 nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+#endif // TRACECLOCK_H
@@ -0,0 +1,108 @@
+#ifndef TRACEDICTIONARY_H
+#define TRACEDICTIONARY_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include <QtEndian>
+#include <QReadWriteLock>
+#include <cstring>
+
+///
+/// \brief The TraceDictionary class decodes the compact binary traces.
+///        A binary datagram starts with the magic "TTB\x01" followed by records,
+///        all integers in little endian:
+///            u32 message id, u16 argument size, packed arguments
+///        The dictionary file maps the message ids to a level and a printf like
+///        format string, one message per line: "<id> <level> <format>".
+///        The format gives the size of the arguments: 4 bytes for the integers
+///        (8 with ll or j) and %p, 8 bytes for the floating points (promoted to double),
+///        and u16 length + bytes for %s.
+///        A stream, or a datagram holding an LZ4 frame, starts with the magic once and
+///        its records may span several reads or blocks.
+///        The records are kept as they are and only formatted when displayed.
+///
+class TraceDictionary
+{
+public:
+    static TraceDictionary& instance();
+
+    bool load(const QString& path, QString& errorString);
+    inline QString path() const;
+    inline int size() const;
+    QString format(const QByteArray& record) const;
+    int lengthHint(const char* record, int size) const;
+    QString level(quint32 id) const;
+
+    static constexpr int MAGIC_SIZE = 4;
+    static constexpr int RECORD_HEADER_SIZE = 6;
+    static inline bool isBinaryDatagram(const char*, int);
+
+    static inline int recordSize(const char* header);
+
+    // Call callback(const char* record, int size) for every complete record of the data,
+    // which starts at a record. Return the size of the complete records.
+    template <typename Callback>
+    static int forEachRecord(const char* data, int size, Callback&& callback);
+
+private:
+    TraceDictionary();
+
+    // Piece of a format string: literal text, or one conversion and its printf spec
+    struct Segment
+    {
+        QByteArray text;       // Literal text, or the spec normalized for QString::asprintf
+        char       conversion{0};
+        int        argSize{0}; // 0 for %s, its size is in the record
+    };
+    struct Message
+    {
+        QString          level;
+        QVector<Segment> segments;
+    };
+    static QVector<Segment> parseFormat(const QByteArray&);
+
+    QString                  m_path;
+    QHash<quint32, Message>  m_messages;     // Changed in the gui thread only
+    mutable QReadWriteLock   m_lock;         // For the readers of the other threads
+};
+
+inline QString TraceDictionary::path() const
+{
+    return m_path;
+}
+
+inline int TraceDictionary::size() const
+{
+    return m_messages.size();
+}
+
+inline bool TraceDictionary::isBinaryDatagram(const char* data, int size)
+{
+    return size >= MAGIC_SIZE && memcmp(data, "TTB\x01", MAGIC_SIZE) == 0;
+}
+
+inline int TraceDictionary::recordSize(const char* header)
+{
+    return RECORD_HEADER_SIZE + qFromLittleEndian<quint16>(header + 4);
+}
+
+template <typename Callback>
+int TraceDictionary::forEachRecord(const char* data, int size, Callback&& callback)
+{
+    int offset = 0;
+    while (offset + RECORD_HEADER_SIZE <= size)
+    {
+        int length = recordSize(data + offset);
+        if (offset + length > size)
+        {
+            break;
+        }
+        callback(data + offset, length);
+        offset += length;
+    }
+    return offset;
+}
+
+#endif // TRACEDICTIONARY_H
@@ -1,19 +1,21 @@
 #ifndef TRACEHIGHLIGHTER_H
 #define TRACEHIGHLIGHTER_H
 
-#include <QSyntaxHighlighter>
 #include <QTextCharFormat>
+#include <QTextLayout>
 #include <QRegularExpression>
 
-class TraceHighlighter : public QSyntaxHighlighter
+///
+/// \brief The TraceHighlighter class colors the lines with the highlighting rules when
+///        they are painted or saved. The rules are shared by all the views.
+///
+class TraceHighlighter
 {
-    Q_OBJECT
 public:
-    explicit TraceHighlighter(QTextDocument *parent = nullptr);
+    TraceHighlighter();
     static void addHighlightingRule(const QString&, const QString&);
 
-protected:
-    void highlightBlock(const QString& text) override;
+    void highlight(const QString& text, QVector<QTextLayout::FormatRange>& formats) const;
 
 private:
     struct HighlightingRule
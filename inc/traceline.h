@@ -0,0 +1,71 @@
+#ifndef TRACELINE_H
+#define TRACELINE_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QMetaType>
+
+///
+/// \brief One framed trace line, tagged with the source it comes from.
+///        The text is a slice of the received chunk, which is copied once and shared
+///        by all its lines, so that framing a line does not allocate.
+///
+struct TraceLine
+{
+    enum Encoding : quint8
+    {
+        Text,
+        Binary    // Compact record, formatted by TraceDictionary when displayed
+    };
+
+    QByteArray chunk;         // Received data holding the text, implicitly shared
+    int        offset{0};     // Of the text in the chunk
+    int        size{0};       // Of the text
+    qint64     timestamp{0};  // Monotonic receive time of the line, in ns
+    quint16    sourceId{0};   // 0 is the main interface, the additional endpoints follow
+    Encoding   encoding{Text};
+
+    inline const char* data() const;
+    inline QByteArray text() const;
+    inline void setText(const QByteArray&);
+    inline void detach();
+};
+
+inline const char* TraceLine::data() const
+{
+    return chunk.constData() + offset;
+}
+
+///
+/// \brief TraceLine::text
+/// \return the text, not copied, only valid as long as the line
+///
+inline QByteArray TraceLine::text() const
+{
+    return QByteArray::fromRawData(data(), size);
+}
+
+inline void TraceLine::setText(const QByteArray& text)
+{
+    chunk = text;
+    offset = 0;
+    size = text.size();
+}
+
+///
+/// \brief TraceLine::detach
+///        Copy the text out of the chunk, so that a line kept long does not hold it whole
+///
+inline void TraceLine::detach()
+{
+    if (size != chunk.size())
+    {
+        setText(QByteArray(data(), size));
+    }
+}
+
+typedef QVector<TraceLine> TraceLines;
+
+Q_DECLARE_METATYPE(TraceLines)
+
+#endif // TRACELINE_H
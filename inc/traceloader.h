@@ -0,0 +1,51 @@
+#ifndef TRACELOADER_H
+#define TRACELOADER_H
+
+#include <QObject>
+#include <QFuture>
+#include <QAtomicInteger>
+#include <QSemaphore>
+#include "linestore.h"
+
+///
+/// \brief The TraceLoader class is the base of the loaders which read a trace in a worker
+///        thread, and hand its lines to their own thread part by part. The worker sleeps
+///        while too many parts are not taken yet, and is woken up as soon as one is.
+///        A loader stops its worker in its destructor, before its members are destroyed.
+///
+class TraceLoader : public QObject
+{
+    Q_OBJECT
+public:
+    ~TraceLoader();
+
+    void start();
+
+signals:
+    void linesLoaded(LineBlock lines, qint64 bytesRead, qint64 size);
+    void finished(QString errorString);
+
+protected:
+    TraceLoader();
+
+    virtual void load() = 0;
+    void stop();
+    bool handOver(const LineBlock& lines, qint64 bytesRead, qint64 size);
+    void finish(const QString& errorString);
+    inline bool isStopped() const;
+
+    // Read and parsed at once
+    static constexpr int LOAD_CHUNK_SIZE = 1024 * 1024;
+
+private:
+    QFuture<void> m_loader;
+    QAtomicInteger<bool> m_stop{false};
+    QSemaphore    m_freeParts;  // Parts the worker may still read ahead of the gui thread
+};
+
+inline bool TraceLoader::isStopped() const
+{
+    return m_stop;
+}
+
+#endif // TRACELOADER_H
@@ -7,6 +7,41 @@
 #include <QQueue>
 #include <QTimer>
 #include <QThread>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QHash>
+#include "lineframer.h"
+#include "recordframer.h"
+#include "traceline.h"
+#include "overloadpolicy.h"
+
+QT_BEGIN_NAMESPACE
+class SlabRing;
+class SessionJournal;
+struct IngestRecord;
+QT_END_NAMESPACE
+
+///
+/// \brief Key of the reassembly state of one sender: address and port
+///
+struct SenderKey
+{
+    quint64 high{0};
+    quint64 low{0};
+    quint16 port{0};
+
+    static SenderKey fromRecord(const IngestRecord&);
+};
+
+inline bool operator==(const SenderKey& a, const SenderKey& b)
+{
+    return a.high == b.high && a.low == b.low && a.port == b.port;
+}
+
+inline uint qHash(const SenderKey& key, uint seed = 0)
+{
+    return qHash(key.high ^ (key.low * 0x9E3779B97F4A7C15ULL) ^ key.port, seed);
+}
 
 class TraceManager : public QObject
 {
@@ -14,27 +49,66 @@ class TraceManager : public QObject
 public:
     static TraceManager& instance();
     ~TraceManager();
-    bool readFile(const QString& url, QString&);
+    int backlog();
+    void setJournal(SessionJournal*);
 
 public slots:
-    void onNewDataReady(const QByteArray);
+    void onTracesDisplayed(int, qint64);
+    void onIngestSourceAdded(SlabRing*, quint16);
+    void onIngestSourceRemoved(SlabRing*);
 
 signals:
-    void newTracesReady(QStringList);
+    void newTracesReady(TraceLines);
+    void backlogChanged(int);
+    void overloadStatsChanged(OverloadStats);
 
 private:
     TraceManager();
     void filterIncompletedFromRawData();
+    void mergeSourceLines();
     void sendPendingDataToView();
+    int lineBudgetPerFrame() const;
 
     // Methods for async process
     void processAndSendTraceToViewAsync();
 
     QMutex          m_mutex;
-    QString         m_rawData;
+    // Each sender is framed on its own, a partial line cannot be completed by another
+    // device or by another producer
+    struct Sender
+    {
+        LineFramer   framer;
+        RecordFramer records;
+        TraceLine::Encoding encoding{TraceLine::Text}; // Of its current datagram or stream
+        bool         inStream{false};  // Its last record continued the previous one
+        qint64       lastSeen{0};
+    };
+    struct IngestSource
+    {
+        SlabRing*  ring{nullptr};
+        quint16    sourceId{0};
+        QHash<SenderKey, Sender> senders;
+        qint64     lastEviction{0};
+        TraceLines lines;               // Framed in the current frame, waiting to be merged
+        quint64    reportedOverflow{0};
+    };
+    void consumeSource(IngestSource*);
+    void releaseSender(IngestSource*, Sender&);
+    void evictIdleSenders(IngestSource*, qint64);
+    QList<IngestSource*> m_sources;
 
     QTimer*         m_timer{nullptr};
-    QQueue<QString> m_pendingTraces;
+    QQueue<TraceLine> m_pendingTraces;
+    int             m_lastBacklog{0};
+    OverloadPolicy  m_overloadPolicy;
+    OverloadStats   m_lastOverloadStats;
+    SessionJournal* m_journal{nullptr};
+    TraceLines      m_journalLines;  // Merged in the current frame, before any of them is dropped
+
+    // Flush scheduling, fed back by the view after each rendered frame
+    QAtomicInteger<bool> m_batchInFlight{false};
+    QAtomicInt      m_displayRate;   // lines per second the view can render
+    QElapsedTimer   m_lastBatchTimer;
 
     QThread         m_sendTraceThread;
 };
@@ -0,0 +1,83 @@
+#ifndef TRACERECEIVER_H
+#define TRACERECEIVER_H
+
+#include <QObject>
+#include <QAtomicInteger>
+#include "ingestendpoint.h"
+
+QT_BEGIN_NAMESPACE
+class SlabRing;
+QT_END_NAMESPACE
+
+///
+/// \brief The TraceReceiver class is the base of the receivers running in their own thread.
+///        A receiver reads one endpoint and is the only producer of its ingest ring.
+///        open() and close() must be called from the thread the receiver lives in.
+///
+class TraceReceiver : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TraceReceiver(SlabRing* ring, QObject* parent = nullptr);
+
+    virtual bool open(const IngestEndpoint&) = 0;
+    virtual void close() = 0;
+    inline QString errorString() const;
+
+    // Requested socket receive buffer, applied at next open. 0 keeps the system default
+    inline void setReceiveBufferSize(int);
+    inline int receiveBufferSize() const;
+
+    // Statistics, can be read from any thread
+    inline quint64 receivedDatagrams() const;  // Datagrams, or reads for stream endpoints
+    inline quint64 receivedBytes() const;
+    inline quint64 kernelDrops() const;        // Dropped by the kernel before being read
+    inline int effectiveReceiveBufferSize() const;
+
+protected:
+    SlabRing*  m_ring{nullptr};
+    QString    m_errorString;
+    int        m_receiveBufferSize{0};
+
+    QAtomicInteger<quint64> m_receivedDatagrams{0};
+    QAtomicInteger<quint64> m_receivedBytes{0};
+    QAtomicInteger<quint64> m_kernelDrops{0};
+    QAtomicInt              m_effectiveReceiveBufferSize{0};
+};
+
+inline QString TraceReceiver::errorString() const
+{
+    return m_errorString;
+}
+
+inline void TraceReceiver::setReceiveBufferSize(int size)
+{
+    m_receiveBufferSize = size;
+}
+
+inline int TraceReceiver::receiveBufferSize() const
+{
+    return m_receiveBufferSize;
+}
+
+inline quint64 TraceReceiver::receivedDatagrams() const
+{
+    return m_receivedDatagrams.loadRelaxed();
+}
+
+inline quint64 TraceReceiver::receivedBytes() const
+{
+    return m_receivedBytes.loadRelaxed();
+}
+
+inline quint64 TraceReceiver::kernelDrops() const
+{
+    return m_kernelDrops.loadRelaxed();
+}
+
+inline int TraceReceiver::effectiveReceiveBufferSize() const
+{
+    return m_effectiveReceiveBufferSize.loadRelaxed();
+}
+
+#endif // TRACERECEIVER_H
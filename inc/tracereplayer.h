@@ -0,0 +1,69 @@
+#ifndef TRACEREPLAYER_H
+#define TRACEREPLAYER_H
+
+#include <QObject>
+#include <QFile>
+#include <QElapsedTimer>
+#include "slabring.h"
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+
+///
+/// \brief The TraceReplayer class feeds a saved trace file back into an ingest ring,
+///        in its own thread, so that it goes through the framing, the merge and the
+///        live view exactly as received traces do.
+///        The file is read by chunks. If it was saved with the timestamps shown
+///        ("<seconds>\t<trace>" lines), the timestamps are stripped and, unless
+///        replaying as fast as possible, the lines are sent at their original pace
+///        divided by the speed. When the ring is full, the replay waits for trace
+///        manager, nothing is dropped.
+///
+class TraceReplayer : public QObject
+{
+    Q_OBJECT
+public:
+    TraceReplayer(const QString& path, double speed, SlabRing* ring);
+
+    static constexpr double AS_FAST_AS_POSSIBLE = 0;
+    // Tags the replayed lines, which are shown untagged as those of the main interface
+    static constexpr quint16 SOURCE_ID = 0xffff;
+
+public slots:
+    void start();
+
+signals:
+    void finished(quint64 lines, qint64 elapsedNs, QString errorString);
+
+private slots:
+    void replay();
+
+private:
+    bool nextLine();
+    bool readChunk();
+    void flushBatch();
+    void finish(const QString& errorString = QString());
+
+    QFile        m_file;
+    double       m_speed;
+    SlabRing*    m_ring;
+    QTimer*      m_timer{nullptr};     // Wait for the next line, or for room in the ring
+
+    QByteArray   m_input;              // Read from the file, not parsed yet
+    int          m_inputOffset{0};
+    bool         m_endOfFile{false};
+    bool         m_timestamped{false};
+    bool         m_formatKnown{false};
+
+    QByteArray   m_line;               // Next line to send, without its timestamp
+    qint64       m_lineTimestamp{-1};  // Stored time of the line in ns, -1 if none
+    bool         m_hasLine{false};
+    qint64       m_firstTimestamp{-1};
+
+    QByteArray   m_batch;              // Lines gathered for one ring record
+    quint64      m_lines{0};
+    QElapsedTimer m_elapsed;
+};
+
+#endif // TRACEREPLAYER_H
@@ -2,8 +2,33 @@
 #define TRACESERVER_H
 
 #include <QUdpSocket>
-#include <QSerialPort>
 #include <QTimer>
+#include <QThread>
+#include <QElapsedTimer>
+#include "ingestendpoint.h"
+
+QT_BEGIN_NAMESPACE
+class UdpReceiver;
+class SerialReceiver;
+class TraceReceiver;
+class TraceReplayer;
+class SlabRing;
+QT_END_NAMESPACE
+
+///
+/// \brief Ingest counters of all the receivers, where the traces are lost
+///        before reaching trace manager
+///
+struct IngestStats
+{
+    quint64 receivedDatagrams{0};
+    quint64 receivedBytes{0};
+    quint64 kernelDrops{0};        // Socket buffer overflows, Linux only
+    quint64 ringDrops{0};          // Records dropped because trace manager lagged behind
+    double  datagramsPerSecond{0};
+    double  bytesPerSecond{0};
+    int     receiveBufferSize{0};  // Effective buffer of the main UDP socket
+};
 
 class TraceServer : public QObject
 {
@@ -16,25 +41,88 @@ public:
     void reinit();
     void onInterfaceChangeRequested(QString);
     void onPortChangeRequested(quint16);
+    void onEndpointsChangeRequested(QStringList);
+    void onSerialPortChangeRequested(QString, qint32);
+    void onReplayRequested(QString, double);
+    inline IngestStats stats() const;
 
 private slots:
     void onReadyRead();
     void retryRemoteConnecting();
+    void updateStats();
+    void onReplayFinished(quint64, qint64, QString);
 
 signals:
     void bindResult(QString, quint16, bool);
-    void newDataReady(const QByteArray);
+    void endpointResult(QString, bool);
+    // Must be connected directly: once removed, the ring is deleted
+    void ingestSourceAdded(SlabRing*, quint16, QString);
+    void ingestSourceRemoved(SlabRing*);
+    void statsUpdated(const IngestStats&);
+    void replayFinished(QString, quint64, qint64, QString);
 
 private:
     TraceServer();
-    void configSerialPort();
     bool establishConnection();
+    void closeConnection();
+    void openEndpoints();
+    void closeEndpoints();
+    void applyReceiveBufferSize();
+    void stopReplay();
 
     QUdpSocket*  m_udpSocket{nullptr};
     QString      m_interface{"0.0.0.0"};
     quint16      m_port{911};
     QTimer*      m_timer;
-    QSerialPort* m_serial{nullptr};
+    int          m_receiveBufferSize{0};
+    QString      m_serialPortName;
+    qint32       m_serialBaudRate{115200};
+
+    // The receivers of the main interface live in the receive thread.
+    // In non threaded receive mode, the UDP socket stays in this thread
+    bool            m_threadedReceive{true};
+    QThread         m_receiveThread;
+    UdpReceiver*    m_udpReceiver{nullptr};
+    SerialReceiver* m_serialReceiver{nullptr};
+
+    // Transport to trace manager, one ring per producer thread
+    SlabRing*    m_localRing{nullptr};   // Written in this thread (non threaded UDP)
+    SlabRing*    m_receiveRing{nullptr}; // Written in the receive thread
+
+    // Additional endpoints, listened at the same time as the main interface,
+    // each one has its own thread and ring
+    struct Endpoint
+    {
+        IngestEndpoint config;
+        quint16        sourceId{0};
+        SlabRing*      ring{nullptr};     // None for the stream endpoints, one per connection instead
+        QThread*       thread{nullptr};
+        TraceReceiver* receiver{nullptr};
+    };
+    QStringList      m_endpointSpecs;
+    QList<Endpoint*> m_endpoints;
+
+    // Replay of a saved trace, fed as the main interface in a thread of its own
+    QString        m_replayPath;
+    QThread*       m_replayThread{nullptr};
+    TraceReplayer* m_replayer{nullptr};
+    SlabRing*      m_replayRing{nullptr};
+
+    // Statistics, the receivers in this thread count here
+    quint64       m_localDatagrams{0};
+    quint64       m_localBytes{0};
+    QTimer*       m_statsTimer{nullptr};
+    QElapsedTimer m_statsElapsed;
+    IngestStats   m_stats;
 };
 
+///
+/// \brief TraceServer::stats
+/// \return the statistics of the last update, refreshed every second
+///
+inline IngestStats TraceServer::stats() const
+{
+    return m_stats;
+}
+
 #endif // TRACESERVER_H
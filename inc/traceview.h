@@ -1,14 +1,24 @@
 #ifndef TRACEVIEW_H
 #define TRACEVIEW_H
 
-#include <QTextEdit>
+#include <QAbstractScrollArea>
+#include <QTextLayout>
 #include <QHostAddress>
+#include "linestore.h"
 
 QT_BEGIN_NAMESPACE
+class QTextStream;
 class TraceHighlighter;
+class TraceLoader;
 QT_END_NAMESPACE
 
-class TraceView : public QTextEdit
+///
+/// \brief The TraceView class shows the lines of a line store, only the visible rows are
+///        laid out and painted, so that its cost does not depend on the number of lines.
+///        The highlighting rules, the search results and the selection are applied
+///        when a row is painted.
+///
+class TraceView : public QAbstractScrollArea
 {
     Q_OBJECT
 
@@ -19,38 +29,120 @@ public:
     inline virtual bool isAutoScrollEnabled() const;
 
     inline bool isHighlightUpdated() const;
-    inline bool wasHighlightUpdateRequested() const;
-    void setHighlightUpdateRequested();
     void disableCustomHighlighting();
     void updateHighlighting();
 
+    inline int lineCount() const;
+    inline QString lineText(int) const;
+    void appendLine(const QString& text, const QVector<ColorSpan>& spans = QVector<ColorSpan>(),
+                    qint64 timestamp = 0);
+    void appendLine(const QByteArray& text, const QVector<ColorSpan>& spans = QVector<ColorSpan>(),
+                    qint64 timestamp = 0);
+    void appendLine(const char* data, int size, qint64 timestamp);
+    void appendRecord(const char* record, int size, const QByteArray& tag, qint64 timestamp);
+    void setPlainText(const QString&);
+    bool openFile(const QString&);
+    void openHtmlFile(const QString&);
+    void openJournal(const QString&);
+    void setHtml(const QString&);
+
+    bool hasSelection() const;
+    QString selectedText() const;
+
+    inline const QVector<TextRange>& matches() const;
+    inline const TextRange& currentMatch() const;
+    void setMatches(const QVector<TextRange>&);
+    void setCurrentMatch(const TextRange&);
+    void setMarkedLine(int);
+    void ensureVisible(const TextRange&);
+
 protected:
     void contextMenuEvent(QContextMenuEvent *event) override;
     void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void changeEvent(QEvent* event) override;
+    void scrollContentsBy(int dx, int dy) override;
 
 public slots:
     void save();
-    void clear();
-    void clearUntilHere();
+    void copy();
+    void selectAll();
+    virtual void clear();
+    virtual void clearUntilHere();
 
     void setCustomHighlights();
     void onHighlightingChanged();
+    void showMemoryReport();
+
+signals:
+    void copyAvailable(bool);
+    void linesChanged();
+    void loadProgress(qint64 bytesRead, qint64 size);
+    void loadFinished(QString errorString);
 
 protected:
+    // Position of a character in the view
+    struct TextPosition
+    {
+        int line{0};
+        int column{0};
+
+        bool operator<(const TextPosition& other) const
+        {
+            return line < other.line || (line == other.line && column < other.column);
+        }
+        bool operator==(const TextPosition& other) const
+        {
+            return line == other.line && column == other.column;
+        }
+    };
+
     void createTraceActions();
     void createNetworkActions();
 
-    QString toHtmlWithAdditionalFormats();
+    void writeHtml(QTextStream&);
+    virtual void writePlainText(QTextStream&);
     QAction* toAction(QString&) const;
 
+    void appendMessage(const QString& text, const QColor& color);
+    void removeLastLine();
+    void removeFirstLines(int);
+    void scrollToEnd();
+    inline int lineHeight() const;
+    int lineAt(int y) const;
+
+private slots:
+    void onLinesAppended();
+
+private:
+    void startLoader(TraceLoader*);
+    void scheduleLinesAppended();
+    void onFirstLinesRemoved(int);
+    void takeDroppedLines();
+    void updateScrollBars();
+    void updateMetrics();
+    QVector<QTextLayout::FormatRange> lineFormats(int, const QString&) const;
+    QVector<QTextLayout::FormatRange> lineSelections(int, int) const;
+    TextPosition positionAt(const QPoint&) const;
+    void setSelection(const TextPosition& anchor, const TextPosition& cursor);
 
     //! [Actions]
+protected:
+    QAction* m_copyAct{nullptr};
+    QAction* m_selectAllAct{nullptr};
     QAction* m_saveAct{nullptr};
     QAction* m_searchAct{nullptr};
     QAction* m_clearAct{nullptr};
     QAction* m_clearUntilHereAct{nullptr};
     QAction* m_setAutoScrollAct{nullptr};
+    QAction* m_showTimestampsAct{nullptr};
     QAction* m_setCustomHighlightAct{nullptr};
+    QAction* m_memoryReportAct{nullptr};
 
     QAction* m_setAnyItfAct{nullptr};
     QAction* m_setAnyItfIpv6Act{nullptr};
@@ -59,14 +151,33 @@ protected:
     QAction* m_setSerialItfAct{nullptr};
 
     QAction* m_setPortAct{nullptr};
+    QAction* m_setSerialPortAct{nullptr};
+    QAction* m_setEndpointsAct{nullptr};
+    QAction* m_loadDictionaryAct{nullptr};
+    QAction* m_replayAct{nullptr};
     //! [Actions]
 
     //! [Attr]
-    QTextCursor  m_clearUntilCursor;
+    LineStore    m_lines;
+    int          m_clearUntilLine{-1};
 
+private:
     TraceHighlighter* m_highlighter{nullptr};
+    QObject*     m_loader{nullptr};   // Html file or journal, loaded in the background
     bool         m_highlightUpdated{true};
-    bool         m_highlightUpdateRequested{false};
+    bool         m_linesAppendedPending{false};
+
+    int          m_lineHeight{1};
+    int          m_charWidth{1};
+
+    bool         m_hasSelection{false};
+    bool         m_selecting{false};
+    TextPosition m_selectionAnchor;
+    TextPosition m_selectionCursor;
+
+    QVector<TextRange> m_matches;        // Search results, sorted
+    TextRange    m_currentMatch;
+    int          m_markedLine{-1};
 };
 
 inline bool TraceView::isAutoScrollEnabled() const
@@ -79,9 +190,29 @@ inline bool TraceView::isHighlightUpdated() const
     return m_highlightUpdated;
 }
 
-inline bool TraceView::wasHighlightUpdateRequested() const
+inline int TraceView::lineCount() const
+{
+    return m_lines.size();
+}
+
+inline QString TraceView::lineText(int line) const
+{
+    return m_lines.line(line);
+}
+
+inline const QVector<TextRange>& TraceView::matches() const
+{
+    return m_matches;
+}
+
+inline const TextRange& TraceView::currentMatch() const
+{
+    return m_currentMatch;
+}
+
+inline int TraceView::lineHeight() const
 {
-    return m_highlightUpdateRequested;
+    return m_lineHeight;
 }
 
 #endif // TRACEVIEW_H
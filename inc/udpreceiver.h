@@ -0,0 +1,57 @@
+#ifndef UDPRECEIVER_H
+#define UDPRECEIVER_H
+
+#include <QHostAddress>
+#include "tracereceiver.h"
+#include "lz4framedecoder.h"
+
+QT_BEGIN_NAMESPACE
+class QUdpSocket;
+class QSocketNotifier;
+class QTimer;
+struct IngestRecord;
+QT_END_NAMESPACE
+
+///
+/// \brief The UdpReceiver class owns the UDP socket on a dedicated receive thread.
+///        It drains the socket in batches into preallocated buffers and writes
+///        the datagrams into the ingest ring, it is the only producer of that ring.
+///        While the ring is full, the datagrams are left in the socket buffer.
+///        A datagram holding an LZ4 frame is decompressed before being written.
+///
+class UdpReceiver : public TraceReceiver
+{
+    Q_OBJECT
+public:
+    explicit UdpReceiver(SlabRing* ring, QObject* parent = nullptr);
+    ~UdpReceiver();
+
+    bool open(const IngestEndpoint&) override;
+    void close() override;
+    bool bind(const QHostAddress&, quint16);
+
+private slots:
+    void onReadyRead();
+    void flushBatch();
+    void resumeReading();
+
+private:
+    int datagramRoom() const;
+    int readBatch(int maxDatagrams);
+    void applyReceiveBufferSize();
+    void writeDatagram(const IngestRecord&, const char*, int);
+
+#ifdef Q_OS_LINUX
+    int             m_fd{-1};
+    QSocketNotifier* m_notifier{nullptr};
+    quint64         m_kernelDropsBase{0}; // Drops of the previous sockets, the kernel counts per socket
+#else
+    QUdpSocket*     m_socket{nullptr};
+#endif
+    QTimer*         m_flushTimer{nullptr};
+    QTimer*         m_retryTimer{nullptr}; // Reads again once trace manager has made room
+    QByteArray      m_buffer; // Preallocated, sliced in one slot per datagram
+    Lz4FrameDecoder m_decoder;
+};
+
+#endif // UDPRECEIVER_H
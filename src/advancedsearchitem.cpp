@@ -1,19 +1,16 @@
 #include "inc/advancedsearchitem.h"
 #include <QDebug>
 
-AdvancedSearchItem::AdvancedSearchItem(QTextCursor cursor)
+AdvancedSearchItem::AdvancedSearchItem(const TextRange& match, const QString& lineText)
 {
-    auto cursorOnLine = cursor;
-    cursorOnLine.select(QTextCursor::LineUnderCursor);
-    QString lineUnderCursor = cursorOnLine.selectedText();
-    int lineNumber = cursorOnLine.blockNumber() + 1;
-    QString displayText = QString("Line %1\t%2").arg(QString::number(lineNumber), lineUnderCursor);
+    int lineNumber = match.line + 1;
+    QString displayText = QString("Line %1\t%2").arg(QString::number(lineNumber), lineText);
 
     setData(Qt::DisplayRole, displayText);
-    setData(Qt::UserRole, QVariant::fromValue(cursor));
+    setData(Qt::UserRole, QVariant::fromValue(match));
 }
 
 bool AdvancedSearchItem::operator<(const QListWidgetItem& other) const
 {
-    return this->data(Qt::UserRole).value<QTextCursor>() < other.data(Qt::UserRole).value<QTextCursor>();
+    return this->data(Qt::UserRole).value<TextRange>() < other.data(Qt::UserRole).value<TextRange>();
 }
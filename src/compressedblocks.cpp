@@ -0,0 +1,285 @@
+#include "inc/compressedblocks.h"
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtEndian>
+#include <QDebug>
+#include <zstd.h>
+
+namespace
+{
+// Header of the compressed data: size of the serialized block
+const int SIZE_HEADER = 4;
+// Blocks kept decompressed, enough for a screen across two blocks and a search going on
+const int CACHED_BLOCKS = 4;
+// The default level of zstd: on trace lines it compresses about twice as much as LZ4,
+// as fast, the higher levels cost several times more for a few percent
+const int COMPRESSION_LEVEL = 3;
+
+///
+/// \brief Helper function
+///        Run in a worker thread, the block is not modified meanwhile
+/// \param block
+/// \return the compressed block, empty if it does not get smaller
+///
+QByteArray compressBlock(const LineBlock* block)
+{
+    QByteArray serialized = block->serialize(true);
+    QByteArray data(SIZE_HEADER + int(ZSTD_compressBound(size_t(serialized.size()))), Qt::Uninitialized);
+    qToLittleEndian<quint32>(quint32(serialized.size()), data.data());
+    size_t size = ZSTD_compress(data.data() + SIZE_HEADER, size_t(data.size() - SIZE_HEADER),
+                                serialized.constData(), size_t(serialized.size()), COMPRESSION_LEVEL);
+    if (ZSTD_isError(size) || SIZE_HEADER + qint64(size) >= serialized.size())
+    {
+        return QByteArray();
+    }
+    data.resize(SIZE_HEADER + int(size));
+    data.squeeze();
+    return data;
+}
+}
+
+CompressedBlocks::~CompressedBlocks()
+{
+    for (auto& entry : m_entries)
+    {
+        release(entry);
+    }
+}
+
+///
+/// \brief CompressedBlocks::append
+///        Start the compression of the block
+/// \param block full block, owned by this
+/// \param skip lines removed from the start of the block
+///
+void CompressedBlocks::append(LineBlock* block, int skip)
+{
+    Entry entry;
+    entry.number = m_nextNumber++;
+    entry.skip = skip;
+    entry.lines = block->size();
+    entry.block = block;
+    entry.pending = true;
+    entry.blockMemory = block->memoryUsage();
+    entry.compressing = QtConcurrent::run(compressBlock, static_cast<const LineBlock*>(block));
+    m_entries.append(entry);
+    m_lines += entry.lines - skip;
+    m_blocksMemory += entry.blockMemory;
+    ++m_pendingBlocks;
+}
+
+///
+/// \brief CompressedBlocks::takeFirst
+/// \param skip set to the lines removed from the start of the block
+/// \param lines set to the lines of the block, without the skipped ones
+/// \return the first block decompressed, owned by the caller, nullptr if it could not be
+///         decompressed: its lines are removed anyway
+///
+LineBlock* CompressedBlocks::takeFirst(int& skip, int& lines)
+{
+    Entry entry = m_entries.takeFirst();
+    skip = entry.skip;
+    lines = entry.lines - entry.skip;
+    m_lines -= lines;
+
+    LineBlock* block = entry.block;
+    if (block)
+    {
+        entry.block = nullptr;
+        m_blocksMemory -= entry.blockMemory;
+    }
+    else
+    {
+        block = decompress(entry);
+    }
+    release(entry); // Waits for the worker before the block is given
+    return block;
+}
+
+///
+/// \brief CompressedBlocks::dropFirst
+///        Remove the first block without decompressing it
+/// \return the lines removed, without the skipped ones
+///
+int CompressedBlocks::dropFirst()
+{
+    Entry entry = m_entries.takeFirst();
+    int lines = entry.lines - entry.skip;
+    m_lines -= lines;
+    release(entry);
+    return lines;
+}
+
+///
+/// \brief CompressedBlocks::removeFirst
+/// \param count number of lines removed from the start
+///
+void CompressedBlocks::removeFirst(int count)
+{
+    count = qMin(count, m_lines);
+    while (count > 0)
+    {
+        Entry& entry = m_entries.first();
+        int lines = entry.lines - entry.skip;
+        if (count < lines)
+        {
+            entry.skip += count;
+            m_lines -= count;
+            return;
+        }
+        release(entry);
+        m_entries.removeFirst();
+        m_lines -= lines;
+        count -= lines;
+    }
+}
+
+///
+/// \brief CompressedBlocks::blockAt
+///        Decompress the block of the line, unless it is cached
+/// \param line
+/// \param index set to the index of the line in the block
+/// \return the block, nullptr if it could not be decompressed
+///
+const LineBlock* CompressedBlocks::blockAt(int line, int& index)
+{
+    int number = m_entries.first().skip + line;
+    const Entry& entry = m_entries.at(number / LineStore::BLOCK_LINES);
+    index = number % LineStore::BLOCK_LINES;
+    if (entry.block)
+    {
+        return entry.block;
+    }
+
+    for (int i = 0; i < m_cache.size(); ++i)
+    {
+        if (m_cache[i].number == entry.number)
+        {
+            m_cache.move(i, 0);
+            return m_cache.first().block;
+        }
+    }
+
+    auto block = decompress(entry);
+    if (!block)
+    {
+        return nullptr;
+    }
+    m_cache.prepend({ entry.number, block });
+    if (m_cache.size() > CACHED_BLOCKS)
+    {
+        delete m_cache.takeLast().block;
+    }
+    return block;
+}
+
+///
+/// \brief CompressedBlocks::collect
+///        Replace the blocks compressed by the workers by their compressed data
+///
+void CompressedBlocks::collect()
+{
+    for (int i = m_entries.size() - 1; i >= 0 && m_pendingBlocks > 0; --i)
+    {
+        Entry& entry = m_entries[i];
+        if (!entry.pending || !entry.compressing.isFinished())
+        {
+            continue;
+        }
+        entry.pending = false;
+        --m_pendingBlocks;
+        entry.data = entry.compressing.result();
+        entry.compressing = QFuture<QByteArray>();
+        if (entry.data.isEmpty())
+        {
+            // Kept as is, the lines would not get smaller
+            entry.block->squeeze();
+            continue;
+        }
+        delete entry.block;
+        entry.block = nullptr;
+        m_blocksMemory += entry.data.capacity() - entry.blockMemory;
+        m_compressedSize += entry.data.size();
+        m_uncompressedSize += entry.blockMemory;
+    }
+}
+
+///
+/// \brief CompressedBlocks::memoryUsage
+/// \return bytes allocated for the blocks, compressed or not, and the cached ones
+///
+qint64 CompressedBlocks::memoryUsage() const
+{
+    qint64 usage = m_blocksMemory + qint64(m_entries.size()) * qint64(sizeof(Entry) + sizeof(void*));
+    for (const auto& cached : m_cache)
+    {
+        usage += cached.block->memoryUsage();
+    }
+    return usage;
+}
+
+///
+/// \brief CompressedBlocks::decompress
+/// \param entry compressed block
+/// \return the block, owned by the caller, nullptr if the data is corrupted
+///
+LineBlock* CompressedBlocks::decompress(const Entry& entry) const
+{
+    int size = int(qFromLittleEndian<quint32>(entry.data.constData()));
+    QByteArray serialized(size, Qt::Uninitialized);
+    auto block = new LineBlock;
+    size_t decodedSize = ZSTD_decompress(serialized.data(), size_t(size), entry.data.constData() + SIZE_HEADER,
+                                         size_t(entry.data.size() - SIZE_HEADER));
+    if (ZSTD_isError(decodedSize) || decodedSize != size_t(size) || !block->deserialize(serialized, true))
+    {
+        qDebug() << "Decompress line block failed";
+        delete block;
+        return nullptr;
+    }
+    return block;
+}
+
+///
+/// \brief CompressedBlocks::release
+///        Free the block or the data of an entry being removed
+/// \param entry
+///
+void CompressedBlocks::release(Entry& entry)
+{
+    removeCached(entry.number);
+    if (entry.pending)
+    {
+        // The worker may still read the block
+        entry.compressing.waitForFinished();
+        entry.pending = false;
+        --m_pendingBlocks;
+    }
+    if (entry.block)
+    {
+        delete entry.block;
+        entry.block = nullptr;
+        m_blocksMemory -= entry.blockMemory;
+    }
+    else if (!entry.data.isEmpty())
+    {
+        m_blocksMemory -= entry.data.capacity();
+        m_compressedSize -= entry.data.size();
+        m_uncompressedSize -= entry.blockMemory;
+    }
+    entry.data.clear();
+}
+
+///
+/// \brief CompressedBlocks::removeCached
+/// \param number
+///
+void CompressedBlocks::removeCached(qint64 number)
+{
+    for (int i = 0; i < m_cache.size(); ++i)
+    {
+        if (m_cache[i].number == number)
+        {
+            delete m_cache.takeAt(i).block;
+            return;
+        }
+    }
+}
@@ -0,0 +1,516 @@
+#include "inc/headlesscapture.h"
+#include "inc/traceserver.h"
+#include "inc/tracemanager.h"
+#include "inc/tracedictionary.h"
+#include "inc/slabring.h"
+#include "inc/constants.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QDir>
+#include <QTimer>
+#include <QThread>
+#include <QLocale>
+#include <QDebug>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <QSocketNotifier>
+#include <sys/socket.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+const char* HEADLESS_OPTION = "--headless";
+// The writer is woken for every full block, and writes what is formatted at least
+// every WRITE_INTERVAL ms. The capture waits for it beyond MAX_BUFFER_SIZE.
+const int BUFFER_SIZE = 1024 * 1024;
+const int MAX_BUFFER_SIZE = 64 * 1024 * 1024;
+const int WRITE_INTERVAL = 16;
+const qint64 DEFAULT_MAX_FILE_SIZE = 256;   // MiB
+const int DEFAULT_MAX_FILES = 10;
+const int DEFAULT_SUMMARY_INTERVAL = 10;    // s
+// Time given to the traces still in the pipeline when stopping
+const int DRAIN_TIMEOUT = 5000;
+const int DRAIN_POLL_INTERVAL = 16;
+
+#ifdef Q_OS_WIN
+///
+/// \brief Helper function
+///        Called in a thread of its own on Ctrl+C or when the console is closed
+/// \return true, the event is handled
+///
+BOOL WINAPI onConsoleCtrl(DWORD)
+{
+    QMetaObject::invokeMethod(QCoreApplication::instance(), []() {
+        QCoreApplication::quit();
+    }, Qt::QueuedConnection);
+    return TRUE;
+}
+#else
+// The signal handler only writes to the first socket, the event loop reads the second one
+int stopSignalSockets[2] = {-1, -1};
+
+///
+/// \brief Helper function
+///        Signal handler, nothing but async-signal-safe calls
+///
+void onStopSignal(int)
+{
+    char signal = 1;
+    ssize_t written = ::write(stopSignalSockets[0], &signal, sizeof(signal));
+    Q_UNUSED(written)
+}
+#endif
+
+///
+/// \brief Helper function
+///        Stop the capture on Ctrl+C or when the CI kills the job, in the event loop
+/// \param app
+///
+void watchStopSignals(QCoreApplication& app)
+{
+#ifdef Q_OS_WIN
+    Q_UNUSED(app)
+    SetConsoleCtrlHandler(onConsoleCtrl, TRUE);
+#else
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, stopSignalSockets) != 0)
+    {
+        qDebug() << "Cannot watch the stop signals";
+        return;
+    }
+    // A signal repeated before the quit must not block the handler
+    fcntl(stopSignalSockets[0], F_SETFL, fcntl(stopSignalSockets[0], F_GETFL) | O_NONBLOCK);
+    auto notifier = new QSocketNotifier(stopSignalSockets[1], QSocketNotifier::Read, &app);
+    QObject::connect(notifier, &QSocketNotifier::activated, &app, &QCoreApplication::quit);
+
+    struct sigaction action = {};
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+#endif
+}
+}
+
+HeadlessCapture::HeadlessCapture(const QString& outputPath, qint64 maxFileSize, int maxFiles)
+    : m_outputPath(outputPath)
+    , m_startTime(QDateTime::currentDateTime())
+    , m_maxFileSize(maxFileSize)
+    , m_maxFiles(maxFiles)
+    , m_out(stdout)
+{
+    // Reserved, so that the buffers keep their memory when they are emptied
+    m_buffer.reserve(BUFFER_SIZE);
+    m_batch.reserve(BUFFER_SIZE);
+}
+
+HeadlessCapture::~HeadlessCapture()
+{
+    close();
+}
+
+///
+/// \brief HeadlessCapture::isRequested
+///        Checked before any application object is created, the headless mode
+///        needs a QCoreApplication instead of a QApplication
+/// \param argc
+/// \param argv
+/// \return true if --headless is on the command line
+///
+bool HeadlessCapture::isRequested(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (qstrcmp(argv[i], HEADLESS_OPTION) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+///
+/// \brief HeadlessCapture::run
+///        Receive and frame the traces as the live view does, and write them to files
+///        until stopped by a signal or by --duration
+/// \param argc
+/// \param argv
+/// \return exit code
+///
+int HeadlessCapture::run(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    qRegisterMetaType<TraceLines>();
+    qRegisterMetaType<OverloadStats>();
+    qRegisterMetaType<SlabRing*>("SlabRing*");
+    app.setOrganizationName("None");
+    app.setOrganizationDomain("None");
+    app.setApplicationName("TraceTerminal++");
+    app.setApplicationVersion("1.4");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("TraceTerminal++ headless capture. The interface, port and "
+                                     "endpoints are the ones of TraceTerminalPlus.ini.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "headless", "Capture without display." },
+        { "output", "Base path of the capture files.", "path", "traces.log" },
+        { "max-file-size", "Size of a capture file before the next one is started, in MiB.",
+          "MiB", QString::number(DEFAULT_MAX_FILE_SIZE) },
+        { "max-files", "Number of capture files kept, 0 keeps them all.",
+          "count", QString::number(DEFAULT_MAX_FILES) },
+        { "summary-interval", "Interval of the throughput and drop summary, in seconds.",
+          "seconds", QString::number(DEFAULT_SUMMARY_INTERVAL) },
+        { "duration", "Stop after this time, in seconds. Runs until Ctrl+C by default.", "seconds" },
+        { "interface", "Listen to this interface instead of the saved one.", "address" },
+        { "port", "Listen to this port instead of the saved one.", "port" },
+    });
+    parser.process(app);
+
+    HeadlessCapture capture(parser.value("output"),
+                            qMax<qint64>(parser.value("max-file-size").toLongLong(), 1) * 1024 * 1024,
+                            qMax(parser.value("max-files").toInt(), 0));
+    QString errorString;
+    if (!capture.open(errorString))
+    {
+        capture.m_out << "Open capture file failed: " << errorString << Qt::endl;
+        return 1;
+    }
+
+    TraceServer& server = TraceServer::instance();
+    TraceManager& traceManager = TraceManager::instance();
+
+    QObject::connect(&server, &TraceServer::bindResult, &capture, &HeadlessCapture::onBindResult);
+    QObject::connect(&server, &TraceServer::endpointResult, &capture, &HeadlessCapture::onEndpointResult);
+    QObject::connect(&server, &TraceServer::statsUpdated, &capture, &HeadlessCapture::onIngestStatsUpdated);
+    // The stream endpoints add their sources from their listener thread
+    QObject::connect(&server, &TraceServer::ingestSourceAdded,
+                     &capture, [&](SlabRing*, quint16 sourceId, QString name){
+        capture.setSourceName(sourceId, name);
+    }, Qt::DirectConnection);
+    QObject::connect(&server, &TraceServer::ingestSourceAdded,
+                     &traceManager, &TraceManager::onIngestSourceAdded, Qt::DirectConnection);
+    QObject::connect(&server, &TraceServer::ingestSourceRemoved,
+                     &traceManager, &TraceManager::onIngestSourceRemoved, Qt::DirectConnection);
+    // Written in the send trace thread, the batch size adapts to the write speed as it does to the view
+    QObject::connect(&traceManager, &TraceManager::newTracesReady,
+                     &capture, &HeadlessCapture::writeTraces, Qt::DirectConnection);
+    QObject::connect(&capture, &HeadlessCapture::tracesWritten,
+                     &traceManager, &TraceManager::onTracesDisplayed, Qt::DirectConnection);
+    QObject::connect(&traceManager, &TraceManager::overloadStatsChanged,
+                     &capture, &HeadlessCapture::onOverloadStatsChanged, Qt::QueuedConnection);
+
+    server.init();
+    if (parser.isSet("interface"))
+    {
+        server.onInterfaceChangeRequested(parser.value("interface"));
+    }
+    if (parser.isSet("port"))
+    {
+        server.onPortChangeRequested(quint16(parser.value("port").toUInt()));
+    }
+
+    QTimer summaryTimer;
+    QObject::connect(&summaryTimer, &QTimer::timeout, &capture, &HeadlessCapture::printSummary);
+    summaryTimer.start(qMax(parser.value("summary-interval").toInt(), 1) * 1000);
+    if (parser.isSet("duration"))
+    {
+        QTimer::singleShot(parser.value("duration").toInt() * 1000, &app, &QCoreApplication::quit);
+    }
+    watchStopSignals(app);
+
+    int ret = app.exec();
+
+    // Let trace manager hand over what is still in the pipeline
+    QElapsedTimer drainTimer;
+    drainTimer.start();
+    do
+    {
+        QThread::msleep(DRAIN_POLL_INTERVAL * 2);
+    } while (traceManager.backlog() > 0 && !drainTimer.hasExpired(DRAIN_TIMEOUT));
+    QObject::disconnect(&traceManager, &TraceManager::newTracesReady,
+                        &capture, &HeadlessCapture::writeTraces);
+    // A batch still being written holds the manager lock, wait for it before closing
+    traceManager.backlog();
+
+    capture.close();
+    capture.printSummary();
+    return ret;
+}
+
+///
+/// \brief HeadlessCapture::open
+/// \param errorString
+/// \return false if the first file cannot be created
+///
+bool HeadlessCapture::open(QString& errorString)
+{
+    if (!openNextFile())
+    {
+        errorString = m_file.errorString();
+        return false;
+    }
+    m_summaryElapsed.start();
+    m_open = true;
+    m_writer = QThread::create([this]() {
+        write();
+    });
+    m_writer->start();
+    return true;
+}
+
+///
+/// \brief HeadlessCapture::close
+///        Write what is left in the buffer
+///
+void HeadlessCapture::close()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_open = false;
+        m_closing = true;
+        m_bufferReady.wakeOne();
+    }
+    if (m_writer)
+    {
+        m_writer->wait();
+        delete m_writer;
+        m_writer = nullptr;
+    }
+    if (m_file.isOpen())
+    {
+        m_file.close();
+    }
+}
+
+///
+/// \brief HeadlessCapture::writeTraces
+///        Called in the send trace thread. The lines are formatted as in the live view
+///        and handed to the writer thread by large blocks.
+/// \param traces
+///
+void HeadlessCapture::writeTraces(TraceLines traces)
+{
+    QElapsedTimer writeTimer;
+    writeTimer.start();
+    {
+        QMutexLocker lock(&m_mutex);
+        while (m_open && m_buffer.size() >= MAX_BUFFER_SIZE)
+        {
+            // The disk does not keep up, the traces wait in the ring and the socket
+            m_bufferWritten.wait(&m_mutex);
+        }
+        if (!m_open)
+        {
+            return;
+        }
+        const auto& dictionary = TraceDictionary::instance();
+        for (const auto& trace : qAsConst(traces))
+        {
+            if (trace.sourceId != 0)
+            {
+                m_buffer.append('[').append(m_sourceNames.value(trace.sourceId).toUtf8()).append("] ");
+            }
+            if (trace.encoding == TraceLine::Binary)
+            {
+                m_buffer.append(dictionary.format(trace.text()).toUtf8());
+            }
+            else
+            {
+                m_buffer.append(trace.data(), trace.size);
+            }
+            m_buffer.append('\n');
+        }
+        if (m_buffer.size() >= BUFFER_SIZE)
+        {
+            m_bufferReady.wakeOne();
+        }
+        m_writtenLines.fetchAndAddRelaxed(quint64(traces.size()));
+    }
+    emit tracesWritten(traces.size(), writeTimer.nsecsElapsed());
+}
+
+///
+/// \brief HeadlessCapture::write
+///        Run by the writer thread until the capture is closed
+///
+void HeadlessCapture::write()
+{
+    QMutexLocker lock(&m_mutex);
+    bool closing = false;
+    while (!closing)
+    {
+        if (!m_closing && m_buffer.size() < BUFFER_SIZE)
+        {
+            m_bufferReady.wait(&m_mutex, WRITE_INTERVAL);
+        }
+        closing = m_closing;
+        m_batch.swap(m_buffer);
+        m_bufferWritten.wakeAll();
+        lock.unlock();
+
+        writeBatch();
+
+        lock.relock();
+    }
+}
+
+///
+/// \brief HeadlessCapture::writeBatch
+///        Start the next file first if the batch does not fit in the current one
+///
+void HeadlessCapture::writeBatch()
+{
+    if (m_batch.isEmpty())
+    {
+        return;
+    }
+    if (m_file.size() > 0 && m_file.size() + m_batch.size() > m_maxFileSize && !openNextFile())
+    {
+        qDebug() << "Open capture file failed" << m_file.errorString();
+        m_batch.resize(0);
+        return;
+    }
+    if (m_file.write(m_batch) != m_batch.size())
+    {
+        qDebug() << "Write capture file failed" << m_file.errorString();
+    }
+    // Visible to the readers of the file at each write
+    m_file.flush();
+    m_writtenBytes.fetchAndAddRelaxed(quint64(m_batch.size()));
+    m_batch.resize(0);
+}
+
+///
+/// \brief HeadlessCapture::fileName
+/// \param index
+/// \return path of the capture file, e.g. traces-20240131-221500-0003.log
+///
+QString HeadlessCapture::fileName(int index) const
+{
+    QFileInfo info(m_outputPath);
+    QString name = QString("%1-%2-%3").arg(info.completeBaseName(),
+                                           m_startTime.toString("yyyyMMdd-hhmmss"),
+                                           QString::number(index).rightJustified(4, '0'));
+    if (!info.suffix().isEmpty())
+    {
+        name += "." + info.suffix();
+    }
+    return info.dir().filePath(name);
+}
+
+///
+/// \brief HeadlessCapture::openNextFile
+///        Close the current file, remove the oldest one beyond the maximum count
+/// \return false if the next file cannot be created
+///
+bool HeadlessCapture::openNextFile()
+{
+    if (m_file.isOpen())
+    {
+        m_file.close();
+    }
+    ++m_fileIndex;
+    if (m_maxFiles > 0 && m_fileIndex > m_maxFiles)
+    {
+        QFile::remove(fileName(m_fileIndex - m_maxFiles));
+    }
+    m_file.setFileName(fileName(m_fileIndex));
+    {
+        QMutexLocker lock(&m_mutex);
+        m_fileName = m_file.fileName();
+    }
+    return m_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+}
+
+///
+/// \brief HeadlessCapture::setSourceName
+/// \param sourceId
+/// \param name
+///
+void HeadlessCapture::setSourceName(quint16 sourceId, QString name)
+{
+    QMutexLocker lock(&m_mutex);
+    m_sourceNames[sourceId] = name;
+}
+
+///
+/// \brief HeadlessCapture::onBindResult
+/// \param addr
+/// \param port
+/// \param success
+///
+void HeadlessCapture::onBindResult(QString addr, quint16 port, bool success)
+{
+    m_out << "Binding to " << addr;
+    if (addr != SpecialInterface::SERIAL_INTERFACE)
+    {
+        m_out << ":" << port;
+    }
+    m_out << (success ? " interface OK" : " interface failed") << Qt::endl;
+}
+
+///
+/// \brief HeadlessCapture::onEndpointResult
+/// \param endpoint
+/// \param success
+///
+void HeadlessCapture::onEndpointResult(QString endpoint, bool success)
+{
+    m_out << "Listening to endpoint " << endpoint << (success ? " OK" : " failed") << Qt::endl;
+}
+
+///
+/// \brief HeadlessCapture::onIngestStatsUpdated
+/// \param stats
+///
+void HeadlessCapture::onIngestStatsUpdated(const IngestStats& stats)
+{
+    m_kernelDrops = stats.kernelDrops;
+    m_ringDrops = stats.ringDrops;
+}
+
+///
+/// \brief HeadlessCapture::onOverloadStatsChanged
+/// \param stats
+///
+void HeadlessCapture::onOverloadStatsChanged(OverloadStats stats)
+{
+    m_overloadDrops = stats.droppedLines;
+}
+
+///
+/// \brief HeadlessCapture::printSummary
+///        Throughput since the last summary, and the traces lost on the way
+///
+void HeadlessCapture::printSummary()
+{
+    quint64 lines = m_writtenLines.loadRelaxed();
+    quint64 bytes = m_writtenBytes.loadRelaxed();
+    double seconds = qMax<qint64>(m_summaryElapsed.restart(), 1) / 1000.0;
+    QString file;
+    {
+        QMutexLocker lock(&m_mutex);
+        file = m_fileName;
+    }
+
+    QLocale locale;
+    m_out << QTime::currentTime().toString("hh:mm:ss")
+          << QString(" lines %1 (%2/s), %3/s | dropped: kernel %4, ring %5, overload %6 | backlog %7 | %8")
+                 .arg(lines)
+                 .arg(qRound64((lines - m_lastLines) / seconds))
+                 .arg(locale.formattedDataSize(qint64((bytes - m_lastBytes) / seconds)))
+                 .arg(m_kernelDrops)
+                 .arg(m_ringDrops)
+                 .arg(m_overloadDrops)
+                 .arg(TraceManager::instance().backlog())
+                 .arg(QDir::toNativeSeparators(file))
+          << Qt::endl;
+    m_lastLines = lines;
+    m_lastBytes = bytes;
+}
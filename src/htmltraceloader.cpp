@@ -0,0 +1,51 @@
+#include "inc/htmltraceloader.h"
+#include "inc/htmltraceparser.h"
+#include <QFile>
+
+HtmlTraceLoader::HtmlTraceLoader(const QString& path)
+    : m_path(path)
+{
+}
+
+///
+/// \brief HtmlTraceLoader::~HtmlTraceLoader
+///        Cancel the loading, the parts not taken yet are dropped
+///
+HtmlTraceLoader::~HtmlTraceLoader()
+{
+    stop();
+}
+
+///
+/// \brief HtmlTraceLoader::load
+///        Run by the worker
+///
+void HtmlTraceLoader::load()
+{
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        finish(file.errorString());
+        return;
+    }
+
+    qint64 size = file.size();
+    HtmlTraceParser parser;
+    bool atEnd = false;
+    while (!atEnd && !isStopped())
+    {
+        QByteArray data = file.read(LOAD_CHUNK_SIZE);
+        atEnd = data.isEmpty();
+        LineBlock lines;
+        if (atEnd)
+        {
+            parser.finish(lines);
+        }
+        else
+        {
+            parser.parse(data, lines);
+        }
+        handOver(lines, file.pos(), size);
+    }
+    finish(file.error() == QFileDevice::NoError ? QString() : file.errorString());
+}
@@ -0,0 +1,342 @@
+#include "inc/htmltraceparser.h"
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+// Longest entity looked for, e.g. "&#x10FFFF;"
+const int MAX_ENTITY_LENGTH = 10;
+
+///
+/// \brief Helper function
+/// \param tag content of the tag, without the brackets
+/// \param size
+/// \param name lower case name, "/p" for a closing tag
+/// \return true if the tag has the name
+///
+bool isTag(const char* tag, int size, const char* name)
+{
+    int length = int(strlen(name));
+    if (size < length || qstrnicmp(tag, name, uint(length)) != 0)
+    {
+        return false;
+    }
+    return size == length || !isalnum(static_cast<unsigned char>(tag[length]));
+}
+
+///
+/// \brief Helper function
+///        Find the color of the style of a span, e.g. style=" color:#ff0000;"
+/// \param tag content of the tag
+/// \param size
+/// \param color set to the color found
+/// \return false if the tag has no color
+///
+bool findColor(const char* tag, int size, QRgb& color)
+{
+    const char* end = tag + size;
+    for (const char* position = tag; position + 6 < end; ++position)
+    {
+        if (memcmp(position, "color:", 6) != 0 || (position > tag && (isalnum(static_cast<unsigned char>(position[-1])) || position[-1] == '-')))
+        {
+            // E.g. background-color
+            continue;
+        }
+        const char* value = position + 6;
+        while (value < end && *value == ' ')
+        {
+            ++value;
+        }
+        if (value >= end || *value != '#')
+        {
+            return false;
+        }
+        ++value;
+        int digits = 0;
+        QRgb rgb = 0;
+        for (; value + digits < end && isxdigit(static_cast<unsigned char>(value[digits])); ++digits)
+        {
+            char digit = char(tolower(value[digits]));
+            rgb = (rgb << 4) | QRgb(digit <= '9' ? digit - '0' : digit - 'a' + 10);
+        }
+        if (digits == 3)
+        {
+            // #rgb
+            rgb = ((rgb & 0xf00) << 12) | ((rgb & 0xf00) << 8) | ((rgb & 0x0f0) << 8)
+                  | ((rgb & 0x0f0) << 4) | ((rgb & 0x00f) << 4) | (rgb & 0x00f);
+        }
+        else if (digits != 6)
+        {
+            return false;
+        }
+        color = 0xff000000 | rgb;
+        return true;
+    }
+    return false;
+}
+}
+
+///
+/// \brief HtmlTraceParser::parse
+/// \param data next part of the document
+/// \param lines the lines ended in the part are appended to it
+///
+void HtmlTraceParser::parse(const QByteArray& data, LineBlock& lines)
+{
+    QByteArray input = m_pending.isEmpty() ? data : m_pending + data;
+    m_pending.clear();
+    const char* position = input.constData();
+    const char* end = position + input.size();
+    while (position < end)
+    {
+        if (*position == '<')
+        {
+            if (end - position < 4)
+            {
+                m_pending = QByteArray(position, int(end - position));
+                break;
+            }
+            const char* tagEnd;
+            if (memcmp(position, "<!--", 4) == 0)
+            {
+                // Comment, may hold a '>'
+                int commentEnd = input.indexOf("-->", int(position - input.constData()) + 4);
+                tagEnd = commentEnd < 0 ? nullptr : input.constData() + commentEnd + 2;
+            }
+            else
+            {
+                tagEnd = static_cast<const char*>(memchr(position, '>', size_t(end - position)));
+                if (tagEnd)
+                {
+                    parseTag(position + 1, int(tagEnd - position - 1), lines);
+                }
+            }
+            if (!tagEnd)
+            {
+                m_pending = QByteArray(position, int(end - position));
+                break;
+            }
+            position = tagEnd + 1;
+        }
+        else if (*position == '&')
+        {
+            int length = int(qMin<qint64>(end - position, MAX_ENTITY_LENGTH + 1));
+            auto entityEnd = static_cast<const char*>(memchr(position, ';', size_t(length)));
+            if (entityEnd)
+            {
+                parseEntity(position + 1, int(entityEnd - position - 1));
+                position = entityEnd + 1;
+            }
+            else if (end - position <= MAX_ENTITY_LENGTH)
+            {
+                m_pending = QByteArray(position, int(end - position));
+                break;
+            }
+            else
+            {
+                // Not an entity
+                appendText(position, 1);
+                ++position;
+            }
+        }
+        else
+        {
+            const char* textEnd = position;
+            while (textEnd < end && *textEnd != '<' && *textEnd != '&')
+            {
+                ++textEnd;
+            }
+            appendText(position, int(textEnd - position));
+            position = textEnd;
+        }
+    }
+}
+
+///
+/// \brief HtmlTraceParser::finish
+///        End of the document
+/// \param lines the last line is appended to it if its paragraph is not closed
+///
+void HtmlTraceParser::finish(LineBlock& lines)
+{
+    if (m_inParagraph && !m_text.isEmpty())
+    {
+        endLine(lines);
+    }
+    m_pending.clear();
+    m_inParagraph = false;
+}
+
+///
+/// \brief HtmlTraceParser::parseTag
+///        A paragraph is a line, a span with a color starts a color run
+/// \param tag content of the tag, without the brackets
+/// \param size
+/// \param lines
+///
+void HtmlTraceParser::parseTag(const char* tag, int size, LineBlock& lines)
+{
+    if (isTag(tag, size, "p"))
+    {
+        if (m_inParagraph)
+        {
+            endLine(lines);
+        }
+        m_inParagraph = true;
+    }
+    else if (isTag(tag, size, "/p") || isTag(tag, size, "/body"))
+    {
+        if (m_inParagraph)
+        {
+            endLine(lines);
+        }
+    }
+    else if (isTag(tag, size, "span"))
+    {
+        QRgb color = m_colors.isEmpty() ? 0 : m_colors.last();
+        findColor(tag, size, color);
+        m_colors.append(color);
+    }
+    else if (isTag(tag, size, "/span"))
+    {
+        if (!m_colors.isEmpty())
+        {
+            m_colors.removeLast();
+        }
+    }
+    // The <br /> of the empty lines and the other tags are skipped
+}
+
+///
+/// \brief HtmlTraceParser::parseEntity
+/// \param entity name of the entity, without '&' and ';'
+/// \param size
+///
+void HtmlTraceParser::parseEntity(const char* entity, int size)
+{
+    QByteArray name(entity, size);
+    if (name == "lt")
+    {
+        appendText("<", 1);
+    }
+    else if (name == "gt")
+    {
+        appendText(">", 1);
+    }
+    else if (name == "amp")
+    {
+        appendText("&", 1);
+    }
+    else if (name == "quot")
+    {
+        appendText("\"", 1);
+    }
+    else if (name == "apos")
+    {
+        appendText("'", 1);
+    }
+    else if (name == "nbsp")
+    {
+        appendCodePoint(0xa0);
+    }
+    else if (name.startsWith('#'))
+    {
+        bool ok;
+        uint codePoint = name.startsWith("#x") || name.startsWith("#X") ? name.mid(2).toUInt(&ok, 16)
+                                                                         : name.mid(1).toUInt(&ok, 10);
+        if (ok && codePoint > 0 && codePoint <= 0x10ffff)
+        {
+            appendCodePoint(codePoint);
+        }
+    }
+    else
+    {
+        // Unknown, kept as is
+        appendText(entity - 1, size + 2);
+    }
+}
+
+///
+/// \brief HtmlTraceParser::appendText
+///        Append text of the paragraph in the color of the innermost span
+/// \param data UTF-8 text, the line breaks of the file are skipped
+/// \param size
+///
+void HtmlTraceParser::appendText(const char* data, int size)
+{
+    if (!m_inParagraph || size == 0)
+    {
+        return;
+    }
+
+    QRgb color = m_colors.isEmpty() ? 0 : m_colors.last();
+    if (m_spans.isEmpty() ? qAlpha(color) != 0 : m_spans.last().color != color)
+    {
+        m_spans.append({ m_column, color });
+    }
+    for (int i = 0; i < size; ++i)
+    {
+        auto byte = static_cast<unsigned char>(data[i]);
+        if (byte == '\n' || byte == '\r')
+        {
+            continue;
+        }
+        m_text.append(char(byte));
+        if ((byte & 0xc0) != 0x80)
+        {
+            // Columns are counted in UTF-16, as the decoded line
+            m_column += byte >= 0xf0 ? 2 : 1;
+        }
+    }
+}
+
+///
+/// \brief HtmlTraceParser::appendCodePoint
+/// \param codePoint
+///
+void HtmlTraceParser::appendCodePoint(uint codePoint)
+{
+    char utf8[4];
+    int size;
+    if (codePoint < 0x80)
+    {
+        utf8[0] = char(codePoint);
+        size = 1;
+    }
+    else if (codePoint < 0x800)
+    {
+        utf8[0] = char(0xc0 | (codePoint >> 6));
+        utf8[1] = char(0x80 | (codePoint & 0x3f));
+        size = 2;
+    }
+    else if (codePoint < 0x10000)
+    {
+        utf8[0] = char(0xe0 | (codePoint >> 12));
+        utf8[1] = char(0x80 | ((codePoint >> 6) & 0x3f));
+        utf8[2] = char(0x80 | (codePoint & 0x3f));
+        size = 3;
+    }
+    else
+    {
+        utf8[0] = char(0xf0 | (codePoint >> 18));
+        utf8[1] = char(0x80 | ((codePoint >> 12) & 0x3f));
+        utf8[2] = char(0x80 | ((codePoint >> 6) & 0x3f));
+        utf8[3] = char(0x80 | (codePoint & 0x3f));
+        size = 4;
+    }
+    appendText(utf8, size);
+}
+
+///
+/// \brief HtmlTraceParser::endLine
+/// \param lines
+///
+void HtmlTraceParser::endLine(LineBlock& lines)
+{
+    lines.append(m_text.constData(), m_text.size(), m_spans.constData(), m_spans.size(), 0);
+    m_text.clear();
+    m_column = 0;
+    m_spans.clear();
+    m_colors.clear();
+    m_inParagraph = false;
+}
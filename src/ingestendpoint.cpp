@@ -0,0 +1,92 @@
+#include "inc/ingestendpoint.h"
+#include <QHostAddress>
+
+///
+/// \brief IngestEndpoint::toString
+/// \return the endpoint in the settings syntax
+///
+QString IngestEndpoint::toString() const
+{
+    switch (type)
+    {
+    case Udp:
+        return QString("udp:%1:%2").arg(address, QString::number(port));
+    case Serial:
+        return QString("serial:%1@%2").arg(address, QString::number(baudRate));
+    case Tcp:
+        return QString("tcp:%1:%2").arg(address, QString::number(port));
+    case Local:
+        return QString("unix:%1").arg(address);
+    default:
+        return QString();
+    }
+}
+
+///
+/// \brief IngestEndpoint::fromString
+/// \param text endpoint in the settings syntax
+/// \return the parsed endpoint, invalid if the syntax is not recognized
+///
+IngestEndpoint IngestEndpoint::fromString(const QString& text)
+{
+    IngestEndpoint endpoint;
+    QString spec = text.trimmed();
+    int schemeEnd = spec.indexOf(':');
+    if (schemeEnd < 0)
+    {
+        return endpoint;
+    }
+    QString scheme = spec.left(schemeEnd).toLower();
+    QString rest = spec.mid(schemeEnd + 1);
+
+    if (scheme == "udp" || scheme == "tcp")
+    {
+        // The port is after the last colon, IPv6 addresses contain colons too
+        int portSeparator = rest.lastIndexOf(':');
+        bool ok = false;
+        quint16 port = portSeparator > 0 ? rest.mid(portSeparator + 1).toUShort(&ok) : 0;
+        QString address = rest.left(portSeparator);
+        if (address.startsWith('[') && address.endsWith(']'))
+        {
+            address = address.mid(1, address.length() - 2);
+        }
+        if (!ok || port == 0 || QHostAddress(address).isNull())
+        {
+            return endpoint;
+        }
+        endpoint.type = scheme == "udp" ? Udp : Tcp;
+        endpoint.address = address;
+        endpoint.port = port;
+    }
+    else if (scheme == "serial")
+    {
+        int baudSeparator = rest.lastIndexOf('@');
+        if (baudSeparator >= 0)
+        {
+            bool ok = false;
+            qint32 baudRate = rest.mid(baudSeparator + 1).toInt(&ok);
+            if (!ok || baudRate <= 0)
+            {
+                return endpoint;
+            }
+            endpoint.baudRate = baudRate;
+            rest = rest.left(baudSeparator);
+        }
+        if (rest.isEmpty())
+        {
+            return endpoint;
+        }
+        endpoint.type = Serial;
+        endpoint.address = rest;
+    }
+    else if (scheme == "unix")
+    {
+        if (rest.isEmpty())
+        {
+            return endpoint;
+        }
+        endpoint.type = Local;
+        endpoint.address = rest;
+    }
+    return endpoint;
+}
@@ -0,0 +1,120 @@
+#include "inc/journalloader.h"
+#include "inc/sessionjournal.h"
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QDebug>
+#include <limits>
+
+JournalLoader::JournalLoader(const QString& sessionPath)
+    : m_path(sessionPath)
+{
+}
+
+///
+/// \brief JournalLoader::~JournalLoader
+///        Cancel the loading, the parts not taken yet are dropped
+///
+JournalLoader::~JournalLoader()
+{
+    stop();
+}
+
+///
+/// \brief JournalLoader::load
+///        Run by the worker
+///
+void JournalLoader::load()
+{
+    QDir dir(m_path);
+    const QFileInfoList segments = dir.entryInfoList({"segment-*.log"}, QDir::Files, QDir::Name);
+    qint64 size = 0;
+    for (const auto& segment : segments)
+    {
+        size += segment.size();
+    }
+    SessionJournal::Checkpoint checkpoint;
+    bool checkpointed = SessionJournal::lastCheckpoint(m_path, checkpoint);
+
+    QHash<quint16, QByteArray> sourceTags;
+    QString errorString;
+    qint64 bytesDone = 0;
+    for (const auto& segment : segments)
+    {
+        if (isStopped())
+        {
+            break;
+        }
+        QFile file(segment.filePath());
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            errorString = file.errorString();
+            break;
+        }
+        // The records before the last checkpoint were synced, they are not checked
+        int number = segment.baseName().section('-', 1).toInt();
+        qint64 synced = 0;
+        if (checkpointed && number < checkpoint.segment)
+        {
+            synced = std::numeric_limits<qint64>::max();
+        }
+        else if (checkpointed && number == checkpoint.segment)
+        {
+            synced = checkpoint.offset;
+        }
+
+        QByteArray pending;
+        qint64 pendingOffset = 0;
+        bool atEnd = false;
+        bool corrupted = false;
+        while (!atEnd && !corrupted && !isStopped())
+        {
+            QByteArray data = file.read(LOAD_CHUNK_SIZE);
+            atEnd = data.isEmpty();
+            pending.append(data);
+
+            LineBlock lines;
+            int offset = 0;
+            forever
+            {
+                SessionJournal::Record record;
+                int recordSize = SessionJournal::parseRecord(pending.constData() + offset, pending.size() - offset,
+                                                             pendingOffset + offset >= synced, record);
+                if (recordSize <= 0)
+                {
+                    corrupted = recordSize < 0;
+                    break;
+                }
+                offset += recordSize;
+
+                QByteArray text = QByteArray::fromRawData(record.text, record.size);
+                if (record.kind == SessionJournal::SourceName)
+                {
+                    sourceTags[record.sourceId] = '[' + text + "] ";
+                    continue;
+                }
+                // Lines of additional endpoints are tagged with the endpoint name
+                QByteArray tag = record.sourceId != 0 ? sourceTags.value(record.sourceId, "[] ") : QByteArray();
+                if (record.kind == SessionJournal::BinaryLine)
+                {
+                    // Formatted by the view when shown, the dictionary is not used by the worker
+                    text += tag;
+                    lines.append(text.constData(), text.size(), nullptr, 0, record.timestamp, TraceLine::Binary);
+                    continue;
+                }
+                text.prepend(tag);
+                lines.append(text.constData(), text.size(), nullptr, 0, record.timestamp);
+            }
+            pending.remove(0, offset);
+            pendingOffset += offset;
+            if ((atEnd && !pending.isEmpty()) || corrupted)
+            {
+                // Written when the session crashed, what follows is not trusted
+                qDebug() << "Journal" << file.fileName() << "ends at" << pendingOffset;
+            }
+            handOver(lines, bytesDone + (corrupted ? file.size() : file.pos()), size);
+        }
+        bytesDone += file.size();
+    }
+    finish(errorString);
+}
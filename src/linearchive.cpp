@@ -0,0 +1,274 @@
+#include "inc/linearchive.h"
+#include <QDir>
+#include <QDebug>
+#include <algorithm>
+
+namespace
+{
+const qint64 SEGMENT_SIZE = 64 * 1024 * 1024;
+// Blocks kept decoded, enough for a screen across two blocks and a search going on
+const int CACHED_BLOCKS = 4;
+}
+
+LineArchive::LineArchive()
+    : m_dir(QDir::tempPath() + "/TraceTerminalPlus-view-XXXXXX")
+{
+    if (!m_dir.isValid())
+    {
+        qDebug() << "Create view archive directory failed" << m_dir.errorString();
+    }
+}
+
+LineArchive::~LineArchive()
+{
+    clearCache();
+    m_reader.close();
+    m_writer.close();
+}
+
+///
+/// \brief LineArchive::append
+///        Write the block at the end of the last segment
+/// \param block
+/// \param skip lines removed from the start of the block, not part of the archive
+/// \return the lines removed from the start to stay in the disk usage, -1 if the block
+///         could not be written
+///
+int LineArchive::append(const LineBlock& block, int skip)
+{
+    QByteArray data = block.serialize();
+    if (!m_writer.isOpen() || m_writer.size() + data.size() > SEGMENT_SIZE)
+    {
+        if (!openNextSegment())
+        {
+            return -1;
+        }
+    }
+
+    Entry entry;
+    entry.start = m_end;
+    entry.skip = skip;
+    entry.lines = block.size();
+    entry.segment = m_nextSegment - 1;
+    entry.offset = m_writer.size();
+    entry.size = data.size();
+    if (m_writer.write(data) != data.size() || !m_writer.flush())
+    {
+        qDebug() << "Write view archive failed" << m_writer.errorString();
+        return -1;
+    }
+    m_entries.append(entry);
+    m_end = entry.end();
+    m_segmentSizes.last() += entry.size;
+    m_diskUsage += entry.size;
+
+    int removed = 0;
+    while (m_maxDiskUsage > 0 && m_diskUsage > m_maxDiskUsage && m_segmentSizes.size() > 1)
+    {
+        removed += removeOldestSegment();
+    }
+    return removed;
+}
+
+///
+/// \brief LineArchive::removeFirst
+/// \param count number of lines removed from the start
+///
+void LineArchive::removeFirst(int count)
+{
+    m_start = qMin(m_end, m_start + qMax(count, 0));
+    int removedEntries = 0;
+    while (removedEntries < m_entries.size() && m_entries[removedEntries].end() <= m_start)
+    {
+        ++removedEntries;
+    }
+    if (removedEntries == 0)
+    {
+        return;
+    }
+    m_entries.remove(0, removedEntries);
+    clearCache();
+
+    if (m_entries.isEmpty())
+    {
+        // Nothing left, the last segment is not written anymore
+        m_writer.close();
+        removeSegmentsBefore(m_nextSegment);
+    }
+    else
+    {
+        removeSegmentsBefore(m_entries.first().segment);
+    }
+}
+
+///
+/// \brief LineArchive::blockAt
+///        Read the block of the line back, unless it is cached
+/// \param line line of the archive
+/// \param index set to the index of the line in the block
+/// \return the block, nullptr if it could not be read
+///
+const LineBlock* LineArchive::blockAt(int line, int& index)
+{
+    qint64 number = m_start + line;
+    auto entry = std::upper_bound(m_entries.constBegin(), m_entries.constEnd(), number,
+                                  [](qint64 value, const Entry& entry) {
+        return value < entry.start;
+    }) - 1;
+    index = entry->skip + int(number - entry->start);
+
+    for (int i = 0; i < m_cache.size(); ++i)
+    {
+        if (m_cache[i].start == entry->start)
+        {
+            m_cache.move(i, 0);
+            return m_cache.first().block;
+        }
+    }
+
+    if (m_readSegment != entry->segment)
+    {
+        m_reader.close();
+        m_reader.setFileName(segmentPath(entry->segment));
+        m_readSegment = entry->segment;
+        if (!m_reader.open(QIODevice::ReadOnly))
+        {
+            qDebug() << "Open view archive failed" << m_reader.errorString();
+            m_readSegment = -1;
+            return nullptr;
+        }
+    }
+    auto block = new LineBlock;
+    QByteArray data;
+    if (m_reader.seek(entry->offset))
+    {
+        data = m_reader.read(entry->size);
+    }
+    if (data.size() != entry->size || !block->deserialize(data))
+    {
+        qDebug() << "Read view archive failed" << m_reader.errorString();
+        delete block;
+        return nullptr;
+    }
+
+    m_cache.prepend({ entry->start, block });
+    if (m_cache.size() > CACHED_BLOCKS)
+    {
+        delete m_cache.takeLast().block;
+    }
+    return block;
+}
+
+///
+/// \brief LineArchive::memoryUsage
+/// \return bytes allocated for the index and the cached blocks
+///
+qint64 LineArchive::memoryUsage() const
+{
+    qint64 usage = qint64(m_entries.capacity()) * qint64(sizeof(Entry))
+                   + qint64(m_segmentSizes.capacity()) * qint64(sizeof(qint64));
+    for (const auto& cached : m_cache)
+    {
+        usage += cached.block->memoryUsage();
+    }
+    return usage;
+}
+
+///
+/// \brief LineArchive::segmentPath
+/// \param segment
+/// \return
+///
+QString LineArchive::segmentPath(int segment) const
+{
+    return m_dir.filePath(QString("segment-%1.bin").arg(segment, 6, 10, QChar('0')));
+}
+
+///
+/// \brief LineArchive::openNextSegment
+/// \return false if the segment file cannot be created
+///
+bool LineArchive::openNextSegment()
+{
+    if (!m_dir.isValid())
+    {
+        return false;
+    }
+    m_writer.close();
+    m_writer.setFileName(segmentPath(m_nextSegment));
+    if (!m_writer.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "Create view archive segment failed" << m_writer.errorString();
+        return false;
+    }
+    if (m_segmentSizes.isEmpty())
+    {
+        m_firstSegment = m_nextSegment;
+    }
+    m_segmentSizes.append(0);
+    ++m_nextSegment;
+    return true;
+}
+
+///
+/// \brief LineArchive::removeSegmentsBefore
+///        Remove the files of the segments without any line left
+/// \param segment first segment kept
+///
+void LineArchive::removeSegmentsBefore(int segment)
+{
+    while (!m_segmentSizes.isEmpty() && m_firstSegment < segment)
+    {
+        if (m_readSegment == m_firstSegment)
+        {
+            m_reader.close();
+            m_readSegment = -1;
+        }
+        if (!QFile::remove(segmentPath(m_firstSegment)))
+        {
+            qDebug() << "Remove view archive segment failed" << segmentPath(m_firstSegment);
+        }
+        m_diskUsage -= m_segmentSizes.takeFirst();
+        ++m_firstSegment;
+    }
+}
+
+///
+/// \brief LineArchive::removeOldestSegment
+/// \return number of lines removed with the segment
+///
+int LineArchive::removeOldestSegment()
+{
+    qint64 start = m_end;
+    for (const auto& entry : m_entries)
+    {
+        if (entry.segment != m_firstSegment)
+        {
+            start = entry.start;
+            break;
+        }
+    }
+    int removed = int(start - m_start);
+    if (removed > 0)
+    {
+        removeFirst(removed);
+    }
+    else
+    {
+        // A segment left without any block by a failed write
+        removeSegmentsBefore(m_firstSegment + 1);
+    }
+    return removed;
+}
+
+///
+/// \brief LineArchive::clearCache
+///
+void LineArchive::clearCache()
+{
+    for (const auto& cached : m_cache)
+    {
+        delete cached.block;
+    }
+    m_cache.clear();
+}
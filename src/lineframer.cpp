@@ -0,0 +1,77 @@
+#include "inc/lineframer.h"
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LINEFRAMER_USE_SSE2
+#endif
+
+///
+/// \brief LineFramer::append
+///        Queue a chunk of raw data, the data is shared with the caller, not copied
+/// \param chunk
+///
+void LineFramer::append(const QByteArray& chunk)
+{
+    if (!chunk.isEmpty())
+    {
+        m_chunks.append(chunk);
+    }
+}
+
+///
+/// \brief LineFramer::clear
+///
+void LineFramer::clear()
+{
+    m_chunks.clear();
+    m_carry.clear();
+}
+
+///
+/// \brief LineFramer::takePartialLine
+///        Take out the incomplete line, e.g. when its source is gone
+/// \return the bytes received after the last line terminator
+///
+QByteArray LineFramer::takePartialLine()
+{
+    takeLines([](const char*, int){});
+    QByteArray partial = m_carry;
+    m_carry.clear();
+    return partial;
+}
+
+///
+/// \brief LineFramer::findNewline
+///        Vectorized search of '\n', 16 bytes at a time
+/// \param begin
+/// \param end
+/// \return pointer to the first '\n' in [begin, end), nullptr if there is none
+///
+const char* LineFramer::findNewline(const char* begin, const char* end)
+{
+#ifdef LINEFRAMER_USE_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    const char* pos = begin;
+    for (; end - pos >= 16; pos += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        if (mask)
+        {
+            return pos + qCountTrailingZeroBits(quint32(mask));
+        }
+    }
+    for (; pos < end; ++pos)
+    {
+        if (*pos == '\n')
+        {
+            return pos;
+        }
+    }
+    return nullptr;
+#else
+    return static_cast<const char*>(memchr(begin, '\n', size_t(end - begin)));
+#endif
+}
@@ -0,0 +1,1057 @@
+#include "inc/linestore.h"
+#include "inc/linearchive.h"
+#include "inc/compressedblocks.h"
+#include "inc/tracedictionary.h"
+#include <QDebug>
+#include <climits>
+#include <cstring>
+
+namespace
+{
+// Header of a serialized block: lines, text size, spans, timestamps, encodings
+const int BLOCK_HEADER_COUNT = 5;
+// The line numbers of the views are int, the oldest archived lines are removed beyond
+const int MAX_LINES = INT_MAX / 2;
+
+// Interned tokens: a token is a word at the start of the line with its trailing space,
+// the short words that follow it are part of it, e.g. "PRINT - "
+const int MAX_PREFIX_TOKENS = 4;
+const int MIN_TOKEN_LENGTH = 4;
+const int MAX_TOKEN_LENGTH = 64;
+// A reference is the marker, never found in UTF-8, then the index of the token
+const char TOKEN_MARKER = '\xff';
+const int TOKEN_REFERENCE_SIZE = 3;
+const int ESCAPED_MARKER = 0xffff; // A 0xff byte of the line itself
+const int MAX_TOKENS = 0xffff;
+const int SEEN_TOKEN_SLOTS = 4096;
+
+///
+/// \brief Helper function
+///        Append the values, or their differences with the previous value: the differences
+///        of growing values are small, their zero bytes compress well
+/// \param data
+/// \param values
+/// \param count
+/// \param delta
+///
+template<typename T>
+void appendValues(QByteArray& data, const T* values, int count, bool delta)
+{
+    if (!delta)
+    {
+        data.append(reinterpret_cast<const char*>(values), count * int(sizeof(T)));
+        return;
+    }
+    T previous = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        T difference = values[i] - previous;
+        previous = values[i];
+        data.append(reinterpret_cast<const char*>(&difference), int(sizeof(difference)));
+    }
+}
+
+///
+/// \brief Helper function
+/// \param position values written by appendValues(), moved after them
+/// \param values
+/// \param count
+/// \param delta
+///
+template<typename T>
+void readValues(const char*& position, T* values, int count, bool delta)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    memcpy(values, position, size_t(count) * sizeof(T));
+    position += count * int(sizeof(T));
+    for (int i = 1; delta && i < count; ++i)
+    {
+        values[i] += values[i - 1];
+    }
+}
+
+///
+/// \brief Helper function
+///        Timestamps, sequence numbers or values are mostly digits and seldom repeat
+/// \param token
+/// \param size
+/// \return true if the token is worth interning
+///
+bool isInternable(const char* token, int size)
+{
+    int digits = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        digits += token[i] >= '0' && token[i] <= '9';
+    }
+    return digits * 2 < size;
+}
+
+///
+/// \brief Helper function
+/// \param data
+/// \param size
+/// \param from start of the word
+/// \return the end of the word with its trailing space, -1 if the word ends the line
+///
+int wordEnd(const char* data, int size, int from)
+{
+    auto space = static_cast<const char*>(memchr(data + from, ' ', size_t(size - from)));
+    return space ? int(space - data) + 1 : -1;
+}
+
+///
+/// \brief Helper function
+/// \param encoded
+/// \param data text of the line, its 0xff bytes are escaped
+/// \param size
+///
+void appendLiteral(QByteArray& encoded, const char* data, int size)
+{
+    const char* end = data + size;
+    while (data < end)
+    {
+        auto marker = static_cast<const char*>(memchr(data, TOKEN_MARKER, size_t(end - data)));
+        if (!marker)
+        {
+            encoded.append(data, int(end - data));
+            return;
+        }
+        encoded.append(data, int(marker - data));
+        encoded.append(TOKEN_MARKER);
+        encoded.append(char(ESCAPED_MARKER & 0xff));
+        encoded.append(char(ESCAPED_MARKER >> 8));
+        data = marker + 1;
+    }
+}
+
+///
+/// \brief Helper function
+/// \param data binary line: the record, then the text shown before it
+/// \param size
+/// \return size of the record in the line
+///
+int recordPart(const char* data, int size)
+{
+    if (size < TraceDictionary::RECORD_HEADER_SIZE)
+    {
+        return size;
+    }
+    return qMin(size, TraceDictionary::recordSize(data));
+}
+}
+
+///
+/// \brief LineBlock::append
+/// \param data UTF-8 text of the line, without line break
+/// \param length
+/// \param lineSpans color runs of the line, sorted by start column
+/// \param spanCount
+/// \param timestamp receive time of the line, 0 if none
+/// \param encoding Binary for a record followed by the text shown before it
+///
+void LineBlock::append(const char* data, int length, const ColorSpan* lineSpans, int spanCount, qint64 timestamp,
+                       TraceLine::Encoding encoding)
+{
+    int line = size();
+    text.append(data, length);
+    offsets.append(quint32(text.size()));
+    for (int i = 0; i < spanCount; ++i)
+    {
+        spans.append(lineSpans[i]);
+    }
+    spanOffsets.append(quint32(spans.size()));
+    if (timestamp != 0 || timestamps.size() > 0)
+    {
+        // The lines before the first timestamp get 0
+        timestamps.resize(line);
+        timestamps.append(timestamp);
+    }
+    if (encoding != TraceLine::Text || encodings.size() > 0)
+    {
+        // The lines before the first binary line are text
+        encodings.resize(line);
+        encodings.append(encoding);
+    }
+}
+
+///
+/// \brief LineBlock::removeLast
+///
+void LineBlock::removeLast()
+{
+    offsets.removeLast();
+    spanOffsets.removeLast();
+    text.truncate(int(offsets.last()));
+    spans.resize(int(spanOffsets.last()));
+    if (timestamps.size() > size())
+    {
+        timestamps.resize(size());
+    }
+    if (encodings.size() > size())
+    {
+        encodings.resize(size());
+    }
+}
+
+///
+/// \brief LineBlock::lineSpans
+/// \param index index of the line in the block, must be valid
+/// \return the color runs of the line
+///
+QVector<ColorSpan> LineBlock::lineSpans(int index) const
+{
+    return spans.mid(int(spanOffsets[index]), int(spanOffsets[index + 1] - spanOffsets[index]));
+}
+
+///
+/// \brief LineBlock::squeeze
+///        Release the unused capacity of a block not growing anymore
+///
+void LineBlock::squeeze()
+{
+    text.squeeze();
+    offsets.squeeze();
+    spans.squeeze();
+    spanOffsets.squeeze();
+    encodings.squeeze();
+}
+
+///
+/// \brief LineBlock::memoryUsage
+/// \return bytes allocated for the lines of the block
+///
+qint64 LineBlock::memoryUsage() const
+{
+    return qint64(sizeof(LineBlock))
+           + text.capacity()
+           + qint64(offsets.capacity()) * qint64(sizeof(quint32))
+           + qint64(spans.capacity()) * qint64(sizeof(ColorSpan))
+           + qint64(spanOffsets.capacity()) * qint64(sizeof(quint32))
+           + timestamps.memoryUsage()
+           + qint64(encodings.capacity()) * qint64(sizeof(TraceLine::Encoding));
+}
+
+///
+/// \brief LineBlock::serialize
+/// \param delta the offsets and the timestamps are written as differences, to be compressed
+/// \return the block as written in a line archive
+///
+QByteArray LineBlock::serialize(bool delta) const
+{
+    quint32 header[BLOCK_HEADER_COUNT] = { quint32(size()), quint32(text.size()),
+                                           quint32(spans.size()), quint32(timestamps.size()),
+                                           quint32(encodings.size()) };
+    QByteArray data;
+    data.reserve(int(sizeof(header)) + 2 * offsets.size() * int(sizeof(quint32))
+                 + spans.size() * int(sizeof(ColorSpan)) + timestamps.size() * int(sizeof(qint64))
+                 + encodings.size() * int(sizeof(TraceLine::Encoding)) + text.size());
+    data.append(reinterpret_cast<const char*>(header), int(sizeof(header)));
+    appendValues(data, offsets.constData(), offsets.size(), delta);
+    appendValues(data, spanOffsets.constData(), spanOffsets.size(), delta);
+    data.append(reinterpret_cast<const char*>(spans.constData()), spans.size() * int(sizeof(ColorSpan)));
+    QVector<qint64> values(timestamps.size());
+    for (int i = 0; i < timestamps.size(); ++i)
+    {
+        values[i] = timestamps.at(i);
+    }
+    appendValues(data, values.constData(), values.size(), delta);
+    data.append(reinterpret_cast<const char*>(encodings.constData()),
+                encodings.size() * int(sizeof(TraceLine::Encoding)));
+    data.append(text);
+    return data;
+}
+
+///
+/// \brief LineBlock::deserialize
+/// \param data block written by serialize()
+/// \param delta as given to serialize()
+/// \return false if the data is not a whole block
+///
+bool LineBlock::deserialize(const QByteArray& data, bool delta)
+{
+    quint32 header[BLOCK_HEADER_COUNT];
+    if (data.size() < int(sizeof(header)))
+    {
+        return false;
+    }
+    memcpy(header, data.constData(), sizeof(header));
+    qint64 lines = header[0];
+    qint64 textSize = header[1];
+    qint64 spanCount = header[2];
+    qint64 timestampCount = header[3];
+    qint64 encodingCount = header[4];
+    qint64 expectedSize = qint64(sizeof(header)) + 2 * (lines + 1) * qint64(sizeof(quint32))
+                          + spanCount * qint64(sizeof(ColorSpan)) + timestampCount * qint64(sizeof(qint64))
+                          + encodingCount * qint64(sizeof(TraceLine::Encoding)) + textSize;
+    if (expectedSize != data.size() || timestampCount > lines || encodingCount > lines)
+    {
+        return false;
+    }
+
+    const char* position = data.constData() + sizeof(header);
+    offsets.resize(int(lines + 1));
+    readValues(position, offsets.data(), offsets.size(), delta);
+    spanOffsets.resize(int(lines + 1));
+    readValues(position, spanOffsets.data(), spanOffsets.size(), delta);
+    spans.resize(int(spanCount));
+    if (spanCount > 0)
+    {
+        memcpy(spans.data(), position, size_t(spans.size()) * sizeof(ColorSpan));
+        position += spans.size() * int(sizeof(ColorSpan));
+    }
+    QVector<qint64> values(static_cast<int>(timestampCount));
+    readValues(position, values.data(), values.size(), delta);
+    timestamps.clear();
+    for (int i = 0; i < values.size(); ++i)
+    {
+        timestamps.append(values.at(i));
+    }
+    encodings.resize(int(encodingCount));
+    if (encodingCount > 0)
+    {
+        memcpy(encodings.data(), position, size_t(encodings.size()) * sizeof(TraceLine::Encoding));
+        position += encodings.size() * int(sizeof(TraceLine::Encoding));
+    }
+    text = QByteArray(position, int(textSize));
+    return offsets.last() == quint32(textSize) && spanOffsets.last() == quint32(spanCount);
+}
+
+LineStore::LineStore()
+    : m_seenTokens(SEEN_TOKEN_SLOTS, 0)
+{
+    // Kept allocated between the lines
+    m_encoded.reserve(1024);
+}
+
+LineStore::~LineStore()
+{
+    clear();
+}
+
+///
+/// \brief LineStore::append
+/// \param data UTF-8 text of the line, without line break
+/// \param size
+/// \param spans color runs of the line, sorted by start column
+/// \param spanCount
+/// \param timestamp receive time of the line, 0 if none
+///
+void LineStore::append(const char* data, int size, const ColorSpan* spans, int spanCount, qint64 timestamp)
+{
+    LineBlock* block = growingBlock();
+    if (internTokens(data, size))
+    {
+        block->append(m_encoded.constData(), m_encoded.size(), spans, spanCount, timestamp);
+    }
+    else
+    {
+        block->append(data, size, spans, spanCount, timestamp);
+    }
+    block->decodedSize += size;
+    m_maxLineLength = qMax(m_maxLineLength, size);
+}
+
+///
+/// \brief LineStore::append
+/// \param text UTF-8 text of the line
+/// \param spans
+/// \param timestamp
+///
+void LineStore::append(const QByteArray& text, const QVector<ColorSpan>& spans, qint64 timestamp)
+{
+    append(text.constData(), text.size(), spans.constData(), spans.size(), timestamp);
+}
+
+///
+/// \brief LineStore::append
+/// \param text
+/// \param spans
+/// \param timestamp
+///
+void LineStore::append(const QString& text, const QVector<ColorSpan>& spans, qint64 timestamp)
+{
+    append(text.toUtf8(), spans, timestamp);
+}
+
+///
+/// \brief LineStore::append
+/// \param lines lines built apart, e.g. by a loader
+///
+void LineStore::append(const LineBlock& lines)
+{
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        if (lines.encoding(i) == TraceLine::Binary)
+        {
+            appendBinary(lines.text.constData() + lines.offsets[i], int(lines.offsets[i + 1] - lines.offsets[i]),
+                         lines.timestamp(i));
+            continue;
+        }
+        int spanStart = int(lines.spanOffsets[i]);
+        append(lines.text.constData() + lines.offsets[i], int(lines.offsets[i + 1] - lines.offsets[i]),
+               lines.spans.constData() + spanStart, int(lines.spanOffsets[i + 1]) - spanStart, lines.timestamp(i));
+    }
+}
+
+///
+/// \brief LineStore::appendRecord
+///        The record is kept as received, it is formatted by TraceDictionary when the
+///        line is read
+/// \param record binary record
+/// \param size
+/// \param tag UTF-8 text shown before the record, e.g. the endpoint name
+/// \param timestamp receive time of the line, 0 if none
+///
+void LineStore::appendRecord(const char* record, int size, const QByteArray& tag, qint64 timestamp)
+{
+    m_encoded.clear();
+    m_encoded.append(record, size);
+    m_encoded.append(tag);
+    appendBinary(m_encoded.constData(), m_encoded.size(), timestamp);
+}
+
+///
+/// \brief LineStore::growingBlock
+///        Start a block when the last one is full
+/// \return the block the next line is appended to
+///
+LineBlock* LineStore::growingBlock()
+{
+    if (m_blocks.isEmpty() || m_blocks.last()->size() == BLOCK_LINES)
+    {
+        if (!m_blocks.isEmpty())
+        {
+            // The block is full, it does not grow anymore
+            m_blocks.last()->squeeze();
+            m_fullBlocksMemory += m_blocks.last()->memoryUsage();
+        }
+        m_blocks.append(new LineBlock);
+        compressOldBlocks();
+        applyRetention();
+    }
+    return m_blocks.last();
+}
+
+///
+/// \brief LineStore::appendBinary
+///        The length of the formatted line is estimated, the record is not formatted
+/// \param data binary line: the record, then the text shown before it
+/// \param size
+/// \param timestamp receive time of the line, 0 if none
+///
+void LineStore::appendBinary(const char* data, int size, qint64 timestamp)
+{
+    LineBlock* block = growingBlock();
+    block->append(data, size, nullptr, 0, timestamp, TraceLine::Binary);
+    int record = recordPart(data, size);
+    int length = size - record + TraceDictionary::instance().lengthHint(data, record);
+    block->decodedSize += length;
+    m_maxLineLength = qMax(m_maxLineLength, length);
+}
+
+///
+/// \brief LineStore::removeFirst
+/// \param count number of lines removed from the start, on disk first
+///
+void LineStore::removeFirst(int count)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    if (count >= size() && (!m_file || m_file->isIndexed()))
+    {
+        clear();
+        return;
+    }
+
+    int fileRemoved = qMin(count, fileLines());
+    m_fileFirst += fileRemoved;
+    count -= fileRemoved;
+    int archived = qMin(count, m_archivedLines);
+    if (archived > 0)
+    {
+        m_archive->removeFirst(archived);
+        m_archivedLines -= archived;
+        count -= archived;
+    }
+    int compressed = qMin(count, m_compressedLines);
+    if (compressed > 0)
+    {
+        m_compressed->removeFirst(compressed);
+        m_compressedLines -= compressed;
+        count -= compressed;
+    }
+    m_first += count;
+    while (!m_blocks.isEmpty() && m_first >= m_blocks.first()->size())
+    {
+        int removed = m_first - m_blocks.first()->size();
+        releaseFirstBlock();
+        m_first = removed;
+    }
+}
+
+///
+/// \brief LineStore::removeLast
+///        Only the lines in memory can be removed from the end
+///
+void LineStore::removeLast()
+{
+    if (memoryLines() == 0)
+    {
+        return;
+    }
+    int index;
+    auto block = blockAt(size() - 1, index);
+    int decodedSize;
+    if (block->encoding(index) == TraceLine::Binary)
+    {
+        // As counted by appendBinary()
+        const char* data = block->text.constData() + block->offsets[index];
+        int length = int(block->offsets[index + 1] - block->offsets[index]);
+        int record = recordPart(data, length);
+        decodedSize = length - record + TraceDictionary::instance().lengthHint(data, record);
+    }
+    else
+    {
+        decodedSize = lineData(size() - 1).size();
+    }
+    if (m_blocks.last()->size() == 0)
+    {
+        // The previous block was full, it grows again
+        delete m_blocks.takeLast();
+        m_fullBlocksMemory -= m_blocks.last()->memoryUsage();
+    }
+    m_blocks.last()->decodedSize -= decodedSize;
+    m_blocks.last()->removeLast();
+    if (m_blocks.size() == 1 && m_blocks.last()->size() == m_first)
+    {
+        releaseFirstBlock();
+    }
+}
+
+///
+/// \brief LineStore::clear
+///        Remove all the lines and the interned tokens, the retention is kept
+///
+void LineStore::clear()
+{
+    delete m_file; // Stops the indexing
+    m_file = nullptr;
+    m_fileFirst = 0;
+    qDeleteAll(m_blocks);
+    m_blocks.clear();
+    m_first = 0;
+    m_maxLineLength = 0;
+    m_fullBlocksMemory = 0;
+    delete m_archive; // Removes the segment files
+    m_archive = nullptr;
+    m_archivedLines = 0;
+    m_droppedLines = 0;
+    delete m_compressed; // Waits for the compressions going on
+    m_compressed = nullptr;
+    m_compressedLines = 0;
+    m_tokens.clear();
+    m_tokenIds.clear();
+    m_tokenBytes = 0;
+    m_seenTokens.fill(0);
+}
+
+///
+/// \brief LineStore::setFile
+///        Show the lines of a file, they are read from it when needed
+/// \param file opened file, owned by the store
+///
+void LineStore::setFile(MappedTraceFile* file)
+{
+    clear();
+    m_file = file;
+}
+
+///
+/// \brief LineStore::setRetention
+///        Applied from the next block
+/// \param maxLines lines kept in memory, 0 for no limit
+/// \param maxMemory bytes of the lines kept in memory, 0 for no limit
+/// \param spillToDisk the lines beyond are written to disk if true, else dropped
+/// \param maxDiskUsage bytes of the lines on disk, the oldest are dropped beyond, 0 for no limit
+///
+void LineStore::setRetention(int maxLines, qint64 maxMemory, bool spillToDisk, qint64 maxDiskUsage)
+{
+    m_maxLines = maxLines;
+    m_maxMemory = maxMemory;
+    m_spillToDisk = spillToDisk;
+    m_maxDiskUsage = maxDiskUsage;
+    if (m_archive)
+    {
+        m_archive->setMaxDiskUsage(maxDiskUsage);
+    }
+}
+
+///
+/// \brief LineStore::setCompression
+///        Applied from the next block
+/// \param compress the blocks beyond the last HOT_BLOCKS are compressed if true
+///
+void LineStore::setCompression(bool compress)
+{
+    m_compress = compress;
+}
+
+///
+/// \brief LineStore::takeDroppedLines
+///        The retention drops the lines from the start, the view has to move the lines
+///        it refers to accordingly
+/// \return number of lines dropped since the last call
+///
+int LineStore::takeDroppedLines()
+{
+    int dropped = m_droppedLines;
+    m_droppedLines = 0;
+    return dropped;
+}
+
+///
+/// \brief LineStore::compressOldBlocks
+///        Hand the full blocks beyond the last HOT_BLOCKS to the compressed blocks
+///
+void LineStore::compressOldBlocks()
+{
+    if (m_compressed)
+    {
+        m_compressed->collect();
+    }
+    if (!m_compress)
+    {
+        return;
+    }
+    while (m_blocks.size() > HOT_BLOCKS)
+    {
+        if (!m_compressed)
+        {
+            m_compressed = new CompressedBlocks;
+        }
+        LineBlock* block = m_blocks.takeFirst();
+        m_fullBlocksMemory -= block->memoryUsage();
+        m_compressedLines += block->size() - m_first;
+        m_compressed->append(block, m_first);
+        m_first = 0;
+    }
+}
+
+///
+/// \brief LineStore::applyRetention
+///        Move the oldest full blocks out of the memory until the store is in its budget,
+///        the compressed ones first
+///
+void LineStore::applyRetention()
+{
+    while ((m_maxLines > 0 && m_compressedLines + memoryLines() > m_maxLines) ||
+           (m_maxMemory > 0 && retainedMemory() > m_maxMemory))
+    {
+        bool compressed = m_compressedLines > 0;
+        if (!compressed && m_blocks.size() <= 1)
+        {
+            break;
+        }
+        if (m_spillToDisk && !m_archive)
+        {
+            m_archive = new LineArchive;
+            m_archive->setMaxDiskUsage(m_maxDiskUsage);
+        }
+        bool spill = m_spillToDisk && m_archive->isValid();
+
+        LineBlock* block = nullptr;
+        int skip = 0;
+        int lines;
+        if (compressed && !spill)
+        {
+            // Dropped as is, without decompressing it
+            lines = m_compressed->dropFirst();
+            m_compressedLines -= lines;
+        }
+        else if (compressed)
+        {
+            block = m_compressed->takeFirst(skip, lines);
+            m_compressedLines -= lines;
+        }
+        else
+        {
+            block = m_blocks.first();
+            skip = m_first;
+            lines = block->size() - m_first;
+        }
+
+        int removed = -1;
+        if (block && spill)
+        {
+            removed = m_archive->append(*block, skip);
+        }
+        if (removed >= 0)
+        {
+            m_archivedLines += lines - removed;
+            m_droppedLines += removed;
+        }
+        else
+        {
+            // Lines are only dropped from the start, the archived ones go with the block
+            if (m_archive)
+            {
+                m_archive->removeFirst(m_archivedLines);
+            }
+            m_droppedLines += m_archivedLines + lines;
+            m_archivedLines = 0;
+        }
+
+        if (compressed)
+        {
+            delete block;
+        }
+        else
+        {
+            releaseFirstBlock();
+        }
+    }
+
+    if (m_archivedLines > 0 && size() > MAX_LINES)
+    {
+        int removed = qMin(m_archivedLines, size() - MAX_LINES);
+        m_archive->removeFirst(removed);
+        m_archivedLines -= removed;
+        m_droppedLines += removed;
+    }
+}
+
+///
+/// \brief LineStore::retainedMemory
+/// \return bytes of the full blocks and the compressed blocks, the subject of the retention
+///
+qint64 LineStore::retainedMemory() const
+{
+    return m_compressed ? m_fullBlocksMemory + m_compressed->memoryUsage() : m_fullBlocksMemory;
+}
+
+///
+/// \brief LineStore::releaseFirstBlock
+///
+void LineStore::releaseFirstBlock()
+{
+    LineBlock* block = m_blocks.takeFirst();
+    if (!m_blocks.isEmpty())
+    {
+        // Only the full blocks are counted
+        m_fullBlocksMemory -= block->memoryUsage();
+    }
+    delete block;
+    m_first = 0;
+}
+
+///
+/// \brief LineStore::internTokens
+///        Replace the tokens at the start of the line by references to the dictionary.
+///        A token is interned the second time it is seen, the tokens that seldom repeat
+///        are replaced by the next candidates of their slot and never fill the dictionary.
+/// \param data UTF-8 text of the line
+/// \param size
+/// \return true if the line is encoded in m_encoded, false if it is stored as is
+///
+bool LineStore::internTokens(const char* data, int size)
+{
+    bool hasMarker = memchr(data, TOKEN_MARKER, size_t(size)) != nullptr;
+    bool interned = false;
+    m_encoded.resize(0);
+    int literalStart = 0;
+    int position = 0;
+    for (int token = 0; token < MAX_PREFIX_TOKENS && position < size; ++token)
+    {
+        // The last word is not a prefix
+        int end = wordEnd(data, size, position);
+        if (end < 0)
+        {
+            break;
+        }
+        // A short word that follows, such as a separator, ends the token instead of starting the next
+        while (end < size)
+        {
+            int next = wordEnd(data, size, end);
+            if (next < 0 || next - end >= MIN_TOKEN_LENGTH)
+            {
+                break;
+            }
+            end = next;
+        }
+        if (end - position > MAX_TOKEN_LENGTH)
+        {
+            break;
+        }
+
+        int id = isInternable(data + position, end - position) ? tokenId(data + position, end - position) : -1;
+        if (id >= 0)
+        {
+            appendLiteral(m_encoded, data + literalStart, position - literalStart);
+            m_encoded.append(TOKEN_MARKER);
+            m_encoded.append(char(id & 0xff));
+            m_encoded.append(char(id >> 8));
+            literalStart = end;
+            interned = true;
+        }
+        position = end;
+    }
+
+    if (!interned && !hasMarker)
+    {
+        return false;
+    }
+    appendLiteral(m_encoded, data + literalStart, size - literalStart);
+    return true;
+}
+
+///
+/// \brief LineStore::tokenId
+/// \param token
+/// \param size
+/// \return the index of the token in the dictionary, -1 if it is not interned
+///
+int LineStore::tokenId(const char* token, int size)
+{
+    if (size <= TOKEN_REFERENCE_SIZE)
+    {
+        return -1;
+    }
+    QByteArray key = QByteArray::fromRawData(token, size);
+    auto it = m_tokenIds.constFind(key);
+    if (it != m_tokenIds.constEnd())
+    {
+        return it.value();
+    }
+
+    uint hash = qHash(key);
+    uint& seen = m_seenTokens[int(hash % SEEN_TOKEN_SLOTS)];
+    if (seen != hash || m_tokens.size() >= MAX_TOKENS)
+    {
+        seen = hash;
+        return -1;
+    }
+    int id = m_tokens.size();
+    QByteArray interned(token, size); // Deep copy of the line
+    m_tokens.append(interned);
+    m_tokenIds.insert(interned, id);
+    m_tokenBytes += size;
+    return id;
+}
+
+///
+/// \brief LineStore::expandTokens
+/// \param data text of a line in a block
+/// \param size
+/// \return the UTF-8 text of the line
+///
+QByteArray LineStore::expandTokens(const char* data, int size) const
+{
+    auto marker = static_cast<const char*>(memchr(data, TOKEN_MARKER, size_t(size)));
+    if (!marker)
+    {
+        return QByteArray(data, size);
+    }
+
+    QByteArray text;
+    text.reserve(size + MAX_PREFIX_TOKENS * MAX_TOKEN_LENGTH);
+    const char* end = data + size;
+    while (marker && marker + TOKEN_REFERENCE_SIZE <= end)
+    {
+        text.append(data, int(marker - data));
+        int id = static_cast<uchar>(marker[1]) | static_cast<uchar>(marker[2]) << 8;
+        if (id == ESCAPED_MARKER)
+        {
+            text.append(TOKEN_MARKER);
+        }
+        else if (id < m_tokens.size())
+        {
+            text.append(m_tokens.at(id));
+        }
+        data = marker + TOKEN_REFERENCE_SIZE;
+        marker = static_cast<const char*>(memchr(data, TOKEN_MARKER, size_t(end - data)));
+    }
+    text.append(data, int(end - data));
+    return text;
+}
+
+///
+/// \brief LineStore::dictionarySize
+/// \return bytes allocated for the interned tokens
+///
+qint64 LineStore::dictionarySize() const
+{
+    // Every token is shared by the list and the hash, with the header of its data
+    const qint64 tokenOverhead = qint64(sizeof(QByteArray)) * 2 + 32;
+    return m_tokenBytes + m_tokens.size() * tokenOverhead
+           + qint64(m_seenTokens.size()) * qint64(sizeof(uint)) + m_encoded.capacity();
+}
+
+///
+/// \brief LineStore::blockAt
+/// \param line line index, after the lines of the file, must be valid
+/// \param index set to the index of the line in the block
+/// \return the block of the line, read back from disk if archived or decompressed, nullptr if it cannot be read
+///
+const LineBlock* LineStore::blockAt(int line, int& index) const
+{
+    line -= fileLines();
+    if (line < m_archivedLines)
+    {
+        return m_archive->blockAt(line, index);
+    }
+    line -= m_archivedLines;
+    if (line < m_compressedLines)
+    {
+        return m_compressed->blockAt(line, index);
+    }
+    int number = line - m_compressedLines + m_first;
+    index = number % BLOCK_LINES;
+    return m_blocks[number / BLOCK_LINES];
+}
+
+///
+/// \brief LineStore::lineData
+/// \param line line index, must be valid
+/// \return the UTF-8 text of the line
+///
+QByteArray LineStore::lineData(int line) const
+{
+    if (line < fileLines())
+    {
+        return m_file->lineData(m_fileFirst + line);
+    }
+    int index;
+    auto block = blockAt(line, index);
+    if (!block)
+    {
+        return QByteArray();
+    }
+    const char* data = block->text.constData() + block->offsets[index];
+    int size = int(block->offsets[index + 1] - block->offsets[index]);
+    if (block->encoding(index) == TraceLine::Binary)
+    {
+        int record = recordPart(data, size);
+        return QByteArray(data + record, size - record)
+               + TraceDictionary::instance().format(QByteArray::fromRawData(data, record)).toUtf8();
+    }
+    return expandTokens(data, size);
+}
+
+///
+/// \brief LineStore::line
+/// \param line line index, must be valid
+/// \return the decoded text of the line
+///
+QString LineStore::line(int line) const
+{
+    return QString::fromUtf8(lineData(line));
+}
+
+///
+/// \brief LineStore::spans
+/// \param line line index, must be valid
+/// \return the color runs of the line, empty for a line in the default color
+///
+QVector<ColorSpan> LineStore::spans(int line) const
+{
+    if (line < fileLines())
+    {
+        return QVector<ColorSpan>();
+    }
+    int index;
+    auto block = blockAt(line, index);
+    return block ? block->lineSpans(index) : QVector<ColorSpan>();
+}
+
+///
+/// \brief LineStore::timestamp
+/// \param line line index, must be valid
+/// \return the receive time of the line, 0 if none
+///
+qint64 LineStore::timestamp(int line) const
+{
+    if (line < fileLines())
+    {
+        return 0;
+    }
+    int index;
+    auto block = blockAt(line, index);
+    return block ? block->timestamp(index) : 0;
+}
+
+///
+/// \brief LineStore::memoryUsage
+/// \return bytes allocated for the lines in memory and the index of the lines on disk
+///
+qint64 LineStore::memoryUsage() const
+{
+    qint64 usage = m_fullBlocksMemory + qint64(m_blocks.capacity()) * qint64(sizeof(LineBlock*));
+    if (m_file)
+    {
+        usage += m_file->memoryUsage();
+    }
+    if (!m_blocks.isEmpty())
+    {
+        usage += m_blocks.last()->memoryUsage();
+    }
+    if (m_archive)
+    {
+        usage += m_archive->memoryUsage();
+    }
+    if (m_compressed)
+    {
+        usage += m_compressed->memoryUsage();
+    }
+    return usage + dictionarySize();
+}
+
+///
+/// \brief LineStore::linesOnDisk
+/// \return
+///
+int LineStore::linesOnDisk() const
+{
+    return m_archivedLines;
+}
+
+///
+/// \brief LineStore::diskUsage
+/// \return bytes of the segment files
+///
+qint64 LineStore::diskUsage() const
+{
+    return m_archive ? m_archive->diskUsage() : 0;
+}
+
+///
+/// \brief LineStore::memoryReport
+/// \return the memory used by the lines, and the part saved by the interned tokens
+///
+LineStore::MemoryReport LineStore::memoryReport() const
+{
+    MemoryReport report;
+    report.lines = size();
+    report.linesOnDisk = linesOnDisk();
+    report.memoryUsage = memoryUsage();
+    report.diskUsage = diskUsage();
+    for (auto block : m_blocks)
+    {
+        report.textSize += block->text.size();
+        report.decodedTextSize += block->decodedSize;
+    }
+    if (m_compressed)
+    {
+        report.compressedLines = m_compressedLines;
+        report.compressedSize = m_compressed->compressedSize();
+        report.uncompressedSize = m_compressed->uncompressedSize();
+    }
+    report.tokens = m_tokens.size();
+    report.dictionarySize = dictionarySize();
+    return report;
+}
@@ -1,17 +1,80 @@
 #include "inc/livetraceview.h"
 #include "inc/mainwindow.h"
 #include "inc/constants.h"
+#include "inc/ingestendpoint.h"
+#include "inc/tracedictionary.h"
+#include "inc/traceclock.h"
+#include "inc/tracereplayer.h"
 #include <QSettings>
+#include <QElapsedTimer>
 #include <QtWidgets>
 
+namespace
+{
+const int GUTTER_PADDING = 4;
+// Without any new line for that long, the rest of the replay is considered dropped
+const int REPLAY_DRAIN_TIMEOUT = 1000;
+}
+
+///
+/// \brief The TimestampGutter class is the margin on the left of the live view,
+///        painted by the view with the timestamps of the visible lines
+///
+class TimestampGutter : public QWidget
+{
+public:
+    explicit TimestampGutter(LiveTraceView* view)
+        : QWidget(view)
+        , m_view(view)
+    {
+    }
+
+protected:
+    void paintEvent(QPaintEvent* event) override
+    {
+        m_view->paintTimestamps(event);
+    }
+
+private:
+    LiveTraceView* m_view;
+};
+
 LiveTraceView::LiveTraceView()
 {
     QSettings settings(Config::CONFIG_DIR, QSettings::IniFormat);
     m_remoteAddress = settings.value(Config::REMOTE_ADDRESS, QString("192.168.137.1")).toString();
     m_autoScroll = settings.value(Config::TRACEVIEW_AUTOSCROLL, true).toBool();
+    m_showTimestamps = settings.value(Config::TRACEVIEW_TIMESTAMPS, false).toBool();
+    m_endpoints = settings.value(Config::ENDPOINTS, QStringList()).toStringList();
+#ifdef Q_OS_WIN
+    m_serialPortName = settings.value(Config::SERIAL_PORT, QString("COM1")).toString();
+#else
+    m_serialPortName = settings.value(Config::SERIAL_PORT, QString("/dev/ttyUSB0")).toString();
+#endif
+    m_serialBaudRate = settings.value(Config::SERIAL_BAUD_RATE, 115200).toInt();
+    // Beyond the retention, the oldest lines are moved to disk or dropped
+    m_lines.setRetention(settings.value(Config::RETENTION_MAX_LINES, 0).toInt(),
+                         settings.value(Config::RETENTION_MAX_MEMORY, 1024).toLongLong() * 1024 * 1024,
+                         settings.value(Config::RETENTION_SPILL, true).toBool(),
+                         settings.value(Config::RETENTION_MAX_DISK, 10240).toLongLong() * 1024 * 1024);
+    m_lines.setCompression(settings.value(Config::RETENTION_COMPRESS, true).toBool());
 
     createTraceActions();
     createNetworkActions();
+
+    m_timestampGutter = new TimestampGutter(this);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, m_timestampGutter, [=](){
+        m_timestampGutter->update();
+    });
+    connect(this, &TraceView::linesChanged, m_timestampGutter, [=](){
+        m_timestampGutter->update();
+    });
+    updateTimestampGutter();
+
+    m_replayDrainTimer = new QTimer(this);
+    m_replayDrainTimer->setSingleShot(true);
+    m_replayDrainTimer->setInterval(REPLAY_DRAIN_TIMEOUT);
+    connect(m_replayDrainTimer, &QTimer::timeout, this, &LiveTraceView::reportReplay);
 }
 
 ///
@@ -24,6 +87,10 @@ void LiveTraceView::createTraceActions()
     m_setAutoScrollAct->setEnabled(true);
     m_setAutoScrollAct->setIconVisibleInMenu(m_autoScroll);
     connect(m_setAutoScrollAct, &QAction::triggered, this, &LiveTraceView::toggleAutoScroll);
+
+    m_showTimestampsAct->setEnabled(true);
+    m_showTimestampsAct->setIconVisibleInMenu(m_showTimestamps);
+    connect(m_showTimestampsAct, &QAction::triggered, this, &LiveTraceView::toggleTimestamps);
 }
 
 ///
@@ -63,6 +130,29 @@ void LiveTraceView::createNetworkActions()
     m_setPortAct->setText(QString("Configure Port - [%1]")
                               .arg(QString::number(m_currentPort)));
     connect(m_setPortAct, &QAction::triggered, this, &LiveTraceView::changePort);
+
+    m_setSerialPortAct->setEnabled(true);
+    updateSerialPortAction();
+    connect(m_setSerialPortAct, &QAction::triggered, this, &LiveTraceView::promptAndSetSerialPort);
+
+    m_setEndpointsAct->setEnabled(true);
+    connect(m_setEndpointsAct, &QAction::triggered, this, &LiveTraceView::promptAndSetEndpoints);
+
+    m_loadDictionaryAct->setEnabled(true);
+    connect(m_loadDictionaryAct, &QAction::triggered, this, &LiveTraceView::promptAndLoadDictionary);
+
+    m_replayAct->setEnabled(true);
+    connect(m_replayAct, &QAction::triggered, this, &LiveTraceView::promptAndReplay);
+}
+
+///
+/// \brief LiveTraceView::updateSerialPortAction
+///        Display current serial port right in the action. Eg.: Configure Serial Port... - [COM3@3000000]
+///
+void LiveTraceView::updateSerialPortAction()
+{
+    m_setSerialPortAct->setText(QString("Configure Serial Port... - [%1@%2]")
+                                    .arg(m_serialPortName, QString::number(m_serialBaudRate)));
 }
 
 ///
@@ -101,6 +191,205 @@ void LiveTraceView::promptAndSetRemoteInterface()
     }
 }
 
+///
+/// \brief LiveTraceView::promptAndSetEndpoints
+///
+void LiveTraceView::promptAndSetEndpoints()
+{
+    bool ok;
+    auto text = QInputDialog::getMultiLineText(this, "Set Additional Endpoints",
+                                               "One endpoint per line:\n"
+                                               "udp:<address>:<port>\n"
+                                               "serial:<port name>[@<baud rate>]\n"
+                                               "tcp:<address>:<port>\n"
+                                               "unix:<socket path>",
+                                               m_endpoints.join("\n"), &ok,
+                                               Qt::WindowSystemMenuHint | Qt::WindowCloseButtonHint);
+    if (!ok)
+    {
+        return;
+    }
+
+    QStringList endpoints;
+    foreach (const auto& line, text.split("\n"))
+    {
+        if (!line.trimmed().isEmpty())
+        {
+            endpoints.append(line.trimmed());
+        }
+    }
+    m_endpoints = endpoints;
+    emit endpointsChangeRequested(endpoints);
+}
+
+///
+/// \brief LiveTraceView::promptAndSetSerialPort
+///
+void LiveTraceView::promptAndSetSerialPort()
+{
+    bool ok;
+    auto text = QInputDialog::getText(this, "Set Serial Port",
+                                      "Port name[@baud rate], e.g. COM3@3000000 or /dev/ttyACM0@12000000:",
+                                      QLineEdit::Normal,
+                                      QString("%1@%2").arg(m_serialPortName, QString::number(m_serialBaudRate)),
+                                      &ok, Qt::WindowSystemMenuHint | Qt::WindowCloseButtonHint);
+    if (!ok || text.trimmed().isEmpty())
+    {
+        return;
+    }
+
+    // Same syntax as the serial additional endpoints
+    auto config = IngestEndpoint::fromString("serial:" + text.trimmed());
+    if (!config.isValid())
+    {
+        QMessageBox::warning(this, "Set Serial Port", QString("Invalid serial port \"%1\"").arg(text));
+        return;
+    }
+    m_serialPortName = config.address;
+    m_serialBaudRate = config.baudRate;
+    updateSerialPortAction();
+    emit serialPortChangeRequested(m_serialPortName, m_serialBaudRate);
+}
+
+///
+/// \brief LiveTraceView::promptAndLoadDictionary
+///        The binary traces received from now on are formatted with the new dictionary
+///
+void LiveTraceView::promptAndLoadDictionary()
+{
+    auto& dictionary = TraceDictionary::instance();
+    QString path = QFileDialog::getOpenFileName(this, "TraceTerminal++ - Load trace dictionary",
+                                                dictionary.path(), "Trace dictionary (*.txt *.dict);;All files (*)");
+    if (path.isEmpty())
+    {
+        return;
+    }
+
+    QString errorString;
+    if (dictionary.load(path, errorString))
+    {
+        appendMessage(QString(">Trace dictionary %1 loaded, %2 messages")
+                          .arg(path, QString::number(dictionary.size())), Qt::black);
+    }
+    else
+    {
+        appendMessage(QString(">Load trace dictionary %1 failed: %2").arg(path, errorString), Qt::red);
+    }
+}
+
+///
+/// \brief LiveTraceView::promptAndReplay
+///        The replayed traces go through the same path as the received ones, the
+///        throughput and the latency are reported once they are all displayed
+///
+void LiveTraceView::promptAndReplay()
+{
+    if (m_replay.active)
+    {
+        QMessageBox::information(this, "Replay Trace File", QString("%1 is still being replayed").arg(m_replay.path));
+        return;
+    }
+    QString path = QFileDialog::getOpenFileName(this, "TraceTerminal++ - Replay trace file",
+                                                QString(), "Plain text (*.txt *.log);;All files (*)");
+    if (path.isEmpty())
+    {
+        return;
+    }
+
+    const QList<QPair<QString, double>> speeds = {
+        { "As fast as possible",     TraceReplayer::AS_FAST_AS_POSSIBLE },
+        { "Original speed",          1 },
+        { "2x",                      2 },
+        { "10x",                     10 },
+        { "100x",                    100 },
+    };
+    QStringList items;
+    for (const auto& speed : speeds)
+    {
+        items << speed.first;
+    }
+    bool ok;
+    QString item = QInputDialog::getItem(this, "Replay Trace File",
+                                         "Speed, the original pace needs a file saved with the timestamps shown:",
+                                         items, 0, false, &ok,
+                                         Qt::WindowSystemMenuHint | Qt::WindowCloseButtonHint);
+    if (!ok)
+    {
+        return;
+    }
+    double speed = speeds[items.indexOf(item)].second;
+
+    m_replay = ReplayStats();
+    m_replay.active = true;
+    m_replay.path = path;
+    m_replay.elapsed.start();
+    appendMessage(QString(">Replaying %1 (%2)...").arg(path, item), Qt::black);
+    emit replayRequested(path, speed);
+}
+
+///
+/// \brief LiveTraceView::onReplayFinished
+///        The whole file is read, the report waits for its last lines to be displayed
+/// \param path
+/// \param lines number of replayed lines
+/// \param elapsedNs time spent on reading the file
+/// \param errorString empty if the whole file is replayed
+///
+void LiveTraceView::onReplayFinished(QString path, quint64 lines, qint64 elapsedNs, QString errorString)
+{
+    if (!errorString.isEmpty())
+    {
+        appendMessage(QString(">Replay of %1 failed: %2").arg(path, errorString), Qt::red);
+        if (m_replay.path == path)
+        {
+            m_replay.active = false;
+        }
+        return;
+    }
+
+    m_replay.readDone = true;
+    m_replay.readLines = lines;
+    m_replay.readNs = elapsedNs;
+    if (m_replay.displayedLines >= m_replay.readLines)
+    {
+        reportReplay();
+    }
+    else
+    {
+        m_replayDrainTimer->start();
+    }
+}
+
+///
+/// \brief LiveTraceView::reportReplay
+///        Sustained throughput, from the start of the replay to the display of its last
+///        line, and latency from the reception of the lines to their display
+///
+void LiveTraceView::reportReplay()
+{
+    if (!m_replay.active)
+    {
+        return;
+    }
+    m_replay.active = false;
+    m_replayDrainTimer->stop();
+
+    double readSeconds = qMax<qint64>(m_replay.readNs, 1) / 1e9;
+    double displaySeconds = qMax<qint64>(m_replay.displayedNs, 1) / 1e9;
+    QString msg = QString(">Replay of %1 done: %2 lines read in %3 s (%4 lines/s), "
+                          "%5 lines displayed in %6 s (%7 lines/s), latency avg %8 ms, max %9 ms")
+                      .arg(m_replay.path)
+                      .arg(m_replay.readLines)
+                      .arg(readSeconds, 0, 'f', 3)
+                      .arg(qRound64(m_replay.readLines / readSeconds))
+                      .arg(m_replay.displayedLines)
+                      .arg(displaySeconds, 0, 'f', 3)
+                      .arg(qRound64(m_replay.displayedLines / displaySeconds))
+                      .arg(m_replay.batches ? m_replay.latencySumNs / m_replay.batches / 1e6 : 0.0, 0, 'f', 1)
+                      .arg(m_replay.latencyMaxNs / 1e6, 0, 'f', 1);
+    appendMessage(msg, Qt::black);
+}
+
 ///
 /// \brief TraceView::setPort
 ///
@@ -126,21 +415,164 @@ void LiveTraceView::toggleAutoScroll()
     m_setAutoScrollAct->setIconVisibleInMenu(m_autoScroll);
 }
 
+///
+/// \brief LiveTraceView::toggleTimestamps
+///
+void LiveTraceView::toggleTimestamps()
+{
+    m_showTimestamps = !m_showTimestamps;
+    m_showTimestampsAct->setIconVisibleInMenu(m_showTimestamps);
+    updateTimestampGutter();
+}
+
+///
+/// \brief LiveTraceView::clear
+///
+void LiveTraceView::clear()
+{
+    TraceView::clear();
+    m_timeOrigin = 0;
+}
+
+///
+/// \brief LiveTraceView::timestampGutterWidth
+/// \return width for 5 digits of seconds and the microseconds
+///
+int LiveTraceView::timestampGutterWidth() const
+{
+    return fontMetrics().horizontalAdvance(QStringLiteral("00000.000000")) + 2 * GUTTER_PADDING;
+}
+
+///
+/// \brief LiveTraceView::updateTimestampGutter
+///        Show or hide the gutter, and fit it to the viewport
+///
+void LiveTraceView::updateTimestampGutter()
+{
+    int width = m_showTimestamps ? timestampGutterWidth() : 0;
+    setViewportMargins(width, 0, 0, 0);
+    QRect rect = contentsRect();
+    m_timestampGutter->setGeometry(QRect(rect.left(), rect.top(), width, rect.height()));
+    m_timestampGutter->setVisible(m_showTimestamps);
+}
+
+///
+/// \brief LiveTraceView::resizeEvent override
+/// \param event
+///
+void LiveTraceView::resizeEvent(QResizeEvent* event)
+{
+    TraceView::resizeEvent(event);
+    updateTimestampGutter();
+}
+
+///
+/// \brief LiveTraceView::formatTimestamp
+/// \param timestamp
+/// \return seconds since the first trace, with the microseconds
+///
+QString LiveTraceView::formatTimestamp(qint64 timestamp) const
+{
+    return QString::number(double(timestamp - m_timeOrigin) / 1e9, 'f', 6);
+}
+
+///
+/// \brief LiveTraceView::writePlainText
+///        With the timestamps shown, every line is saved as "<seconds>\t<trace>",
+///        the format the replay paces the lines with
+/// \param out stream of the saved plain text file
+///
+void LiveTraceView::writePlainText(QTextStream& out)
+{
+    if (!m_showTimestamps)
+    {
+        TraceView::writePlainText(out);
+        return;
+    }
+    for (int line = 0; line < lineCount(); ++line)
+    {
+        qint64 timestamp = m_lines.timestamp(line);
+        if (timestamp != 0)
+        {
+            out << formatTimestamp(timestamp);
+        }
+        out << '\t' << lineText(line) << '\n';
+    }
+}
+
+///
+/// \brief LiveTraceView::paintTimestamps
+///        Paint the timestamps of the visible lines, in seconds since the first trace
+/// \param event paint event of the gutter
+///
+void LiveTraceView::paintTimestamps(QPaintEvent* event)
+{
+    QPainter painter(m_timestampGutter);
+    painter.fillRect(event->rect(), palette().window());
+    painter.setPen(Qt::darkGray);
+
+    int first = verticalScrollBar()->value();
+    int textWidth = m_timestampGutter->width() - GUTTER_PADDING;
+    int lastLine = qMin(lineCount() - 1, lineAt(event->rect().bottom()));
+    for (int line = lineAt(event->rect().top()); line <= lastLine; ++line)
+    {
+        qint64 timestamp = m_lines.timestamp(line);
+        if (timestamp != 0)
+        {
+            painter.drawText(QRect(0, (line - first) * lineHeight(), textWidth, lineHeight()),
+                             Qt::AlignRight | Qt::AlignTop, formatTimestamp(timestamp));
+        }
+    }
+}
+
 ///
 /// \brief TraceView::onNewTracesReady
 /// \param traces
 ///
-void LiveTraceView::onNewTracesReady(QStringList traces)
+void LiveTraceView::onNewTracesReady(TraceLines traces)
 {
     //qDebug() << traces;
-    foreach (auto& trace, traces)
+    QElapsedTimer renderTimer;
+    renderTimer.start();
+    qint64 oldestTimestamp = 0;
+    qint64 oldestReplayed = 0;
+    quint64 replayedLines = 0;
+    foreach (const auto& trace, traces)
     {
-        // Append line by line help us using blockNumber() to get the line number when searching
-        append(trace);
-
-        if (m_autoScroll)
+        bool replayed = trace.sourceId == TraceReplayer::SOURCE_ID;
+        bool tagged = trace.sourceId != 0 && !replayed;
+        // Lines of additional endpoints are tagged with the endpoint name
+        QByteArray tag = tagged ? '[' + m_sourceNames.value(trace.sourceId).toUtf8() + "] " : QByteArray();
+        if (trace.encoding == TraceLine::Binary)
+        {
+            // The records are stored as received, they are formatted when shown
+            appendRecord(trace.data(), trace.size, tag, trace.timestamp);
+        }
+        else if (tagged)
+        {
+            appendLine(tag + QByteArray::fromRawData(trace.data(), trace.size), QVector<ColorSpan>(),
+                       trace.timestamp);
+        }
+        else
         {
-            moveCursor(QTextCursor::End);
+            // The text traces are stored as received, they are decoded when shown
+            appendLine(trace.data(), trace.size, trace.timestamp);
+        }
+        if (m_timeOrigin == 0)
+        {
+            m_timeOrigin = trace.timestamp;
+        }
+        if (trace.timestamp != 0 && (oldestTimestamp == 0 || trace.timestamp < oldestTimestamp))
+        {
+            oldestTimestamp = trace.timestamp;
+        }
+        if (replayed)
+        {
+            ++replayedLines;
+            if (trace.timestamp != 0 && (oldestReplayed == 0 || trace.timestamp < oldestReplayed))
+            {
+                oldestReplayed = trace.timestamp;
+            }
         }
     }
 
@@ -150,6 +582,69 @@ void LiveTraceView::onNewTracesReady(QStringList traces)
     {
         mainWindow->hightlightAllOccurrences();
     }
+
+    // Let the trace manager adapt the size of the next batch
+    emit tracesDisplayed(traces.size(), renderTimer.nsecsElapsed());
+    if (oldestTimestamp != 0)
+    {
+        // From the reception of the oldest line of the batch to its display
+        qint64 latency = TraceClock::nowNs() - oldestTimestamp;
+        emit displayLatencyMeasured(latency);
+    }
+
+    // The live traffic displayed meanwhile is not part of the replay report
+    if (m_replay.active && oldestReplayed != 0)
+    {
+        qint64 latency = TraceClock::nowNs() - oldestReplayed;
+        m_replay.latencySumNs += latency;
+        m_replay.latencyMaxNs = qMax(m_replay.latencyMaxNs, latency);
+        ++m_replay.batches;
+    }
+    if (m_replay.active && replayedLines > 0)
+    {
+        m_replay.displayedLines += replayedLines;
+        m_replay.displayedNs = m_replay.elapsed.nsecsElapsed();
+        if (m_replay.readDone)
+        {
+            if (m_replay.displayedLines >= m_replay.readLines)
+            {
+                reportReplay();
+            }
+            else
+            {
+                m_replayDrainTimer->start();
+            }
+        }
+    }
+}
+
+///
+/// \brief LiveTraceView::setSourceName
+/// \param sourceId
+/// \param name
+///
+void LiveTraceView::setSourceName(quint16 sourceId, QString name)
+{
+    m_sourceNames[sourceId] = name;
+}
+
+///
+/// \brief LiveTraceView::onEndpointResult
+/// \param endpoint
+/// \param success
+///
+void LiveTraceView::onEndpointResult(QString endpoint, bool success)
+{
+    if (success)
+    {
+        appendMessage(QString(">Listening to endpoint %1 OK").arg(endpoint), Qt::black);
+    }
+    else
+    {
+        appendMessage(QString(">Listening to endpoint %1 failed. "
+                              "Please check the endpoint syntax and if other application is taking over it.")
+                          .arg(endpoint), Qt::red);
+    }
 }
 
 ///
@@ -184,14 +679,20 @@ void LiveTraceView::onSocketBindResult(QString addr, quint16 port, bool success)
     m_setPortAct->setText(setPortActTitle);
 
     QString msg;
+    QColor color;
     if (success)
     {
-        msg = QString("<span style=\"color:black\">>Binding to %1").arg(addr);
+        color = Qt::black;
+        msg = QString(">Binding to %1").arg(addr);
         if (act != m_setSerialItfAct)
         {
             msg += QString(":%1").arg(QString::number(m_currentPort));
         }
-        msg += " interface OK</span>";
+        else
+        {
+            msg += QString(" (%1@%2)").arg(m_serialPortName, QString::number(m_serialBaudRate));
+        }
+        msg += " interface OK";
     }
     else
     {
@@ -205,44 +706,36 @@ void LiveTraceView::onSocketBindResult(QString addr, quint16 port, bool success)
             m_waitingStep.replace(idx, 1, "o");
             m_waitingStep.replace(nextIdx, 1, "0");
 
-            // Remove the old step to replace by new step
-            if (m_lastSetItfAct && m_lastSetItfAct == act)
+            // Remove the message with the old step to replace by new step
+            if (m_lastSetItfAct && m_lastSetItfAct == act && lineCount() > 0)
             {
-                auto cursor = textCursor();
-                cursor.movePosition(QTextCursor::End);
-                cursor.movePosition(QTextCursor::StartOfLine, QTextCursor::KeepAnchor);
-                QString interfaceAndPort = cursor.selectedText().split(" ").at(2);
-
-                if (interfaceAndPort == QString("%1:%2").arg(m_remoteAddress,
-                                                             QString::number(m_currentPort)))
+                QStringList words = lineText(lineCount() - 1).split(" ");
+                if (words.size() > 2 &&
+                    words.at(2) == QString("%1:%2").arg(m_remoteAddress, QString::number(m_currentPort)))
                 {
-                    cursor.movePosition(QTextCursor::End);
-                    cursor.movePosition(QTextCursor::Left, QTextCursor::KeepAnchor, m_waitingStep.length());
-                    // Replace old waiting step by the new one
-                    cursor.insertHtml(QString("<span style=\"color:blue\">%1</span>").arg(m_waitingStep));
-                    m_lastSetItfAct = act;
-                    return;
+                    removeLastLine();
                 }
             }
-            // In other case, we append a full message
-            msg = QString("<span style=\"color:blue\">>Binding to %1:%2 interface...   %3</span>")
+            color = Qt::blue;
+            msg = QString(">Binding to %1:%2 interface...   %3")
                       .arg(addr, QString::number(m_currentPort), m_waitingStep);
         }
         else
         {
-            msg = QString("<span style=\"color:red\">>Binding to %1").arg(addr);
+            color = Qt::red;
+            msg = QString(">Binding to %1").arg(addr);
             if (act != m_setSerialItfAct)
             {
                 msg += QString(":%1").arg(QString::number(m_currentPort));
             }
-            msg += " interface failed. Please check if other application is taking over the address.</span>";
+            else
+            {
+                msg += QString(" (%1@%2)").arg(m_serialPortName, QString::number(m_serialBaudRate));
+            }
+            msg += " interface failed. Please check if other application is taking over the address.";
         }
     }
 
     m_lastSetItfAct = act;
-    append(msg);
-    if (m_autoScroll)
-    {
-        moveCursor(QTextCursor::End);
-    }
+    appendMessage(msg, color);
 }
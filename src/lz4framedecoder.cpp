@@ -0,0 +1,207 @@
+#include "inc/lz4framedecoder.h"
+#include <QtEndian>
+#include <cstring>
+#include <lz4.h>
+
+namespace
+{
+// Farthest offset of a match, kept between linked blocks
+const int HISTORY_SIZE = 64 * 1024;
+const int INITIAL_INPUT_CAPACITY = 64 * 1024;
+const quint32 SKIPPABLE_MAGIC = 0x184D2A50;   // The low 4 bits are free
+const quint32 MAX_SKIPPABLE_SIZE = 16 * 1024 * 1024;
+}
+
+Lz4FrameDecoder::Lz4FrameDecoder()
+{
+    // Reserved, so that emptying the buffer keeps its memory
+    m_input.reserve(INITIAL_INPUT_CAPACITY);
+}
+
+///
+/// \brief Lz4FrameDecoder::reset
+///        Drop the buffered input and expect a new frame
+///
+void Lz4FrameDecoder::reset()
+{
+    m_input.resize(0);
+    m_inputOffset = 0;
+    m_historySize = 0;
+    m_lastOutputSize = 0;
+    m_state = FrameStart;
+    m_errorString.clear();
+}
+
+///
+/// \brief Lz4FrameDecoder::append
+///        Buffer compressed data, it is decoded by decodeBlock()
+/// \param data
+/// \param size
+///
+void Lz4FrameDecoder::append(const char* data, int size)
+{
+    if (m_inputOffset > 0 && m_inputOffset >= m_input.size() / 2)
+    {
+        m_input.remove(0, m_inputOffset);
+        m_inputOffset = 0;
+    }
+    m_input.append(data, size);
+}
+
+///
+/// \brief Lz4FrameDecoder::decodeBlock
+///        Decode the next block of the buffered input. The output is at most
+///        maxBlockSize() bytes and stays valid until the next call.
+/// \param output decoded data
+/// \param outputSize
+/// \return Decoded if a block is decoded
+///
+Lz4FrameDecoder::Status Lz4FrameDecoder::decodeBlock(const char*& output, int& outputSize)
+{
+    // The previous block becomes the history of the next one
+    if (m_lastOutputSize > 0)
+    {
+        int total = m_historySize + m_lastOutputSize;
+        m_historySize = 0;
+        if (m_linkedBlocks)
+        {
+            m_historySize = qMin(total, HISTORY_SIZE);
+            memmove(m_window.data(), m_window.constData() + total - m_historySize, size_t(m_historySize));
+        }
+        m_lastOutputSize = 0;
+    }
+
+    forever
+    {
+        const char* in = m_input.constData() + m_inputOffset;
+        const int available = m_input.size() - m_inputOffset;
+
+        if (m_state == FrameStart)
+        {
+            if (available < 4)
+            {
+                return NeedInput;
+            }
+            quint32 magic = qFromLittleEndian<quint32>(in);
+            if ((magic & 0xFFFFFFF0) == SKIPPABLE_MAGIC)
+            {
+                quint32 size = available >= 8 ? qFromLittleEndian<quint32>(in + 4) : 0;
+                if (size > MAX_SKIPPABLE_SIZE)
+                {
+                    return fail("Skippable frame too large");
+                }
+                if (available < 8 || size > quint32(available - 8))
+                {
+                    return NeedInput;
+                }
+                m_inputOffset += 8 + int(size);
+                continue;
+            }
+            if (magic != MAGIC)
+            {
+                return fail("Unknown frame magic");
+            }
+            if (available < 7)
+            {
+                return NeedInput;
+            }
+
+            // FLG: version, block independence, block checksum, content size, content checksum, dictionary id
+            const uchar flags = uchar(in[4]);
+            const uchar blockDescriptor = uchar(in[5]);
+            if ((flags >> 6) != 1)
+            {
+                return fail("Unsupported frame version");
+            }
+            if (flags & 0x01)
+            {
+                return fail("Frames compressed with a dictionary are not supported");
+            }
+            int blockSizeId = (blockDescriptor >> 4) & 0x07;
+            if (blockSizeId < 4)
+            {
+                return fail("Invalid block maximum size");
+            }
+            int headerSize = 7 + ((flags & 0x08) ? 8 : 0);
+            if (available < headerSize)
+            {
+                return NeedInput;
+            }
+
+            m_linkedBlocks = !(flags & 0x20);
+            m_blockChecksum = flags & 0x10;
+            m_contentChecksum = flags & 0x04;
+            m_maxBlockSize = 1 << (8 + 2 * blockSizeId); // 64 KB, 256 KB, 1 MB or 4 MB
+            m_historySize = 0;
+            if (m_window.size() < HISTORY_SIZE + m_maxBlockSize)
+            {
+                m_window.resize(HISTORY_SIZE + m_maxBlockSize);
+            }
+            m_inputOffset += headerSize;
+            m_state = BlockStart;
+            continue;
+        }
+
+        if (available < 4)
+        {
+            return NeedInput;
+        }
+        quint32 blockHeader = qFromLittleEndian<quint32>(in);
+        if (blockHeader == 0)
+        {
+            // End mark
+            int size = 4 + (m_contentChecksum ? 4 : 0);
+            if (available < size)
+            {
+                return NeedInput;
+            }
+            m_inputOffset += size;
+            m_state = FrameStart;
+            continue;
+        }
+
+        bool uncompressed = blockHeader & 0x80000000;
+        int blockSize = int(blockHeader & 0x7FFFFFFF);
+        if (blockSize > m_maxBlockSize)
+        {
+            return fail("Block larger than the frame maximum");
+        }
+        int size = 4 + blockSize + (m_blockChecksum ? 4 : 0);
+        if (available < size)
+        {
+            return NeedInput;
+        }
+
+        char* out = m_window.data() + m_historySize;
+        outputSize = blockSize;
+        if (uncompressed)
+        {
+            memcpy(out, in + 4, size_t(blockSize));
+        }
+        else
+        {
+            // liblz4 checks every length and offset, the input comes from the network
+            int history = m_linkedBlocks ? m_historySize : 0;
+            outputSize = LZ4_decompress_safe_usingDict(in + 4, out, blockSize, m_maxBlockSize, out - history, history);
+            if (outputSize < 0)
+            {
+                return fail("Corrupted block");
+            }
+        }
+        m_inputOffset += size;
+        m_lastOutputSize = outputSize;
+        output = out;
+        return Decoded;
+    }
+}
+
+///
+/// \brief Lz4FrameDecoder::fail
+/// \param errorString
+/// \return Error
+///
+Lz4FrameDecoder::Status Lz4FrameDecoder::fail(const QString& errorString)
+{
+    m_errorString = errorString;
+    return Error;
+}
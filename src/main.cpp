@@ -2,13 +2,30 @@
 #include "inc/traceserver.h"
 #include "inc/tracemanager.h"
 #include "inc/searchdock.h"
+#include "inc/traceline.h"
+#include "inc/slabring.h"
+#include "inc/headlesscapture.h"
+#include "inc/sessionjournal.h"
+#include "inc/constants.h"
 #include <QApplication>
 #include <QSettings>
+#include <QStandardPaths>
 #include <QThread>
+#include <QTimer>
 
 int main(int argc, char *argv[])
 {
+    if (HeadlessCapture::isRequested(argc, argv))
+    {
+        // Same capture without any widget, for the hosts without display
+        return HeadlessCapture::run(argc, argv);
+    }
+
     QApplication app(argc, argv);
+    qRegisterMetaType<TraceLines>();
+    qRegisterMetaType<OverloadStats>();
+    // The stream connections are added from their listener thread
+    qRegisterMetaType<SlabRing*>("SlabRing*");
     app.setOrganizationName("None");
     app.setOrganizationDomain("None");
     app.setApplicationName("TraceTerminal++");
@@ -19,6 +36,22 @@ int main(int argc, char *argv[])
     TraceServer& server = TraceServer::instance();
     TraceManager& traceManager = TraceManager::instance();
 
+    // Every framed line is journaled, the captures which crashed can be reopened
+    QSettings settings(Config::CONFIG_DIR, QSettings::IniFormat);
+    QString journalDirectory = settings.value(Config::JOURNAL_DIRECTORY,
+        QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/journal").toString();
+    SessionJournal journal(journalDirectory);
+    QStringList crashedSessions;
+    if (settings.value(Config::JOURNAL_ENABLED, true).toBool())
+    {
+        crashedSessions = SessionJournal::crashedSessions(journalDirectory);
+        if (journal.open(settings.value(Config::JOURNAL_MAX_SIZE, 10240).toLongLong() * 1024 * 1024,
+                         settings.value(Config::JOURNAL_MAX_SESSIONS, 5).toInt()))
+        {
+            traceManager.setJournal(&journal);
+        }
+    }
+
     auto liveView = new LiveTraceView;
     auto searchDock = new SearchDock;
     MainWindow mainWindow(liveView, searchDock);
@@ -31,16 +64,52 @@ int main(int argc, char *argv[])
                      &server, &TraceServer::onInterfaceChangeRequested);
     QObject::connect(liveView, &LiveTraceView::portChangeRequested,
                      &server, &TraceServer::onPortChangeRequested);
+    QObject::connect(liveView, &LiveTraceView::endpointsChangeRequested,
+                     &server, &TraceServer::onEndpointsChangeRequested);
+    QObject::connect(liveView, &LiveTraceView::serialPortChangeRequested,
+                     &server, &TraceServer::onSerialPortChangeRequested);
+    QObject::connect(&server, &TraceServer::endpointResult,
+                     liveView, &LiveTraceView::onEndpointResult);
+    QObject::connect(liveView, &LiveTraceView::replayRequested,
+                     &server, &TraceServer::onReplayRequested);
+    QObject::connect(&server, &TraceServer::replayFinished,
+                     liveView, &LiveTraceView::onReplayFinished);
+    QObject::connect(&server, &TraceServer::ingestSourceAdded,
+                     liveView, [=](SlabRing*, quint16 sourceId, QString name){
+        liveView->setSourceName(sourceId, name);
+    });
 
-    // Connect server to trace manager
-    QObject::connect(&server, &TraceServer::newDataReady,
-                     &traceManager, &TraceManager::onNewDataReady, Qt::QueuedConnection);
+    // Connect server to journal, the name is journaled before the lines of the source
+    QObject::connect(&server, &TraceServer::ingestSourceAdded,
+                     &traceManager, [&journal](SlabRing*, quint16 sourceId, QString name){
+        journal.setSourceName(sourceId, name);
+    }, Qt::DirectConnection);
+    // Connect server to trace manager, the rings are added and removed synchronously
+    QObject::connect(&server, &TraceServer::ingestSourceAdded,
+                     &traceManager, &TraceManager::onIngestSourceAdded, Qt::DirectConnection);
+    QObject::connect(&server, &TraceServer::ingestSourceRemoved,
+                     &traceManager, &TraceManager::onIngestSourceRemoved, Qt::DirectConnection);
     // Connect manager to live view
     QObject::connect(&traceManager, &TraceManager::newTracesReady,
                      liveView, &LiveTraceView::onNewTracesReady, Qt::QueuedConnection);
+    QObject::connect(liveView, &LiveTraceView::tracesDisplayed,
+                     &traceManager, &TraceManager::onTracesDisplayed, Qt::DirectConnection);
+    QObject::connect(&traceManager, &TraceManager::backlogChanged,
+                     &mainWindow, &MainWindow::onBacklogChanged, Qt::QueuedConnection);
+    QObject::connect(liveView, &LiveTraceView::displayLatencyMeasured,
+                     &mainWindow, &MainWindow::onDisplayLatencyMeasured);
+    QObject::connect(&traceManager, &TraceManager::overloadStatsChanged,
+                     &mainWindow, &MainWindow::onOverloadStatsChanged, Qt::QueuedConnection);
+    QObject::connect(&server, &TraceServer::statsUpdated,
+                     &mainWindow, &MainWindow::onIngestStatsUpdated);
 
     server.init();
     mainWindow.show();
+    QTimer::singleShot(0, &mainWindow, [&]() {
+        mainWindow.recoverSessions(crashedSessions);
+    });
     int ret = app.exec();
+    traceManager.setJournal(nullptr);
+    journal.close();
     return ret;
 }
@@ -3,11 +3,23 @@
 #include "inc/searchdock.h"
 #include "inc/tracemanager.h"
 #include "inc/tracehighlighter.h"
+#include "inc/traceserver.h"
+#include "inc/tracedictionary.h"
+#include "inc/overloadpolicy.h"
+#include "inc/sessionjournal.h"
 #include <QtWidgets>
 #include <QSettings>
 #include <QMessageBox>
-#include <QtConcurrent/QtConcurrentRun>
 #include <QGuiApplication>
+#include <algorithm>
+
+namespace
+{
+// Lines searched between two updates of the gui
+const int SEARCH_EVENTS_INTERVAL = 1000;
+// Steps of the progress of a file being opened
+const int LOAD_PROGRESS_RANGE = 1000;
+}
 
 ///
 /// \brief Helper function
@@ -81,6 +93,17 @@ MainWindow::MainWindow(LiveTraceView* liveView, SearchDock* searchDock)
     QString message = "A context menu is available by right-clicking";
     statusBar()->setStyleSheet("color: indigo");
     statusBar()->showMessage(message);
+    m_backlogLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(m_backlogLabel);
+    onBacklogChanged(0);
+    m_latencyLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(m_latencyLabel);
+    m_ingestLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(m_ingestLabel);
+    m_overloadLabel = new QLabel(this);
+    m_overloadLabel->setStyleSheet("color: darkorange");
+    m_overloadLabel->hide();
+    statusBar()->addPermanentWidget(m_overloadLabel);
 
     // Init the main window property
     setWindowTitle("TraceTerminal++ - Live View");
@@ -185,9 +208,11 @@ void MainWindow::closeEvent(QCloseEvent* event)
     QSettings settings(Config::CONFIG_DIR, QSettings::IniFormat);
     settings.setValue(Config::MAINWINDOW_GEOMETRY, saveGeometry());
     settings.setValue(Config::TRACEVIEW_AUTOSCROLL, m_liveView->isAutoScrollEnabled());
+    settings.setValue(Config::TRACEVIEW_TIMESTAMPS, m_liveView->isTimestampShown());
     settings.setValue(Config::REMOTE_ADDRESS, m_liveView->getRemoteAddress());
     settings.setValue(Config::SEARCH_CASESENSITIVE, m_searchDock->isCaseSensitiveChecked());
     settings.setValue(Config::SEARCH_LOOPSEARCH, m_searchDock->isLoopSearchChecked());
+    settings.setValue(Config::DICTIONARY, TraceDictionary::instance().path());
     event->accept();
 }
 
@@ -333,55 +358,89 @@ void MainWindow::onCurrentTabChanged(int index)
     m_tabWidget->tabBar()->setTabTextColor(m_lastTabIndex, QColor(Qt::black));
     m_lastTabIndex = index;
 
+    // The rules are applied when the lines are painted, only the visible lines are painted again
     auto pView = (TraceView*)m_tabWidget->widget(index);
+    if (!pView->isHighlightUpdated())
+    {
+        pView->updateHighlighting();
+    }
+}
+
+///
+/// \brief MainWindow::onSearchDockHidden
+///
+void MainWindow::onSearchDockHidden()
+{
+    clearOccurrencesHighlight();
+}
+
+///
+/// \brief MainWindow::onBacklogChanged
+/// \param backlog number of traces waiting to be displayed in live view
+///
+void MainWindow::onBacklogChanged(int backlog)
+{
+    m_backlogLabel->setText(QString("Backlog: %1 lines").arg(backlog));
+}
+
+///
+/// \brief MainWindow::onDisplayLatencyMeasured
+/// \param latencyNs time from the reception of a trace to its display in live view
+///
+void MainWindow::onDisplayLatencyMeasured(qint64 latencyNs)
+{
+    m_latencyLabel->setText(QString("Latency: %1 ms").arg(double(latencyNs) / 1e6, 0, 'f', 1));
+}
 
-    if (pView->isHighlightUpdated())
+///
+/// \brief MainWindow::onOverloadStatsChanged
+///        Shown once the view could not keep up, with the lines each policy acted on
+/// \param stats
+///
+void MainWindow::onOverloadStatsChanged(const OverloadStats& stats)
+{
+    QStringList parts;
+    if (stats.droppedLines)
     {
-        return;
+        parts << QString("dropped %1").arg(stats.droppedLines);
     }
-    // Always update the liveview's highlighting
-    else if (!pView->isHighlightUpdated() && pView == m_liveView)
+    if (stats.sampledLines)
     {
-        pView->updateHighlighting();
-        return;
+        parts << QString("sampled out %1 PRINT").arg(stats.sampledLines);
     }
-    else
+    if (stats.spilledLines)
     {
-        m_tabWidget->tabBar()->setTabTextColor(index, QColor(Qt::red));
-        if (pView->wasHighlightUpdateRequested())
-        {
-            return;
-        }
+        parts << QString("spilled %1 (%2 on disk)").arg(stats.spilledLines).arg(stats.linesOnDisk);
     }
-
-    QFuture<void> future;
-    int ret = QMessageBox::information(this, "Highlighting Rule",
-                                       "The highlighting rule of this view is not up-to-date.<br>"
-                                       "Do you want to reload it?<br>"
-                                       "<br>"
-                                       "<i>Note: This may take some times on large file</i>",
-                                       QMessageBox::Yes | QMessageBox::No,
-                                       QMessageBox::Yes);
-    switch (ret)
+    if (stats.protectedLines)
     {
-    case QMessageBox::Yes:
-        future = QtConcurrent::run(pView, &TraceView::updateHighlighting);
-        m_tabWidget->tabBar()->setTabTextColor(index, QColor(Qt::black));
-        break;
-    case QMessageBox::No:
-        // Don't Save was clicked
-        break;
+        parts << QString("kept %1 ERROR/PANIC").arg(stats.protectedLines);
     }
-    pView->setHighlightUpdateRequested();
-    future.waitForFinished();
+    m_overloadLabel->setText("Overload: " + parts.join(", "));
+    m_overloadLabel->setVisible(!parts.isEmpty());
 }
 
 ///
-/// \brief MainWindow::onSearchDockHidden
+/// \brief MainWindow::onIngestStatsUpdated
+/// \param stats receive rate and drops, the drops are shown in red as the traces are lost
 ///
-void MainWindow::onSearchDockHidden()
+void MainWindow::onIngestStatsUpdated(const IngestStats& stats)
 {
-    clearOccurrencesHighlight();
+    QString text = QString("In: %1 dgram/s, %2/s")
+            .arg(qRound64(stats.datagramsPerSecond))
+            .arg(locale().formattedDataSize(qint64(stats.bytesPerSecond)));
+    quint64 drops = stats.kernelDrops + stats.ringDrops;
+    if (drops)
+    {
+        text += QString(" | Dropped: %1 (kernel %2, ring %3)")
+                .arg(drops).arg(stats.kernelDrops).arg(stats.ringDrops);
+    }
+    m_ingestLabel->setText(text);
+    m_ingestLabel->setStyleSheet(drops ? "color: red" : QString());
+    m_ingestLabel->setToolTip(QString("Total received: %1 datagrams, %2\nSocket receive buffer: %3")
+                              .arg(stats.receivedDatagrams)
+                              .arg(locale().formattedDataSize(qint64(stats.receivedBytes)))
+                              .arg(locale().formattedDataSize(stats.receiveBufferSize)));
 }
 
 ///
@@ -420,62 +479,103 @@ void MainWindow::openFile(const QString& url)
         }
     }
 
-    auto offlineView = new TraceView;
-    offlineView->setDocumentTitle(fileInfo.fileName());
-    m_tabWidget->addTab(offlineView, fileInfo.fileName());
-    m_tabWidget->setCurrentIndex(m_tabWidget->count() - 1);
-    connect(offlineView, &TraceView::copyAvailable, this, &MainWindow::onCopyAvailable);
-    connect(this, &MainWindow::highlightChanged, offlineView, &TraceView::onHighlightingChanged);
-
-    QString data;
-    // Start read file concurrently
-    QFuture<bool> future = QtConcurrent::run(&TraceManager::instance(), &TraceManager::readFile, url, std::ref(data));
-
-    if (fileInfo.suffix() == "html")
+    auto offlineView = addOfflineView(fileInfo.fileName());
+    if (fileInfo.suffix() != "html")
     {
-        int ret = QMessageBox::information(this, "Highlighting",
-                                           "This file is in rich text format (html) which might already <br>"
-                                           "have its own highlight.<br>"
-                                           "Do you want to add your highlighting rule? The highlight of <br>"
-                                           "the file is still kept but might be overwritten by your rule.<br>"
-                                           "<br>"
-                                           "<i>Note: This action cannot be undone. You'll need to reopen the file<br>"
-                                           "to change it</i>",
-                                           QMessageBox::Yes | QMessageBox::No,
-                                           QMessageBox::Yes);
-        switch (ret)
+        // The plain text files are mapped, their lines are indexed in the background
+        if (!offlineView->openFile(url))
         {
-        case QMessageBox::Yes:
-            break;
-        case QMessageBox::No:
-            disconnect(this, &MainWindow::highlightChanged, offlineView, &TraceView::onHighlightingChanged);
-            offlineView->disableCustomHighlighting();
-            break;
+            onTabCloseRequested(m_tabWidget->indexOf(offlineView));
+            QMessageBox::critical(nullptr, "ERROR!!!", "Cannot open trace file");
         }
-    }
-
-    QProgressDialog progress("Opening files...", "Abort", 0, 100, this);
-    progress.open();
-
-    // Join the thread
-    future.waitForFinished();
-    if (!future.result())
-    {
-        QMessageBox::critical(nullptr, "ERROR!!!", "Cannot open trace file");
         return;
     }
-    progress.setValue(50);
-    QGuiApplication::processEvents(QEventLoop::ExcludeUserInputEvents | QEventLoop::ExcludeSocketNotifiers);
 
-    if (fileInfo.suffix() == "html")
+    offlineView->openHtmlFile(url);
+    int ret = QMessageBox::information(this, "Highlighting",
+                                       "This file is in rich text format (html) which might already <br>"
+                                       "have its own highlight.<br>"
+                                       "Do you want to add your highlighting rule? The highlight of <br>"
+                                       "the file is still kept but might be overwritten by your rule.<br>"
+                                       "<br>"
+                                       "<i>Note: This action cannot be undone. You'll need to reopen the file<br>"
+                                       "to change it</i>",
+                                       QMessageBox::Yes | QMessageBox::No,
+                                       QMessageBox::Yes);
+    if (ret == QMessageBox::No && m_tabWidget->indexOf(offlineView) >= 0)
     {
-        offlineView->setHtml(data);
+        disconnect(this, &MainWindow::highlightChanged, offlineView, &TraceView::onHighlightingChanged);
+        offlineView->disableCustomHighlighting();
     }
-    else
+}
+
+///
+/// \brief MainWindow::openJournal
+///        Reopen the traces of a capture from its journal
+/// \param sessionPath
+///
+void MainWindow::openJournal(const QString& sessionPath)
+{
+    auto offlineView = addOfflineView(QFileInfo(sessionPath).fileName());
+    offlineView->openJournal(sessionPath);
+}
+
+///
+/// \brief MainWindow::addOfflineView
+///        Add a tab for lines loaded in the background, they show in the tab as they come.
+///        The progress shows up if it takes long, aborting closes the tab.
+/// \param title
+/// \return view of the tab
+///
+TraceView* MainWindow::addOfflineView(const QString& title)
+{
+    auto offlineView = new TraceView;
+    m_tabWidget->addTab(offlineView, title);
+    m_tabWidget->setCurrentIndex(m_tabWidget->count() - 1);
+    connect(offlineView, &TraceView::copyAvailable, this, &MainWindow::onCopyAvailable);
+    connect(this, &MainWindow::highlightChanged, offlineView, &TraceView::onHighlightingChanged);
+
+    auto progress = new QProgressDialog(QString("Opening %1...").arg(title), "Abort",
+                                        0, LOAD_PROGRESS_RANGE, this);
+    connect(offlineView, &TraceView::loadProgress, progress, [=](qint64 bytesRead, qint64 size) {
+        progress->setValue(int(bytesRead * LOAD_PROGRESS_RANGE / qMax<qint64>(size, 1)));
+    });
+    connect(offlineView, &TraceView::loadFinished, progress, [=](const QString& errorString) {
+        progress->deleteLater();
+        if (!errorString.isEmpty())
+        {
+            QMessageBox::critical(nullptr, "ERROR!!!", "Cannot open trace file: " + errorString);
+        }
+    });
+    connect(offlineView, &QObject::destroyed, progress, &QObject::deleteLater);
+    connect(progress, &QProgressDialog::canceled, offlineView, [=]() {
+        onTabCloseRequested(m_tabWidget->indexOf(offlineView));
+    });
+    return offlineView;
+}
+
+///
+/// \brief MainWindow::recoverSessions
+///        Offer to reopen the captures which did not end properly, each one is offered once
+/// \param sessionPaths journals of the captures
+///
+void MainWindow::recoverSessions(const QStringList& sessionPaths)
+{
+    for (const auto& sessionPath : sessionPaths)
     {
-        offlineView->setPlainText(data);
+        int ret = QMessageBox::question(this, "Recover capture",
+                                        QString("The capture %1 did not end properly.<br>"
+                                                "Do you want to reopen its traces?")
+                                            .arg(QFileInfo(sessionPath).fileName()),
+                                        QMessageBox::Yes | QMessageBox::No,
+                                        QMessageBox::Yes);
+        if (ret == QMessageBox::Yes)
+        {
+            openJournal(sessionPath);
+        }
+        // Removed later with the old sessions
+        SessionJournal::markClosed(sessionPath);
     }
-    progress.close();
 }
 
 ///
@@ -496,9 +596,9 @@ void MainWindow::showSearchDock(bool advanced)
     m_searchDock->setFocus();
 
     auto currentView = (TraceView*)m_tabWidget->currentWidget();
-    if (currentView->textCursor().hasSelection())
+    if (currentView->hasSelection())
     {
-        QString selectedText = currentView->textCursor().selectedText();
+        QString selectedText = currentView->selectedText();
         if (!m_searchDock->getQuery().isEmpty() &&
             m_searchDock->getQuery() != selectedText)
         {
@@ -521,7 +621,8 @@ void MainWindow::onSearchRequested(bool advanced, bool newSearch)
     if (advanced)
     {
         m_isOccurrencesHighlighted = false;
-        m_lastSearchCursor = QTextCursor();
+        auto currentView = (TraceView*)m_tabWidget->currentWidget();
+        currentView->setCurrentMatch(TextRange());
         advancedSearch();
     }
     else
@@ -540,34 +641,29 @@ void MainWindow::normalSearch(bool newSearch)
     bool isLoopSearch = m_searchDock->isLoopSearchChecked();
     if (newSearch)
     {
-        m_lastSearchCursor = QTextCursor();
         clearOccurrencesHighlight();
     }
     hightlightAllOccurrences();
 
-    auto extraSelections = currentView->extraSelections();
-    QTextCursor foundCursor;
+    // The current match of the view is the one found last time
+    const auto& matches = currentView->matches();
+    TextRange lastMatch = currentView->currentMatch();
+    TextRange foundMatch;
 
-    if (!extraSelections.isEmpty())
+    if (!matches.isEmpty())
     {
-        if ((m_lastSearchCursor != extraSelections.last().cursor))
+        if (lastMatch != matches.last())
         {
-            if (m_lastSearchCursor.isNull())
+            if (lastMatch.isNull())
             {
-                foundCursor = extraSelections.first().cursor;
-                extraSelections.first().format.setBackground(QColor(Qt::green).lighter());
+                foundMatch = matches.first();
             }
             else
             {
-                for (int i = 0; i < extraSelections.length(); ++i)
+                auto it = std::lower_bound(matches.begin(), matches.end(), lastMatch);
+                if (it != matches.end() && *it == lastMatch)
                 {
-                    if (extraSelections[i].cursor == m_lastSearchCursor)
-                    {
-                        foundCursor = extraSelections[i + 1].cursor;
-                        extraSelections[i].format.setBackground(QColor(Qt::yellow).lighter(140));
-                        extraSelections[i + 1].format.setBackground(QColor(Qt::green).lighter());
-                        break;
-                    }
+                    foundMatch = *(it + 1);
                 }
             }
         }
@@ -576,26 +672,20 @@ void MainWindow::normalSearch(bool newSearch)
             qDebug() << "loop search";
             statusBar()->showMessage("The end of document has been reached, searching from the start",
                                      2000);
-            foundCursor = extraSelections.first().cursor;
-            extraSelections.last().format.setBackground(QColor(Qt::yellow).lighter(140));
-            extraSelections.first().format.setBackground(QColor(Qt::green).lighter());
+            foundMatch = matches.first();
         }
     }
 
-    if (foundCursor.isNull())
+    if (foundMatch.isNull())
     {
         statusBar()->showMessage("The end of document has been reached",
                                  2000);
         return;
     }
 
-    currentView->setExtraSelections(extraSelections);
-    currentView->setTextCursor(foundCursor);
-    currentView->moveCursor(QTextCursor::EndOfWord);
-    currentView->moveCursor(QTextCursor::Right);
-
-    // Save the found cursor so that we can continue to search from there later
-    m_lastSearchCursor = foundCursor;
+    // Save the found match so that we can continue to search from there later
+    currentView->setCurrentMatch(foundMatch);
+    currentView->ensureVisible(foundMatch);
 }
 
 ///
@@ -610,7 +700,6 @@ void MainWindow::advancedSearch()
     progress.setValue(0); // Ugly trick...
 
     auto currentView = (TraceView*)m_tabWidget->currentWidget();
-    auto document = currentView->document();
 
     progress.setValue(50);
 
@@ -619,32 +708,34 @@ void MainWindow::advancedSearch()
                                     m_searchDock->isCaseSensitiveChecked());
     progress.setValue(75);
 
-    // Match the regular expression against the block's text
-    // Here we have each block is one line
-    for (QTextBlock block = document->begin(); block.isValid(); block = block.next())
+    // Match the regular expression against the text of every line
+    for (int line = 0; line < currentView->lineCount(); ++line)
     {
         if (progress.wasCanceled())
         {
             break;
         }
 
+        QString text = currentView->lineText(line);
         foreach (const auto& regex, regexs)
         {
-            QRegularExpressionMatchIterator matchIterator = regex.globalMatch(block.text());
+            QRegularExpressionMatchIterator matchIterator = regex.globalMatch(text);
             while (matchIterator.hasNext())
             {
-                // If there is a match, focus cursor the the actual word
                 auto match = matchIterator.next();
-                QTextCursor cursor(block);
-                cursor.setPosition(block.position() + match.capturedStart());
-                cursor.setPosition(block.position() + match.capturedEnd(), QTextCursor::KeepAnchor);
-
-                m_searchDock->addAdvSearchResult(cursor);
+                TextRange range;
+                range.line = line;
+                range.start = match.capturedStart();
+                range.length = match.capturedLength();
+                m_searchDock->addAdvSearchResult(range, text);
             }
         }
 
         // Process event loop so that gui thread can be updated while searching
-        QGuiApplication::processEvents(QEventLoop::ExcludeSocketNotifiers);
+        if (line % SEARCH_EVENTS_INTERVAL == 0)
+        {
+            QGuiApplication::processEvents(QEventLoop::ExcludeSocketNotifiers);
+        }
     }
 
     m_searchDock->sortAdvSearchResult();
@@ -656,7 +747,7 @@ void MainWindow::advancedSearch()
 /// \brief MainWindow::onSearchResultSelected
 /// \param cursor
 ///
-void MainWindow::onSearchResultSelected(const QTextCursor cursor)
+void MainWindow::onSearchResultSelected(const TextRange match)
 {
     if (!m_viewInAdvSearch)
     {
@@ -669,94 +760,69 @@ void MainWindow::onSearchResultSelected(const QTextCursor cursor)
         m_tabWidget->setCurrentWidget(m_viewInAdvSearch);
         currentView = m_viewInAdvSearch;
     }
-    QList<QTextEdit::ExtraSelection> extraSelections;
-
-    auto cursorOnLine = cursor;
-    cursorOnLine.select(QTextCursor::LineUnderCursor);
-    // the last character of line is " ", do not count it
-    // See note in TraceManager::filterIncompletedFromRawData
-    cursorOnLine.movePosition(QTextCursor::PreviousCharacter);
-    QTextEdit::ExtraSelection extraForLine;
-    extraForLine.format.setBackground(QColor(Qt::gray).lighter(140));
-    extraForLine.cursor = cursorOnLine;
-    extraSelections.append(extraForLine);
 
-    // extraForWord MUST be set after extraForLine
-    QTextEdit::ExtraSelection extraForWord;
-    extraForWord.format.setBackground(QColor(Qt::green).lighter());
-    extraForWord.cursor = cursor;
-    extraSelections.append(extraForWord);
-
-    currentView->setExtraSelections(extraSelections);
-    currentView->setTextCursor(cursor);
-    currentView->moveCursor(QTextCursor::EndOfWord);
-    currentView->moveCursor(QTextCursor::Left);
+    // Only the selected result is highlighted, on its line in gray
+    currentView->setMatches({ match });
+    currentView->setCurrentMatch(match);
+    currentView->setMarkedLine(match.line);
+    currentView->ensureVisible(match);
 }
 
 ///
 /// \brief MainWindow::hightlightAllOccurrences
+///        The lines after the last highlighted occurrence are searched, so that only
+///        the new lines are searched when the live view is updated
 ///
 void MainWindow::hightlightAllOccurrences()
 {
     auto currentView = (TraceView*)m_tabWidget->currentWidget();
-    auto lighterYellow = QColor(Qt::yellow).lighter(140);
-    auto extraSelections = currentView->extraSelections();
+    auto matches = currentView->matches();
 
-    QTextCursor lastHighlightedCursor(currentView->document());
-    if (!extraSelections.isEmpty())
+    TextRange lastHighlighted;
+    lastHighlighted.line = 0;
+    lastHighlighted.start = -1;
+    if (!matches.isEmpty())
     {
-        lastHighlightedCursor = extraSelections.last().cursor;
+        lastHighlighted = matches.last();
     }
 
     // Get the regexes to match the search query
     auto regexs = getRegexsForQuery(m_searchDock->getQuery(),
                                     m_searchDock->isCaseSensitiveChecked());
 
-    auto currentBlock = lastHighlightedCursor.block();
-    QList<QTextEdit::ExtraSelection> tempExtraSelections;
-
-    for (QTextBlock block = currentBlock; block.isValid(); block = block.next())
+    QVector<TextRange> newMatches;
+    for (int line = lastHighlighted.line; line < currentView->lineCount(); ++line)
     {
+        QString text = currentView->lineText(line);
         foreach (const auto& regex, regexs)
         {
-            QRegularExpressionMatchIterator matchIterator = regex.globalMatch(block.text());
+            QRegularExpressionMatchIterator matchIterator = regex.globalMatch(text);
             while (matchIterator.hasNext())
             {
-                // If there is a match, focus cursor in the actual word
                 auto match = matchIterator.next();
-                QTextCursor cursor(block);
-                cursor.setPosition(block.position() + match.capturedStart());
-                cursor.setPosition(block.position() + match.capturedEnd(), QTextCursor::KeepAnchor);
+                TextRange range;
+                range.line = line;
+                range.start = match.capturedStart();
+                range.length = match.capturedLength();
 
-                // We find from the beginning of block so the catured might be already in the list before
-                if (cursor <= lastHighlightedCursor)
+                // We find from the beginning of line so the captured might be already in the list before
+                if (range <= lastHighlighted)
                 {
                     continue;
                 }
-
-                QTextEdit::ExtraSelection extra;
-                extra.format.setBackground(lighterYellow);
-                extra.cursor = cursor;
-                tempExtraSelections.append(extra);
+                newMatches.append(range);
             }
         }
     }
 
-    // We're sure that items of tempExtraSelections is larger than all items of current extraSelections
-    // So just sort the tempExtraSelections and then merge them to the curent one
-    if (!tempExtraSelections.isEmpty())
+    // We're sure that items of newMatches are after all the current matches
+    // So just sort the newMatches and then merge them to the current ones
+    if (!newMatches.isEmpty())
     {
-        // Sort by position, so that we can continue to highlight from the last cursor in the list next time
-        std::sort(tempExtraSelections.begin(), tempExtraSelections.end(), [&](const auto& a, const auto& b) {
-            if (!a.cursor.isNull() && !b.cursor.isNull())
-                return a.cursor < b.cursor;
-            return false;
-        });
-        extraSelections.append(tempExtraSelections);
-        // qDebug() << "Last after sort" << extraSelections.last().cursor.position()
-        //                               << extraSelections.last().cursor.block().text();
-
-        currentView->setExtraSelections(extraSelections);
+        // Sort by position, so that we can continue to highlight from the last match in the list next time
+        std::sort(newMatches.begin(), newMatches.end());
+        matches.append(newMatches);
+        currentView->setMatches(matches);
         m_isOccurrencesHighlighted = true;
     }
 }
@@ -767,7 +833,9 @@ void MainWindow::hightlightAllOccurrences()
 void MainWindow::clearOccurrencesHighlight()
 {
     auto currentView = (TraceView*)m_tabWidget->currentWidget();
-    currentView->setExtraSelections(QList<QTextEdit::ExtraSelection>());
+    currentView->setMatches(QVector<TextRange>());
+    currentView->setCurrentMatch(TextRange());
+    currentView->setMarkedLine(-1);
     m_isOccurrencesHighlighted = false;
 }
 
@@ -0,0 +1,225 @@
+#include "inc/mappedtracefile.h"
+#include <QtConcurrent/QtConcurrentRun>
+#include <QThread>
+#include <QList>
+#include <QDebug>
+#include <climits>
+#include <cstring>
+
+namespace
+{
+// Part of the file scanned by one task, the first lines are shown once the first one is done
+const qint64 INDEX_CHUNK_SIZE = 4 * 1024 * 1024;
+// Longer lines (e.g. a binary file) are cut when read
+const int MAX_LINE_LENGTH = 1024 * 1024;
+// The line numbers of the views are int
+const int MAX_LINES = INT_MAX / 2;
+
+// Line breaks found in a chunk of the file
+struct ChunkIndex
+{
+    QVector<quint32> lineBreaks;   // Offsets from the start of the chunk
+    int maxLineLength{0};          // Of the lines between two line breaks of the chunk
+};
+
+///
+/// \brief indexChunk
+///        Run concurrently for every chunk, memchr being the vectorized scan of the
+///        C runtime
+/// \param data start of the chunk
+/// \param size
+/// \return the line breaks of the chunk
+///
+ChunkIndex indexChunk(const char* data, int size)
+{
+    ChunkIndex chunk;
+    const char* position = data;
+    const char* end = data + size;
+    while (auto lineBreak = static_cast<const char*>(memchr(position, '\n', size_t(end - position))))
+    {
+        if (!chunk.lineBreaks.isEmpty())
+        {
+            chunk.maxLineLength = qMax(chunk.maxLineLength, qMin(int(lineBreak - position), MAX_LINE_LENGTH));
+        }
+        chunk.lineBreaks.append(quint32(lineBreak - data));
+        position = lineBreak + 1;
+    }
+    return chunk;
+}
+}
+
+MappedTraceFile::MappedTraceFile(const QString& path)
+    : m_file(path)
+{
+}
+
+MappedTraceFile::~MappedTraceFile()
+{
+    m_stopIndexing = true;
+    m_indexer.waitForFinished();
+    m_file.close(); // Unmaps the file
+}
+
+///
+/// \brief MappedTraceFile::open
+///        Map the file and start indexing its lines
+/// \return false if the file cannot be opened or mapped
+///
+bool MappedTraceFile::open()
+{
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+    m_offsets.append(0);
+    if (m_size == 0)
+    {
+        m_indexed = true;
+        return true;
+    }
+
+    m_data = reinterpret_cast<const char*>(m_file.map(0, m_size));
+    if (!m_data)
+    {
+        m_errorString = m_file.errorString();
+        return false;
+    }
+    m_indexer = QtConcurrent::run(this, &MappedTraceFile::buildIndex);
+    return true;
+}
+
+///
+/// \brief MappedTraceFile::buildIndex
+///        Run by the worker: the chunks of the file are scanned concurrently, a few ahead
+///        of the merge. The merge numbers their lines in file order, from the line count
+///        of the previous chunks, and hands every chunk to the thread of the object.
+///
+void MappedTraceFile::buildIndex()
+{
+    int maxPending = 2 * qMax(1, QThread::idealThreadCount());
+    QList<QFuture<ChunkIndex>> pending;
+    qint64 nextChunk = 0;
+    qint64 position = 0;
+    qint64 lineStart = 0;
+    int lineCount = 0;
+    int maxLineLength = 0;
+    while (position < m_size && !m_stopIndexing)
+    {
+        while (nextChunk < m_size && pending.size() < maxPending)
+        {
+            qint64 size = qMin(INDEX_CHUNK_SIZE, m_size - nextChunk);
+            pending.append(QtConcurrent::run(indexChunk, m_data + nextChunk, int(size)));
+            nextChunk += size;
+        }
+        ChunkIndex chunk = pending.takeFirst().result();
+
+        const auto& lineBreaks = chunk.lineBreaks;
+        QVector<qint64> offsets;
+        offsets.reserve(lineBreaks.size() / INDEX_INTERVAL + 1);
+        // Break ending the line lineCount + i + 1, keep the start of the next line every INDEX_INTERVAL
+        for (int i = INDEX_INTERVAL - 1 - lineCount % INDEX_INTERVAL; i < lineBreaks.size(); i += INDEX_INTERVAL)
+        {
+            offsets.append(position + lineBreaks[i] + 1);
+        }
+        if (!lineBreaks.isEmpty())
+        {
+            // The first line of the chunk started in a previous one
+            maxLineLength = qMax(maxLineLength, int(qMin<qint64>(position + lineBreaks.first() - lineStart, MAX_LINE_LENGTH)));
+            lineStart = position + lineBreaks.last() + 1;
+        }
+        maxLineLength = qMax(maxLineLength, chunk.maxLineLength);
+        lineCount += lineBreaks.size();
+        position = qMin(m_size, position + INDEX_CHUNK_SIZE);
+
+        if (lineCount >= MAX_LINES)
+        {
+            qDebug() << "Trace file has too many lines, the end is not shown" << m_file.fileName();
+            position = m_size;
+            lineStart = m_size;
+        }
+        bool indexed = position >= m_size;
+        if (indexed && lineStart < m_size)
+        {
+            // The last line has no line break
+            maxLineLength = qMax(maxLineLength, int(qMin<qint64>(m_size - lineStart, MAX_LINE_LENGTH)));
+            ++lineCount;
+        }
+        QMetaObject::invokeMethod(this, [=]() {
+            onChunkIndexed(offsets, lineCount, maxLineLength, position, indexed);
+        }, Qt::QueuedConnection);
+    }
+
+    // The scans still running read the mapped file
+    for (auto& future : pending)
+    {
+        future.waitForFinished();
+    }
+}
+
+///
+/// \brief MappedTraceFile::onChunkIndexed
+/// \param offsets starts of the indexed lines found in the chunk
+/// \param lineCount lines found since the start of the file
+/// \param maxLineLength
+/// \param indexedSize bytes indexed since the start of the file
+/// \param indexed true for the last chunk
+///
+void MappedTraceFile::onChunkIndexed(const QVector<qint64>& offsets, int lineCount, int maxLineLength,
+                                     qint64 indexedSize, bool indexed)
+{
+    m_offsets += offsets;
+    m_lineCount = lineCount;
+    m_maxLineLength = maxLineLength;
+    m_indexedSize = indexedSize;
+    m_indexed = indexed;
+    emit linesIndexed();
+}
+
+///
+/// \brief MappedTraceFile::lineData
+/// \param line line index, must be lower than lineCount()
+/// \return the text of the line, without the line break
+///
+QByteArray MappedTraceFile::lineData(int line) const
+{
+    int current = line - line % INDEX_INTERVAL;
+    qint64 start = m_offsets[line / INDEX_INTERVAL];
+    if (m_lastLine >= current && m_lastLine < line)
+    {
+        // Read in sequence, e.g. when searching or saving
+        current = m_lastLine + 1;
+        start = m_lastLineEnd + 1;
+    }
+    for (; current < line; ++current)
+    {
+        auto lineBreak = static_cast<const char*>(memchr(m_data + start, '\n', size_t(m_size - start)));
+        start = lineBreak - m_data + 1;
+    }
+
+    auto lineBreak = static_cast<const char*>(memchr(m_data + start, '\n', size_t(m_size - start)));
+    qint64 end = lineBreak ? lineBreak - m_data : m_size;
+    m_lastLine = line;
+    m_lastLineEnd = end;
+
+    if (end > start && m_data[end - 1] == '\r')
+    {
+        --end;
+    }
+    if (start == 0 && end >= 3 && memcmp(m_data, "\xEF\xBB\xBF", 3) == 0)
+    {
+        // UTF-8 byte order mark
+        start = 3;
+    }
+    return QByteArray(m_data + start, int(qMin<qint64>(end - start, MAX_LINE_LENGTH)));
+}
+
+///
+/// \brief MappedTraceFile::memoryUsage
+/// \return bytes allocated for the index, the file itself is mapped
+///
+qint64 MappedTraceFile::memoryUsage() const
+{
+    return qint64(sizeof(MappedTraceFile)) + qint64(m_offsets.capacity()) * qint64(sizeof(qint64));
+}
@@ -0,0 +1,254 @@
+#include "inc/overloadpolicy.h"
+#include "inc/constants.h"
+#include "inc/tracedictionary.h"
+#include <QSettings>
+#include <QTemporaryFile>
+#include <QDir>
+#include <QtEndian>
+#include <QDebug>
+
+namespace
+{
+const int DEFAULT_MAX_PENDING_LINES = 2000000;
+const int MIN_PENDING_LINES = 1000;
+// Header of a spilled line: timestamp, size, source id, encoding
+const int SPILL_HEADER_SIZE = 8 + 4 + 2 + 1;
+
+const QHash<QString, OverloadPolicy::Mode> MODES = {
+    { "unbounded",  OverloadPolicy::Unbounded },
+    { "dropOldest", OverloadPolicy::DropOldest },
+    { "spill",      OverloadPolicy::SpillToDisk },
+};
+}
+
+OverloadPolicy::OverloadPolicy()
+{
+    QSettings settings(Config::CONFIG_DIR, QSettings::IniFormat);
+    m_mode = MODES.value(settings.value(Config::OVERLOAD_POLICY, "dropOldest").toString(), DropOldest);
+    m_maxPendingLines = qMax(settings.value(Config::MAX_PENDING_LINES, DEFAULT_MAX_PENDING_LINES).toInt(),
+                             MIN_PENDING_LINES);
+    m_printSampling = qMax(settings.value(Config::PRINT_SAMPLING, 1).toInt(), 1);
+}
+
+OverloadPolicy::~OverloadPolicy()
+{
+    QSettings settings(Config::CONFIG_DIR, QSettings::IniFormat);
+    settings.setValue(Config::OVERLOAD_POLICY, MODES.key(m_mode));
+    settings.setValue(Config::MAX_PENDING_LINES, m_maxPendingLines);
+    settings.setValue(Config::PRINT_SAMPLING, m_printSampling);
+
+    m_spillReader.close();
+    delete m_spillFile; // Removes the file
+    m_spillFile = nullptr;
+}
+
+///
+/// \brief OverloadPolicy::enqueue
+///        Queue a new line for the view, or act on it if the queue is overloaded
+/// \param pending queue of the lines waiting for the view
+/// \param line
+///
+void OverloadPolicy::enqueue(QQueue<TraceLine>& pending, const TraceLine& line)
+{
+    forgetTakenLines(pending);
+    if (m_printSampling > 1 && pending.size() + m_stats.linesOnDisk >= m_maxPendingLines / 2 &&
+        levelOf(line) == PrintLevel)
+    {
+        if (m_printCount++ % quint64(m_printSampling) != 0)
+        {
+            ++m_stats.sampledLines;
+            return;
+        }
+    }
+
+    // Once spilling, the lines go to disk until it is read back, to keep the order
+    if (m_mode == SpillToDisk && (m_stats.linesOnDisk > 0 || pending.size() >= m_maxPendingLines))
+    {
+        if (spill(line))
+        {
+            return;
+        }
+    }
+
+    pending.enqueue(line);
+    if (m_mode == DropOldest && pending.size() > m_maxPendingLines)
+    {
+        trimOldest(pending);
+    }
+    m_queueSize = pending.size();
+}
+
+///
+/// \brief OverloadPolicy::refill
+///        Read the spilled lines back once the view has taken enough of the queue
+/// \param pending queue of the lines waiting for the view
+///
+void OverloadPolicy::refill(QQueue<TraceLine>& pending)
+{
+    forgetTakenLines(pending);
+    if (m_stats.linesOnDisk == 0 || pending.size() >= m_maxPendingLines / 2)
+    {
+        return;
+    }
+
+    m_spillFile->flush();
+    TraceLine line;
+    while (m_stats.linesOnDisk > 0 && pending.size() < m_maxPendingLines)
+    {
+        if (!readSpilled(line))
+        {
+            qDebug() << "Read spill file failed" << m_spillReader.errorString();
+            m_stats.droppedLines += quint64(m_stats.linesOnDisk);
+            m_stats.linesOnDisk = 0;
+            break;
+        }
+        pending.enqueue(line);
+        --m_stats.linesOnDisk;
+    }
+    m_queueSize = pending.size();
+
+    if (m_stats.linesOnDisk == 0)
+    {
+        // Everything is read back, start the file over
+        m_spillFile->resize(0);
+        m_spillFile->seek(0);
+        m_spillReader.seek(0);
+    }
+}
+
+///
+/// \brief OverloadPolicy::levelOf
+///        Same levels as the default highlighting rules
+/// \param line
+/// \return the priority of the line
+///
+OverloadPolicy::Level OverloadPolicy::levelOf(const TraceLine& line)
+{
+    if (line.encoding == TraceLine::Binary)
+    {
+        if (line.size < TraceDictionary::RECORD_HEADER_SIZE)
+        {
+            return OtherLevel;
+        }
+        QString level = TraceDictionary::instance().level(qFromLittleEndian<quint32>(line.data()));
+        if (level == "ERROR" || level == "PANIC")
+        {
+            return ProtectedLevel;
+        }
+        return level == "PRINT" ? PrintLevel : OtherLevel;
+    }
+
+    const QByteArray text = line.text();
+    if (text.contains(" ERROR - ") || text.contains(" PANIC - "))
+    {
+        return ProtectedLevel;
+    }
+    return text.contains(" PRINT - ") ? PrintLevel : OtherLevel;
+}
+
+///
+/// \brief OverloadPolicy::trimOldest
+///        Drop the oldest lines down to 3/4 of the maximum, so that the queue is not
+///        trimmed at every new line. The ERROR/PANIC lines among them are kept at the
+///        front of the queue, where the next trims skip them.
+/// \param pending
+///
+void OverloadPolicy::trimOldest(QQueue<TraceLine>& pending)
+{
+    int toRemove = pending.size() - m_maxPendingLines * 3 / 4;
+    int kept = m_keptLines;
+    int next = kept;
+    for (; next < pending.size() && toRemove > 0; ++next)
+    {
+        if (levelOf(pending.at(next)) == ProtectedLevel)
+        {
+            // Moved before the dropped lines, in order
+            if (next != kept)
+            {
+                std::swap(pending[kept], pending[next]);
+            }
+            pending[kept].detach();
+            ++kept;
+            ++m_stats.protectedLines;
+        }
+        else
+        {
+            --toRemove;
+            ++m_stats.droppedLines;
+        }
+    }
+    pending.erase(pending.begin() + kept, pending.begin() + next);
+    m_keptLines = kept;
+}
+
+///
+/// \brief OverloadPolicy::forgetTakenLines
+///        The view takes the lines from the front of the queue, the kept ERROR/PANIC
+///        lines first
+/// \param pending
+///
+void OverloadPolicy::forgetTakenLines(const QQueue<TraceLine>& pending)
+{
+    m_keptLines = qMax(0, m_keptLines - (m_queueSize - pending.size()));
+    m_queueSize = pending.size();
+}
+
+///
+/// \brief OverloadPolicy::spill
+///        Append the line to the spill file, created at the first use
+/// \param line
+/// \return false if the line cannot be written, it is then queued
+///
+bool OverloadPolicy::spill(const TraceLine& line)
+{
+    if (!m_spillFile)
+    {
+        m_spillFile = new QTemporaryFile(QDir::tempPath() + "/TraceTerminalPlus-spill-XXXXXX");
+        if (!m_spillFile->open())
+        {
+            qDebug() << "Create spill file failed" << m_spillFile->errorString();
+            delete m_spillFile;
+            m_spillFile = nullptr;
+            m_mode = DropOldest;
+            return false;
+        }
+        m_spillReader.setFileName(m_spillFile->fileName());
+        m_spillReader.open(QIODevice::ReadOnly);
+    }
+
+    m_spillRecord.resize(SPILL_HEADER_SIZE);
+    char* header = m_spillRecord.data();
+    qToLittleEndian<qint64>(line.timestamp, header);
+    qToLittleEndian<quint32>(quint32(line.size), header + 8);
+    qToLittleEndian<quint16>(line.sourceId, header + 12);
+    header[14] = char(line.encoding);
+    m_spillRecord.append(line.data(), line.size);
+    if (m_spillFile->write(m_spillRecord) != m_spillRecord.size())
+    {
+        qDebug() << "Write spill file failed" << m_spillFile->errorString();
+        return false;
+    }
+    ++m_stats.spilledLines;
+    ++m_stats.linesOnDisk;
+    return true;
+}
+
+///
+/// \brief OverloadPolicy::readSpilled
+/// \param line the next spilled line
+/// \return false if nothing can be read
+///
+bool OverloadPolicy::readSpilled(TraceLine& line)
+{
+    char header[SPILL_HEADER_SIZE];
+    if (m_spillReader.read(header, SPILL_HEADER_SIZE) != SPILL_HEADER_SIZE)
+    {
+        return false;
+    }
+    line.timestamp = qFromLittleEndian<qint64>(header);
+    int size = int(qFromLittleEndian<quint32>(header + 8));
+    line.sourceId = qFromLittleEndian<quint16>(header + 12);
+    line.encoding = TraceLine::Encoding(header[14]);
+    line.setText(m_spillReader.read(size));
+    return line.size == size;
+}
@@ -145,9 +145,9 @@ bool SearchDock::isLoopSearchChecked() const
     return m_loopCheck->isChecked();
 }
 
-void SearchDock::addAdvSearchResult(QTextCursor& cursor)
+void SearchDock::addAdvSearchResult(const TextRange& match, const QString& lineText)
 {
-    auto item = new AdvancedSearchItem(cursor);
+    auto item = new AdvancedSearchItem(match, lineText);
     m_advSearchList->addItem(item);
 }
 
@@ -163,8 +163,8 @@ void SearchDock::clearAdvSearchList()
 
 void SearchDock::onResultDoubleClicked(QListWidgetItem* item)
 {
-    const auto cursor = item->data(Qt::UserRole).value<QTextCursor>();
-    emit searchResultSelected(cursor);
+    const auto match = item->data(Qt::UserRole).value<TextRange>();
+    emit searchResultSelected(match);
 }
 
 void SearchDock::show(bool advanced)
@@ -0,0 +1,129 @@
+#include "inc/serialreceiver.h"
+#include "inc/slabring.h"
+#include "inc/traceclock.h"
+#include <QSerialPort>
+#include <QTimer>
+#include <QDebug>
+
+namespace
+{
+const int READ_CHUNK_SIZE = 64 * 1024;
+// Bound of the QSerialPort buffer, about 13 s of data at 12 Mbaud if this thread stalls
+const int PORT_READ_BUFFER_SIZE = 16 * 1024 * 1024;
+const int BATCH_SIZE = 16 * 1024;
+const int BATCH_DELAY = 2;
+}
+
+SerialReceiver::SerialReceiver(SlabRing* ring, QObject* parent)
+    : TraceReceiver(ring, parent)
+{
+    m_buffer.resize(READ_CHUNK_SIZE);
+
+    // Child of the receiver, moved to the receive thread with it
+    m_flushTimer = new QTimer(this);
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_flushTimer, &QTimer::timeout, this, &SerialReceiver::flushBatch);
+}
+
+SerialReceiver::~SerialReceiver()
+{
+    close();
+}
+
+///
+/// \brief SerialReceiver::open
+///        Any baud rate supported by the driver can be set, e.g. 3 or 12 Mbaud for USB-CDC.
+///        A pseudo-terminal can be opened as well, the line settings are then ignored.
+/// \param endpoint
+/// \return true if the port is opened
+///
+bool SerialReceiver::open(const IngestEndpoint& endpoint)
+{
+    close();
+    m_errorString.clear();
+
+    m_serial = new QSerialPort(this);
+    m_serial->setPortName(endpoint.address);
+    m_serial->setBaudRate(endpoint.baudRate);
+    m_serial->setDataBits(QSerialPort::Data8);
+    m_serial->setStopBits(QSerialPort::OneStop);
+    m_serial->setParity(QSerialPort::NoParity);
+    m_serial->setReadBufferSize(PORT_READ_BUFFER_SIZE);
+    if (!m_serial->open(QIODevice::ReadOnly))
+    {
+        m_errorString = m_serial->errorString();
+        close();
+        return false;
+    }
+    m_serial->setDataTerminalReady(true); // Enables DTR line when opened, and leaves it on
+    m_serial->setRequestToSend(true);     // Enables RTS line when opened, and leaves it on
+    if (m_serial->baudRate() != endpoint.baudRate)
+    {
+        qDebug() << "Baud rate" << endpoint.baudRate << "not applied on" << endpoint.address;
+    }
+
+    m_continued = false;
+    connect(m_serial, &QSerialPort::readyRead, this, &SerialReceiver::onReadyRead);
+    return true;
+}
+
+///
+/// \brief SerialReceiver::close
+///
+void SerialReceiver::close()
+{
+    flushBatch();
+    if (m_serial)
+    {
+        if (m_serial->isOpen())
+        {
+            m_serial->close();
+        }
+        delete m_serial;
+        m_serial = nullptr;
+    }
+}
+
+///
+/// \brief slot to drain the port into the ring. The data is published once a batch
+///        is gathered, or BATCH_DELAY ms after the first unpublished read
+///
+void SerialReceiver::onReadyRead()
+{
+    IngestRecord record;
+    record.timestamp = TraceClock::nowNs();
+    qint64 size = 0;
+    while ((size = m_serial->read(m_buffer.data(), m_buffer.size())) > 0)
+    {
+        record.flags = m_continued ? IngestRecord::Continued : 0;
+        m_ring->write(record, m_buffer.constData(), int(size));
+        m_continued = true;
+        m_pendingBytes += int(size);
+        m_receivedDatagrams.fetchAndAddRelaxed(1);
+        m_receivedBytes.fetchAndAddRelaxed(quint64(size));
+    }
+
+    if (m_pendingBytes >= BATCH_SIZE)
+    {
+        flushBatch();
+    }
+    else if (m_pendingBytes > 0 && !m_flushTimer->isActive())
+    {
+        m_flushTimer->start(BATCH_DELAY);
+    }
+}
+
+///
+/// \brief SerialReceiver::flushBatch
+///        Publish the gathered data to trace manager
+///
+void SerialReceiver::flushBatch()
+{
+    m_flushTimer->stop();
+    if (m_pendingBytes > 0)
+    {
+        m_ring->flush();
+        m_pendingBytes = 0;
+    }
+}
@@ -0,0 +1,626 @@
+#include "inc/sessionjournal.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QLockFile>
+#include <QThread>
+#include <QtEndian>
+#include <QDebug>
+#include <array>
+#include <cstring>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+const QString SESSION_PREFIX = QStringLiteral("session-");
+const QString INDEX_FILE_NAME = QStringLiteral("index.bin");
+const QString LOCK_FILE_NAME = QStringLiteral("session.lock");
+const qint64 SEGMENT_SIZE = 64 * 1024 * 1024;
+// Group commit: the lines of an interval are written and synced at once,
+// or as soon as they reach the commit size
+const int COMMIT_INTERVAL = 50;   // ms
+const int COMMIT_SIZE = 4 * 1024 * 1024;
+// Beyond, the writer does not keep up with the capture, the lines are not journaled
+const int MAX_BUFFER_SIZE = 64 * 1024 * 1024;
+const int CHECKPOINT_INTERVAL = 1000;  // ms
+// Checkpoint: magic, segment, offset, lines, closed, then the checksum of the rest
+const quint32 CHECKPOINT_MAGIC = 0x4b434a54;  // "TJCK"
+const int CHECKPOINT_SIZE = 4 + 4 + 8 + 8 + 1 + 4;
+
+///
+/// \brief Helper function
+///        CRC-32 of the data
+/// \param data
+/// \param size
+/// \return checksum
+///
+quint32 checksum(const char* data, qint64 size)
+{
+    static const auto table = []() {
+        std::array<quint32, 256> table;
+        for (quint32 i = 0; i < 256; ++i)
+        {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc & 1) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+            }
+            table[i] = crc;
+        }
+        return table;
+    }();
+
+    quint32 crc = 0xffffffffu;
+    for (qint64 i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ quint8(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffffu;
+}
+
+///
+/// \brief Helper function
+///        Append a record without its checksum
+/// \param records
+/// \param kind
+/// \param sourceId
+/// \param timestamp
+/// \param text
+///
+void appendRecord(QByteArray& records, SessionJournal::RecordKind kind, quint16 sourceId, qint64 timestamp,
+                  const char* text, int size)
+{
+    int offset = records.size();
+    records.resize(offset + SessionJournal::RECORD_HEADER_SIZE + size);
+    char* record = records.data() + offset;
+    qToLittleEndian<quint32>(0, record);
+    qToLittleEndian<quint32>(quint32(size), record + 4);
+    qToLittleEndian<qint64>(timestamp, record + 8);
+    qToLittleEndian<quint16>(sourceId, record + 16);
+    record[18] = char(kind);
+    memcpy(record + SessionJournal::RECORD_HEADER_SIZE, text, size_t(size));
+}
+
+///
+/// \brief Helper function
+///        Fill the checksum of the records
+/// \param records
+///
+void checksumRecords(QByteArray& records)
+{
+    char* data = records.data();
+    for (int offset = 0; offset < records.size(); )
+    {
+        int recordSize = SessionJournal::RECORD_HEADER_SIZE + int(qFromLittleEndian<quint32>(data + offset + 4));
+        qToLittleEndian<quint32>(checksum(data + offset + 4, recordSize - 4), data + offset);
+        offset += recordSize;
+    }
+}
+
+///
+/// \brief Helper function
+///        Write the data of the file through to the disk
+/// \param file
+/// \return false if the data might not be on the disk
+///
+bool syncFile(QFile& file)
+{
+    if (!file.flush())
+    {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+///
+/// \brief Helper function
+/// \param sessionPath
+/// \return true if the session is still written by a running instance
+///
+bool isInUse(const QString& sessionPath)
+{
+    // The lock of an instance which crashed is stale and taken over,
+    // however long the running instances hold theirs
+    QLockFile lock(sessionPath + "/" + LOCK_FILE_NAME);
+    lock.setStaleLockTime(0);
+    return !lock.tryLock(0);
+}
+
+///
+/// \brief Helper function
+/// \param sessionPath
+/// \return true if the session has journaled anything
+///
+bool hasRecords(const QString& sessionPath)
+{
+    QDir dir(sessionPath);
+    for (const auto& segment : dir.entryInfoList({"segment-*.log"}, QDir::Files))
+    {
+        if (segment.size() > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+///
+/// \brief Helper function
+/// \param directory
+/// \return paths of the sessions of the directory, from the oldest
+///
+QStringList sessionPaths(const QString& directory)
+{
+    QDir dir(directory);
+    QStringList paths;
+    for (const auto& session : dir.entryList({SESSION_PREFIX + "*"}, QDir::Dirs | QDir::NoDotAndDotDot,
+                                             QDir::Name))
+    {
+        paths.append(dir.filePath(session));
+    }
+    return paths;
+}
+}
+
+///
+/// \brief SessionJournal::SessionJournal
+/// \param directory where the sessions are kept
+///
+SessionJournal::SessionJournal(const QString& directory)
+    : m_directory(directory)
+{
+}
+
+SessionJournal::~SessionJournal()
+{
+    close();
+}
+
+///
+/// \brief SessionJournal::open
+///        Start a new session, the oldest sessions are removed
+/// \param maxSessionSize size of the session beyond which its oldest segments are removed, 0 is no limit
+/// \param maxSessions sessions kept, with the new one. The sessions which crashed are kept anyway
+/// \return false if the session cannot be written, nothing is journaled then
+///
+bool SessionJournal::open(qint64 maxSessionSize, int maxSessions)
+{
+    QDir dir(m_directory);
+    if (!dir.mkpath("."))
+    {
+        qDebug() << "Cannot create the journal directory" << m_directory;
+        return false;
+    }
+    removeOldSessions(m_directory, maxSessions);
+
+    QString name = SESSION_PREFIX + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss");
+    QString sessionName = name;
+    for (int i = 1; dir.exists(sessionName); ++i)
+    {
+        sessionName = QString("%1-%2").arg(name).arg(i);
+    }
+    if (!dir.mkdir(sessionName))
+    {
+        qDebug() << "Cannot create the journal session" << sessionName;
+        return false;
+    }
+    m_sessionPath = dir.filePath(sessionName);
+
+    m_lockFile = new QLockFile(m_sessionPath + "/" + LOCK_FILE_NAME);
+    m_index.setFileName(m_sessionPath + "/" + INDEX_FILE_NAME);
+    if (!m_lockFile->tryLock(0) || !m_index.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qDebug() << "Cannot open the journal session" << m_sessionPath;
+        close();
+        return false;
+    }
+    m_maxSessionSize = maxSessionSize;
+    if (!openNextSegment())
+    {
+        close();
+        return false;
+    }
+
+    // Reserved, so that the buffers keep their memory when they are emptied
+    m_buffer.reserve(COMMIT_SIZE);
+    m_batch.reserve(COMMIT_SIZE);
+    m_lastCheckpoint.start();
+    m_open = true;
+    m_writer = QThread::create([this]() {
+        write();
+    });
+    m_writer->start();
+    return true;
+}
+
+///
+/// \brief SessionJournal::close
+///        Commit what is left and mark the session closed, so that it is not recovered
+///
+void SessionJournal::close()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        m_open = false;
+        m_closing = true;
+        m_bufferReady.wakeOne();
+    }
+    if (m_writer)
+    {
+        m_writer->wait();
+        delete m_writer;
+        m_writer = nullptr;
+        writeCheckpoint(true);
+        if (m_droppedLines > 0)
+        {
+            qDebug() << "Lines not journaled:" << m_droppedLines;
+        }
+    }
+    m_segment.close();
+    m_index.close();
+    delete m_lockFile;
+    m_lockFile = nullptr;
+}
+
+///
+/// \brief SessionJournal::append
+///        Called by the capture, the lines are only copied, the writer does the rest
+/// \param lines
+///
+void SessionJournal::append(const TraceLines& lines)
+{
+    QMutexLocker lock(&m_mutex);
+    if (!m_open)
+    {
+        return;
+    }
+    for (const auto& line : lines)
+    {
+        if (line.size > MAX_RECORD_SIZE || m_buffer.size() + line.size > MAX_BUFFER_SIZE)
+        {
+            ++m_droppedLines;
+            continue;
+        }
+        appendRecord(m_buffer, RecordKind(line.encoding), line.sourceId, line.timestamp, line.data(), line.size);
+        ++m_bufferLines;
+    }
+    if (m_buffer.size() >= COMMIT_SIZE)
+    {
+        m_bufferReady.wakeOne();
+    }
+}
+
+///
+/// \brief SessionJournal::setSourceName
+///        The name tags the following lines of the source when the session is reopened
+/// \param sourceId
+/// \param name
+///
+void SessionJournal::setSourceName(quint16 sourceId, const QString& name)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_open)
+    {
+        QByteArray text = name.toUtf8().left(MAX_RECORD_SIZE);
+        m_sourceNames[sourceId] = text;
+        appendRecord(m_buffer, SourceName, sourceId, 0, text.constData(), text.size());
+    }
+}
+
+///
+/// \brief SessionJournal::write
+///        Run by the writer thread until the journal is closed
+///
+void SessionJournal::write()
+{
+    QMutexLocker lock(&m_mutex);
+    bool closing = false;
+    while (!closing)
+    {
+        if (!m_closing && m_buffer.size() < COMMIT_SIZE)
+        {
+            // The lines appended meanwhile go out with the same write and sync
+            m_bufferReady.wait(&m_mutex, COMMIT_INTERVAL);
+        }
+        closing = m_closing;
+        m_batch.swap(m_buffer);
+        int lines = m_bufferLines;
+        m_bufferLines = 0;
+        lock.unlock();
+
+        bool committed = m_batch.isEmpty() || commit(m_batch, lines);
+        m_batch.resize(0);
+        if (committed && m_lastCheckpoint.hasExpired(CHECKPOINT_INTERVAL))
+        {
+            committed = writeCheckpoint(false);
+        }
+
+        lock.relock();
+        if (!committed)
+        {
+            // Nothing is journaled anymore, the capture goes on
+            m_open = false;
+            m_droppedLines += quint64(m_bufferLines);
+            m_buffer.resize(0);
+            m_bufferLines = 0;
+            break;
+        }
+    }
+}
+
+///
+/// \brief SessionJournal::commit
+///        Write the batch at the end of the current segment and sync it
+/// \param batch records without their checksum
+/// \param lines in the batch
+/// \return false if the journal cannot be written
+///
+bool SessionJournal::commit(QByteArray& batch, int lines)
+{
+    checksumRecords(batch);
+    if (m_segmentSize >= SEGMENT_SIZE && !openNextSegment())
+    {
+        return false;
+    }
+    if (m_segment.write(batch) != batch.size() || !syncFile(m_segment))
+    {
+        qDebug() << "Cannot write the journal" << m_segment.fileName() << m_segment.errorString();
+        return false;
+    }
+    m_segmentSize += batch.size();
+    m_sessionSize += batch.size();
+    m_lines += lines;
+    return true;
+}
+
+///
+/// \brief SessionJournal::openNextSegment
+///        The current segment is complete, its end is checkpointed
+/// \return false if the segment cannot be created
+///
+bool SessionJournal::openNextSegment()
+{
+    if (m_segment.isOpen())
+    {
+        if (!writeCheckpoint(false))
+        {
+            return false;
+        }
+        m_segment.close();
+    }
+
+    ++m_segmentNumber;
+    m_segmentSize = 0;
+    m_segment.setFileName(m_sessionPath + "/" + segmentFileName(m_segmentNumber));
+    if (!m_segment.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "Cannot create the journal segment" << m_segment.fileName() << m_segment.errorString();
+        return false;
+    }
+    removeOldSegments();
+
+    // The segment does not depend on the older ones, which may be removed
+    QByteArray names;
+    {
+        QMutexLocker lock(&m_mutex);
+        for (auto it = m_sourceNames.constBegin(); it != m_sourceNames.constEnd(); ++it)
+        {
+            appendRecord(names, SourceName, it.key(), 0, it.value().constData(), it.value().size());
+        }
+    }
+    checksumRecords(names);
+    if (m_segment.write(names) != names.size())
+    {
+        qDebug() << "Cannot write the journal" << m_segment.fileName() << m_segment.errorString();
+        return false;
+    }
+    m_segmentSize += names.size();
+    m_sessionSize += names.size();
+    return true;
+}
+
+///
+/// \brief SessionJournal::writeCheckpoint
+///        The records until the end of the current segment are synced
+/// \param closed
+/// \return false if the index cannot be written
+///
+bool SessionJournal::writeCheckpoint(bool closed)
+{
+    if (!m_index.isOpen())
+    {
+        return false;
+    }
+    char checkpoint[CHECKPOINT_SIZE];
+    qToLittleEndian<quint32>(CHECKPOINT_MAGIC, checkpoint);
+    qToLittleEndian<qint32>(m_segmentNumber, checkpoint + 4);
+    qToLittleEndian<qint64>(m_segmentSize, checkpoint + 8);
+    qToLittleEndian<qint64>(m_lines, checkpoint + 16);
+    checkpoint[24] = closed ? 1 : 0;
+    qToLittleEndian<quint32>(checksum(checkpoint, CHECKPOINT_SIZE - 4), checkpoint + CHECKPOINT_SIZE - 4);
+
+    m_lastCheckpoint.restart();
+    if (m_index.write(checkpoint, CHECKPOINT_SIZE) != CHECKPOINT_SIZE || !syncFile(m_index))
+    {
+        qDebug() << "Cannot write the journal index" << m_index.fileName() << m_index.errorString();
+        return false;
+    }
+    return true;
+}
+
+///
+/// \brief SessionJournal::removeOldSegments
+///        Keep the session within its size, from the oldest segment. The current one is kept
+///
+void SessionJournal::removeOldSegments()
+{
+    while (m_maxSessionSize > 0 && m_sessionSize > m_maxSessionSize && m_firstSegment < m_segmentNumber)
+    {
+        QFile segment(m_sessionPath + "/" + segmentFileName(m_firstSegment++));
+        m_sessionSize -= segment.size();
+        segment.remove();
+    }
+}
+
+///
+/// \brief SessionJournal::removeOldSessions
+///        Make room for a new session. The sessions which crashed are kept until they are
+///        closed by their recovery, and the sessions in use by another instance are kept
+/// \param directory
+/// \param maxSessions
+///
+void SessionJournal::removeOldSessions(const QString& directory, int maxSessions)
+{
+    QStringList sessions = sessionPaths(directory);
+    int excess = sessions.size() - qMax(maxSessions - 1, 0);
+    for (int i = 0; i < sessions.size() && excess > 0; ++i)
+    {
+        Checkpoint checkpoint;
+        bool closed = lastCheckpoint(sessions[i], checkpoint) && checkpoint.closed;
+        if ((!closed && hasRecords(sessions[i])) || isInUse(sessions[i]))
+        {
+            continue;
+        }
+        if (QDir(sessions[i]).removeRecursively())
+        {
+            --excess;
+        }
+    }
+}
+
+///
+/// \brief SessionJournal::crashedSessions
+///        Sessions which were not closed, by an instance which is not running anymore
+/// \param directory
+/// \return paths of the sessions, from the oldest
+///
+QStringList SessionJournal::crashedSessions(const QString& directory)
+{
+    QStringList crashed;
+    for (const auto& session : sessionPaths(directory))
+    {
+        Checkpoint checkpoint;
+        if ((lastCheckpoint(session, checkpoint) && checkpoint.closed) || !hasRecords(session) ||
+            isInUse(session))
+        {
+            continue;
+        }
+        crashed.append(session);
+    }
+    return crashed;
+}
+
+///
+/// \brief SessionJournal::markClosed
+///        The session is not recovered anymore, it is removed with the old sessions
+/// \param sessionPath
+///
+void SessionJournal::markClosed(const QString& sessionPath)
+{
+    Checkpoint checkpoint;
+    lastCheckpoint(sessionPath, checkpoint);
+    char data[CHECKPOINT_SIZE];
+    qToLittleEndian<quint32>(CHECKPOINT_MAGIC, data);
+    qToLittleEndian<qint32>(checkpoint.segment, data + 4);
+    qToLittleEndian<qint64>(checkpoint.offset, data + 8);
+    qToLittleEndian<qint64>(checkpoint.lines, data + 16);
+    data[24] = 1;
+    qToLittleEndian<quint32>(checksum(data, CHECKPOINT_SIZE - 4), data + CHECKPOINT_SIZE - 4);
+
+    QFile index(sessionPath + "/" + INDEX_FILE_NAME);
+    if (!index.open(QIODevice::ReadWrite))
+    {
+        qDebug() << "Cannot close the journal session" << sessionPath << index.errorString();
+        return;
+    }
+    // After the last complete checkpoint, a torn one is overwritten
+    index.seek(index.size() - index.size() % CHECKPOINT_SIZE);
+    index.write(data, CHECKPOINT_SIZE);
+}
+
+///
+/// \brief SessionJournal::lastCheckpoint
+///        The last checkpoint of the index which is complete and not corrupted
+/// \param sessionPath
+/// \param checkpoint unchanged if there is none
+/// \return false if there is none
+///
+bool SessionJournal::lastCheckpoint(const QString& sessionPath, Checkpoint& checkpoint)
+{
+    QFile index(sessionPath + "/" + INDEX_FILE_NAME);
+    if (!index.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    QByteArray data = index.readAll();
+    for (int offset = data.size() - data.size() % CHECKPOINT_SIZE - CHECKPOINT_SIZE; offset >= 0;
+         offset -= CHECKPOINT_SIZE)
+    {
+        const char* record = data.constData() + offset;
+        if (qFromLittleEndian<quint32>(record) != CHECKPOINT_MAGIC ||
+            qFromLittleEndian<quint32>(record + CHECKPOINT_SIZE - 4) != checksum(record, CHECKPOINT_SIZE - 4))
+        {
+            continue;
+        }
+        checkpoint.segment = qFromLittleEndian<qint32>(record + 4);
+        checkpoint.offset = qFromLittleEndian<qint64>(record + 8);
+        checkpoint.lines = qFromLittleEndian<qint64>(record + 16);
+        checkpoint.closed = record[24] != 0;
+        return true;
+    }
+    return false;
+}
+
+///
+/// \brief SessionJournal::parseRecord
+/// \param data
+/// \param available bytes from data
+/// \param verify the checksum of the record, the records before the last checkpoint are synced
+/// \param record
+/// \return size of the record, 0 if it is not complete, -1 if it is corrupted
+///
+int SessionJournal::parseRecord(const char* data, qint64 available, bool verify, Record& record)
+{
+    if (available < RECORD_HEADER_SIZE)
+    {
+        return 0;
+    }
+    quint32 size = qFromLittleEndian<quint32>(data + 4);
+    if (size > quint32(MAX_RECORD_SIZE))
+    {
+        return -1;
+    }
+    int recordSize = RECORD_HEADER_SIZE + int(size);
+    if (available < recordSize)
+    {
+        return 0;
+    }
+    if (verify && qFromLittleEndian<quint32>(data) != checksum(data + 4, recordSize - 4))
+    {
+        return -1;
+    }
+    record.kind = RecordKind(quint8(data[18]));
+    record.sourceId = qFromLittleEndian<quint16>(data + 16);
+    record.timestamp = qFromLittleEndian<qint64>(data + 8);
+    record.text = data + RECORD_HEADER_SIZE;
+    record.size = int(size);
+    return recordSize;
+}
+
+///
+/// \brief SessionJournal::segmentFileName
+/// \param number
+/// \return name of the segment file in its session
+///
+QString SessionJournal::segmentFileName(int number)
+{
+    return QString("segment-%1.log").arg(number, 6, 10, QChar('0'));
+}
@@ -0,0 +1,118 @@
+#include "inc/slabring.h"
+#include <QtMath>
+
+SlabRing::SlabRing(int slabCount, int slabCapacity)
+    : m_slabCount(int(qNextPowerOfTwo(quint32(qMax(slabCount, 2) - 1))))
+    , m_slabCapacity(alignedSize(qMax(slabCapacity, HEADER_SIZE * 2)))
+    , m_mask(quint32(m_slabCount - 1))
+{
+    m_storage = new char[size_t(m_slabCount) * size_t(m_slabCapacity)];
+    m_used.resize(m_slabCount);
+}
+
+SlabRing::~SlabRing()
+{
+    delete[] m_storage;
+}
+
+///
+/// \brief SlabRing::write
+///        Pack a record in the open slab. A record larger than the space left is split
+///        over the next slabs, in which case every piece has its own header.
+///        The record is either written completely or dropped.
+/// \param record header of the record, the size is set from the payload
+/// \param data payload
+/// \param size payload size
+/// \return false if the ring has no room for the record
+///
+bool SlabRing::write(const IngestRecord& record, const char* data, int size)
+{
+    if (size <= 0)
+    {
+        return true;
+    }
+
+    if (!canWrite(size))
+    {
+        m_overflowRecords.fetchAndAddRelaxed(1);
+        m_overflowBytes.fetchAndAddRelaxed(quint64(size));
+        return false;
+    }
+
+    IngestRecord piece = record;
+    while (size > 0)
+    {
+        if (!m_open || m_slabCapacity - m_writeOffset <= HEADER_SIZE)
+        {
+            openSlab();
+        }
+        int pieceSize = qMin(size, m_slabCapacity - m_writeOffset - HEADER_SIZE);
+        piece.size = quint32(pieceSize);
+
+        char* dest = slab(m_head.loadRelaxed()) + m_writeOffset;
+        memcpy(dest, &piece, sizeof(piece));
+        memcpy(dest + HEADER_SIZE, data, size_t(pieceSize));
+        m_writeOffset = qMin(m_writeOffset + alignedSize(HEADER_SIZE + pieceSize), m_slabCapacity);
+
+        data += pieceSize;
+        size -= pieceSize;
+        piece.flags |= IngestRecord::Continued;
+    }
+    m_writtenRecords.fetchAndAddRelaxed(1);
+    return true;
+}
+
+///
+/// \brief SlabRing::canWrite
+///        Producers which can wait, e.g. stream sockets, check it before reading
+///        so that the sender is slowed down instead of the data being dropped
+/// \param size payload size
+/// \return true if a record of that size fits in the ring now
+///
+bool SlabRing::canWrite(int size) const
+{
+    int freeSlabs = m_slabCount - int(m_head.loadRelaxed() - m_tail.loadAcquire()) - (m_open ? 1 : 0);
+    return neededSlabs(size) <= freeSlabs;
+}
+
+///
+/// \brief SlabRing::neededSlabs
+/// \param size payload size
+/// \return number of slabs to open for a record of that size
+///
+int SlabRing::neededSlabs(int size) const
+{
+    const int maxPayload = m_slabCapacity - HEADER_SIZE;
+    int spaceInOpenSlab = m_open ? m_slabCapacity - m_writeOffset - HEADER_SIZE : 0;
+    int remaining = size - qMax(spaceInOpenSlab, 0);
+    return remaining > 0 ? (remaining + maxPayload - 1) / maxPayload : 0;
+}
+
+///
+/// \brief SlabRing::flush
+///        Publish the open slab to the consumer
+///
+void SlabRing::flush()
+{
+    if (!m_open)
+    {
+        return;
+    }
+    quint32 head = m_head.loadRelaxed();
+    m_used[int(head & m_mask)] = m_writeOffset;
+    m_head.storeRelease(head + 1);
+    m_open = false;
+    m_writeOffset = 0;
+}
+
+///
+/// \brief SlabRing::openSlab
+///        Publish the full slab, if any, and start writing in the next one.
+///        The caller has checked that a free slab is available.
+///
+void SlabRing::openSlab()
+{
+    flush();
+    m_open = true;
+    m_writeOffset = 0;
+}
@@ -0,0 +1,438 @@
+#include "inc/streamreceiver.h"
+#include "inc/traceclock.h"
+#include <QDebug>
+#include <QTimer>
+#include <QThread>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+namespace
+{
+const int READ_CHUNK_SIZE = 64 * 1024;
+// Bound of the socket buffer, beyond it the flow control slows the sender down
+const int SOCKET_READ_BUFFER_SIZE = 4 * 1024 * 1024;
+const int BATCH_SIZE = 16 * 1024;
+const int BATCH_DELAY = 2;
+const int RING_FULL_RETRY_DELAY = 1;
+const int MAX_CONNECTIONS = 64;
+const int RING_SLAB_COUNT = 256;
+const int RING_SLAB_CAPACITY = 64 * 1024;
+}
+
+///
+/// \brief The TcpListener class hands the accepted sockets over to the stream receiver,
+///        before any QTcpSocket is created in the listener thread
+///
+class TcpListener : public QTcpServer
+{
+public:
+    explicit TcpListener(StreamReceiver* receiver)
+        : QTcpServer(receiver)
+        , m_receiver(receiver)
+    {
+    }
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override
+    {
+        m_receiver->addConnection(socketDescriptor);
+    }
+
+private:
+    StreamReceiver* m_receiver;
+};
+
+///
+/// \brief The LocalListener class hands the accepted local sockets over to the stream receiver
+///
+class LocalListener : public QLocalServer
+{
+public:
+    explicit LocalListener(StreamReceiver* receiver)
+        : QLocalServer(receiver)
+        , m_receiver(receiver)
+    {
+    }
+
+protected:
+    void incomingConnection(quintptr socketDescriptor) override
+    {
+        m_receiver->addConnection(qintptr(socketDescriptor));
+    }
+
+private:
+    StreamReceiver* m_receiver;
+};
+
+///
+/// \brief Helper function
+///        Create the socket of an accepted connection in the calling thread
+/// \param type Tcp or Local
+/// \param socketDescriptor
+/// \param parent
+/// \return the socket, or nullptr if the descriptor cannot be used
+///
+static QIODevice* createSocket(IngestEndpoint::Type type, qintptr socketDescriptor, QObject* parent)
+{
+    if (type == IngestEndpoint::Tcp)
+    {
+        auto socket = new QTcpSocket(parent);
+        socket->setReadBufferSize(SOCKET_READ_BUFFER_SIZE);
+        if (socket->setSocketDescriptor(socketDescriptor))
+        {
+            return socket;
+        }
+        delete socket;
+    }
+    else
+    {
+        auto socket = new QLocalSocket(parent);
+        socket->setReadBufferSize(SOCKET_READ_BUFFER_SIZE);
+        if (socket->setSocketDescriptor(quintptr(socketDescriptor)))
+        {
+            return socket;
+        }
+        delete socket;
+    }
+    return nullptr;
+}
+
+StreamConnection::StreamConnection(IngestEndpoint::Type type, qintptr socketDescriptor,
+                                   SlabRing* ring, StreamReceiver* owner)
+    : m_type(type)
+    , m_socketDescriptor(socketDescriptor)
+    , m_ring(ring)
+    , m_owner(owner)
+{
+    m_buffer.resize(READ_CHUNK_SIZE);
+
+    // Child of the connection, moved to the connection thread with it
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &StreamConnection::onTimeout);
+}
+
+///
+/// \brief StreamConnection::open
+///        Take the accepted socket over in the connection thread
+///
+void StreamConnection::open()
+{
+    m_socket = createSocket(m_type, m_socketDescriptor, this);
+    if (!m_socket)
+    {
+        qDebug() << "Accept stream connection failed";
+        m_finished = true;
+        emit finished();
+        return;
+    }
+
+    if (auto tcpSocket = qobject_cast<QTcpSocket*>(m_socket))
+    {
+        // A local socket has no address, its lines are framed apart anyway as it has its own ring
+        Q_IPV6ADDR sender = tcpSocket->peerAddress().toIPv6Address();
+        memcpy(m_record.sender, &sender, sizeof(m_record.sender));
+        m_record.senderPort = tcpSocket->peerPort();
+    }
+    connect(m_socket, &QIODevice::readyRead, this, &StreamConnection::onReadyRead);
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+
+    // Data may have come before the socket was taken over
+    onReadyRead();
+}
+
+///
+/// \brief slot to drain the socket into the ring. The data is published once a batch
+///        is gathered, or BATCH_DELAY ms after the first unpublished read
+///
+void StreamConnection::onReadyRead()
+{
+    if (m_compression == Unknown && !detectCompression())
+    {
+        return;
+    }
+    bool ringFull = m_compression == Lz4 ? readCompressed() : readRaw();
+    if (ringFull)
+    {
+        // Leave the data in the socket until trace manager catches up
+        flushBatch();
+        m_timer->start(RING_FULL_RETRY_DELAY);
+        return;
+    }
+
+    if (m_disconnected)
+    {
+        flushBatch();
+        if (!m_finished)
+        {
+            m_finished = true;
+            emit finished();
+        }
+    }
+    else if (m_pendingBytes >= BATCH_SIZE)
+    {
+        flushBatch();
+    }
+    else if (m_pendingBytes > 0 && !m_timer->isActive())
+    {
+        m_timer->start(BATCH_DELAY);
+    }
+}
+
+///
+/// \brief StreamConnection::detectCompression
+///        The first bytes of the connection tell whether it is compressed
+/// \return false while waiting for enough bytes
+///
+bool StreamConnection::detectCompression()
+{
+    QByteArray magic = m_socket->peek(Lz4FrameDecoder::MAGIC_SIZE);
+    if (magic.size() < Lz4FrameDecoder::MAGIC_SIZE && !m_disconnected)
+    {
+        return false;
+    }
+    m_compression = Lz4FrameDecoder::isFrame(magic.constData(), magic.size()) ? Lz4 : None;
+    return true;
+}
+
+///
+/// \brief StreamConnection::readRaw
+/// \return true if the reading stopped because the ring is full
+///
+bool StreamConnection::readRaw()
+{
+    while (m_socket->bytesAvailable() > 0)
+    {
+        if (!m_ring->canWrite(READ_CHUNK_SIZE))
+        {
+            return true;
+        }
+        qint64 size = m_socket->read(m_buffer.data(), m_buffer.size());
+        if (size <= 0)
+        {
+            break;
+        }
+        m_record.timestamp = TraceClock::nowNs();
+        m_ring->write(m_record, m_buffer.constData(), int(size));
+        m_record.flags |= IngestRecord::Continued;
+        m_pendingBytes += int(size);
+        m_owner->countReceived(quint64(size));
+    }
+    return false;
+}
+
+///
+/// \brief StreamConnection::readCompressed
+///        Decode one block at a time, only when the ring has room for a whole block,
+///        and read more from the socket only when no complete block is buffered
+/// \return true if the reading stopped because the ring is full
+///
+bool StreamConnection::readCompressed()
+{
+    forever
+    {
+        if (!m_ring->canWrite(m_decoder.maxBlockSize()))
+        {
+            return true;
+        }
+
+        const char* output = nullptr;
+        int outputSize = 0;
+        auto status = m_decoder.decodeBlock(output, outputSize);
+        if (status == Lz4FrameDecoder::Decoded)
+        {
+            m_record.timestamp = TraceClock::nowNs();
+            if (!m_ring->write(m_record, output, outputSize))
+            {
+                // Not expected after canWrite(), the next blocks wait for room anyway
+                return true;
+            }
+            m_record.flags |= IngestRecord::Continued;
+            m_pendingBytes += outputSize;
+            continue;
+        }
+        if (status == Lz4FrameDecoder::Error)
+        {
+            // The rest of the connection is shown as it is rather than lost
+            qDebug() << "Invalid compressed stream" << m_decoder.errorString();
+            m_compression = None;
+            return readRaw();
+        }
+
+        if (m_socket->bytesAvailable() <= 0)
+        {
+            return false;
+        }
+        qint64 size = m_socket->read(m_buffer.data(), m_buffer.size());
+        if (size <= 0)
+        {
+            return false;
+        }
+        m_decoder.append(m_buffer.constData(), int(size));
+        m_owner->countReceived(quint64(size));
+    }
+}
+
+///
+/// \brief StreamConnection::onDisconnected
+///        The data still buffered is read before the connection is reported finished
+///
+void StreamConnection::onDisconnected()
+{
+    m_disconnected = true;
+    onReadyRead();
+}
+
+///
+/// \brief StreamConnection::onTimeout
+///        Publish the gathered data, and read what was left while the ring was full
+///
+void StreamConnection::onTimeout()
+{
+    flushBatch();
+    onReadyRead();
+}
+
+///
+/// \brief StreamConnection::flushBatch
+///
+void StreamConnection::flushBatch()
+{
+    m_timer->stop();
+    if (m_pendingBytes > 0)
+    {
+        m_ring->flush();
+        m_pendingBytes = 0;
+    }
+}
+
+StreamReceiver::StreamReceiver(QObject* parent)
+    : TraceReceiver(nullptr, parent)
+{
+}
+
+StreamReceiver::~StreamReceiver()
+{
+    close();
+}
+
+///
+/// \brief StreamReceiver::open
+/// \param endpoint Tcp or Local endpoint
+/// \return true if listening
+///
+bool StreamReceiver::open(const IngestEndpoint& endpoint)
+{
+    close();
+    m_errorString.clear();
+    m_endpoint = endpoint;
+
+    if (endpoint.type == IngestEndpoint::Tcp)
+    {
+        m_tcpServer = new TcpListener(this);
+        if (!m_tcpServer->listen(QHostAddress(endpoint.address), endpoint.port))
+        {
+            m_errorString = m_tcpServer->errorString();
+            close();
+            return false;
+        }
+    }
+    else
+    {
+        // A socket file left by a crashed instance would make listen fail
+        QLocalServer::removeServer(endpoint.address);
+        m_localServer = new LocalListener(this);
+        if (!m_localServer->listen(endpoint.address))
+        {
+            m_errorString = m_localServer->errorString();
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+///
+/// \brief StreamReceiver::close
+///        Stop listening and close all the connections
+///
+void StreamReceiver::close()
+{
+    if (m_tcpServer)
+    {
+        m_tcpServer->close();
+        delete m_tcpServer;
+        m_tcpServer = nullptr;
+    }
+    if (m_localServer)
+    {
+        m_localServer->close();
+        delete m_localServer;
+        m_localServer = nullptr;
+    }
+    while (!m_connections.isEmpty())
+    {
+        removeConnection(m_connections.first()->id);
+    }
+}
+
+///
+/// \brief StreamReceiver::addConnection
+///        Start the thread reading an accepted connection
+/// \param socketDescriptor
+///
+void StreamReceiver::addConnection(qintptr socketDescriptor)
+{
+    if (m_connections.size() >= MAX_CONNECTIONS)
+    {
+        qDebug() << "Too many connections to" << m_endpoint.toString();
+        delete createSocket(m_endpoint.type, socketDescriptor, nullptr);
+        return;
+    }
+
+    auto connection = new Connection;
+    connection->id = ++m_lastConnectionId;
+    connection->ring = new SlabRing(RING_SLAB_COUNT, RING_SLAB_CAPACITY);
+    connection->reader = new StreamConnection(m_endpoint.type, socketDescriptor, connection->ring, this);
+    connection->thread = new QThread;
+    connection->reader->moveToThread(connection->thread);
+    connect(connection->thread, &QThread::started, connection->reader, &StreamConnection::open);
+    connect(connection->thread, &QThread::finished, connection->reader, &QObject::deleteLater);
+    // The connection may be closed already when the queued signal comes, find it by id
+    quint64 id = connection->id;
+    connect(connection->reader, &StreamConnection::finished, this, [=](){
+        removeConnection(id);
+    });
+    m_connections.append(connection);
+
+    emit connectionOpened(connection->ring);
+    connection->thread->start();
+}
+
+///
+/// \brief StreamReceiver::removeConnection
+///        Stop the reader before its ring is released
+/// \param id
+///
+void StreamReceiver::removeConnection(quint64 id)
+{
+    for (int i = 0; i < m_connections.size(); ++i)
+    {
+        if (m_connections[i]->id != id)
+        {
+            continue;
+        }
+        Connection* connection = m_connections.takeAt(i);
+        // The reader is deleted when its thread finishes
+        connection->thread->quit();
+        connection->thread->wait();
+        emit connectionClosed(connection->ring);
+        delete connection->thread;
+        delete connection->ring;
+        delete connection;
+        return;
+    }
+}
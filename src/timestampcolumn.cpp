@@ -0,0 +1,129 @@
+#include "inc/timestampcolumn.h"
+
+///
+/// \brief TimestampColumn::append
+/// \param timestamp
+///
+void TimestampColumn::append(qint64 timestamp)
+{
+    if (m_size % CHECKPOINT_INTERVAL == 0)
+    {
+        m_checkpoints.append({timestamp, m_deltas.size()});
+    }
+    else
+    {
+        quint64 value = zigzag(timestamp - m_last);
+        while (value >= 0x80)
+        {
+            m_deltas.append(char(value | 0x80));
+            value >>= 7;
+        }
+        m_deltas.append(char(value));
+    }
+    m_last = timestamp;
+    ++m_size;
+}
+
+///
+/// \brief TimestampColumn::at
+/// \param index line index, must be valid
+/// \return the timestamp of the line
+///
+qint64 TimestampColumn::at(int index) const
+{
+    Q_ASSERT(index >= 0 && index < m_size);
+    const Checkpoint& checkpoint = m_checkpoints[index / CHECKPOINT_INTERVAL];
+    qint64 timestamp = checkpoint.timestamp;
+    const char* data = m_deltas.constData() + checkpoint.offset;
+    for (int i = index % CHECKPOINT_INTERVAL; i > 0; --i)
+    {
+        timestamp += readDelta(data);
+    }
+    return timestamp;
+}
+
+///
+/// \brief TimestampColumn::resize
+///        Drop the last lines, or pad with value
+/// \param size new number of lines
+/// \param value timestamp of the added lines
+///
+void TimestampColumn::resize(int size, qint64 value)
+{
+    if (size >= m_size)
+    {
+        while (m_size < size)
+        {
+            append(value);
+        }
+        return;
+    }
+    if (size <= 0)
+    {
+        clear();
+        return;
+    }
+
+    // Decode up to the new last line to find where its delta ends
+    const Checkpoint& checkpoint = m_checkpoints[(size - 1) / CHECKPOINT_INTERVAL];
+    qint64 timestamp = checkpoint.timestamp;
+    const char* data = m_deltas.constData() + checkpoint.offset;
+    for (int i = (size - 1) % CHECKPOINT_INTERVAL; i > 0; --i)
+    {
+        timestamp += readDelta(data);
+    }
+    m_deltas.truncate(int(data - m_deltas.constData()));
+    m_checkpoints.resize((size - 1) / CHECKPOINT_INTERVAL + 1);
+    m_size = size;
+    m_last = timestamp;
+}
+
+///
+/// \brief TimestampColumn::removeFirst
+///        The column is encoded again from the first line kept, the lines are
+///        only removed from the start on user request
+/// \param count number of lines to remove
+///
+void TimestampColumn::removeFirst(int count)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    TimestampColumn kept;
+    for (int i = count; i < m_size; ++i)
+    {
+        kept.append(at(i));
+    }
+    *this = kept;
+}
+
+///
+/// \brief TimestampColumn::clear
+///
+void TimestampColumn::clear()
+{
+    m_checkpoints.clear();
+    m_deltas.clear();
+    m_size = 0;
+    m_last = 0;
+}
+
+///
+/// \brief TimestampColumn::readDelta
+/// \param data position of the delta, moved past it
+/// \return the decoded delta
+///
+qint64 TimestampColumn::readDelta(const char*& data)
+{
+    quint64 value = 0;
+    int shift = 0;
+    uchar byte;
+    do
+    {
+        byte = uchar(*data++);
+        value |= quint64(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return unzigzag(value);
+}
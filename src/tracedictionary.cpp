@@ -0,0 +1,329 @@
+#include "inc/tracedictionary.h"
+#include "inc/constants.h"
+#include <QFile>
+#include <QSettings>
+#include <QDebug>
+
+TraceDictionary::TraceDictionary()
+{
+    QSettings settings(Config::CONFIG_DIR, QSettings::IniFormat);
+    QString path = settings.value(Config::DICTIONARY, QString()).toString();
+    if (!path.isEmpty())
+    {
+        QString errorString;
+        if (!load(path, errorString))
+        {
+            qDebug() << "Load trace dictionary failed" << path << errorString;
+        }
+    }
+}
+
+///
+/// \brief TraceDictionary::instance
+/// \return dictionary The only instance of the class, used in the gui thread
+///
+TraceDictionary& TraceDictionary::instance()
+{
+    static TraceDictionary unique;
+    return unique;
+}
+
+///
+/// \brief TraceDictionary::load
+///        Replace the dictionary by the given file. Empty lines and lines starting
+///        with '#' are ignored. The id is decimal or hexadecimal with 0x.
+/// \param path
+/// \param errorString set if the file cannot be loaded
+/// \return true if loaded
+///
+bool TraceDictionary::load(const QString& path, QString& errorString)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        errorString = file.errorString();
+        return false;
+    }
+
+    QHash<quint32, Message> messages;
+    int lineNumber = 0;
+    while (!file.atEnd())
+    {
+        QByteArray line = file.readLine();
+        ++lineNumber;
+        if (line.endsWith('\n'))
+        {
+            line.chop(1);
+        }
+        QByteArray trimmed = line.trimmed();
+        if (trimmed.isEmpty() || trimmed.startsWith('#'))
+        {
+            continue;
+        }
+
+        // The format is the rest of the line, its spaces are kept
+        int idEnd = trimmed.indexOf(' ');
+        int levelEnd = idEnd > 0 ? trimmed.indexOf(' ', idEnd + 1) : -1;
+        bool ok = false;
+        quint32 id = idEnd > 0 ? trimmed.left(idEnd).toUInt(&ok, 0) : 0;
+        if (!ok || levelEnd < 0)
+        {
+            errorString = QString("Invalid message at line %1").arg(lineNumber);
+            return false;
+        }
+        Message message;
+        message.level = QString::fromUtf8(trimmed.mid(idEnd + 1, levelEnd - idEnd - 1));
+        message.segments = parseFormat(trimmed.mid(levelEnd + 1));
+        messages.insert(id, message);
+    }
+
+    QWriteLocker lock(&m_lock);
+    m_messages = messages;
+    m_path = path;
+    return true;
+}
+
+///
+/// \brief TraceDictionary::level
+///        Can be called from any thread
+/// \param id message id
+/// \return level of the message, empty if unknown
+///
+QString TraceDictionary::level(quint32 id) const
+{
+    QReadLocker lock(&m_lock);
+    return m_messages.value(id).level;
+}
+
+///
+/// \brief TraceDictionary::parseFormat
+///        Split a format string once at load, not at every formatted line
+/// \param format printf like format string
+/// \return literal texts and conversions
+///
+QVector<TraceDictionary::Segment> TraceDictionary::parseFormat(const QByteArray& format)
+{
+    QVector<Segment> segments;
+    QByteArray literal;
+    for (int i = 0; i < format.size(); ++i)
+    {
+        if (format[i] != '%')
+        {
+            literal += format[i];
+            continue;
+        }
+        if (i + 1 < format.size() && format[i + 1] == '%')
+        {
+            literal += '%';
+            ++i;
+            continue;
+        }
+
+        // Flags, width and precision are kept, the length is given by the argument size
+        int end = i + 1;
+        while (end < format.size() && strchr("-+ #0123456789.", format[end]) && format[end])
+        {
+            ++end;
+        }
+        QByteArray spec = format.mid(i, end - i);
+        int longCount = 0;
+        while (end < format.size() && strchr("hljztL", format[end]) && format[end])
+        {
+            longCount += format[end] == 'l' ? 1 : (format[end] == 'j' ? 2 : 0);
+            ++end;
+        }
+        if (end >= format.size())
+        {
+            literal += format.mid(i);
+            break;
+        }
+
+        Segment segment;
+        segment.conversion = format[end];
+        switch (segment.conversion)
+        {
+        case 'd':
+        case 'i':
+            segment.argSize = longCount >= 2 ? 8 : 4;
+            segment.text = spec + (segment.argSize == 8 ? "lld" : "d");
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            segment.argSize = longCount >= 2 ? 8 : 4;
+            segment.text = spec + (segment.argSize == 8 ? "ll" : "") + segment.conversion;
+            break;
+        case 'c':
+            segment.argSize = 4;
+            segment.text = spec + "c";
+            break;
+        case 'p':
+            segment.argSize = 4;
+            segment.text = "0x%08x";
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+            segment.argSize = 8;
+            segment.text = spec + segment.conversion;
+            break;
+        case 's':
+            segment.text = spec + "s";
+            break;
+        default:
+            // Not a conversion, shown as it is
+            literal += format.mid(i, end - i + 1);
+            i = end;
+            continue;
+        }
+
+        if (!literal.isEmpty())
+        {
+            Segment text;
+            text.text = literal;
+            segments.append(text);
+            literal.clear();
+        }
+        segments.append(segment);
+        i = end;
+    }
+    if (!literal.isEmpty())
+    {
+        Segment text;
+        text.text = literal;
+        segments.append(text);
+    }
+    return segments;
+}
+
+///
+/// \brief TraceDictionary::format
+///        Build the text of a binary record: "#<id> <level> - <formatted message>",
+///        so that the level is highlighted as in the text traces.
+///        Can be called from any thread
+/// \param record message id, argument size and arguments
+/// \return the text of the record
+///
+QString TraceDictionary::format(const QByteArray& record) const
+{
+    if (record.size() < RECORD_HEADER_SIZE)
+    {
+        return QString("Invalid binary record %1").arg(QString(record.toHex(' ')));
+    }
+    const char* data = record.constData();
+    quint32 id = qFromLittleEndian<quint32>(data);
+    QReadLocker lock(&m_lock);
+    auto message = m_messages.constFind(id);
+    if (message == m_messages.constEnd())
+    {
+        return QString("#%1 ????? - Unknown message, arguments: %2")
+                .arg(id).arg(QString(record.mid(RECORD_HEADER_SIZE).toHex(' ')));
+    }
+
+    QString text = QString("#%1 %2 - ").arg(id).arg(message->level);
+    int offset = RECORD_HEADER_SIZE;
+    const int end = record.size();
+    foreach (const auto& segment, message->segments)
+    {
+        if (!segment.conversion)
+        {
+            text += QString::fromUtf8(segment.text);
+            continue;
+        }
+
+        if (segment.conversion == 's')
+        {
+            int length = offset + 2 <= end ? qFromLittleEndian<quint16>(data + offset) : -1;
+            if (length < 0 || offset + 2 + length > end)
+            {
+                text += "<missing argument>";
+                break;
+            }
+            QByteArray arg(data + offset + 2, length); // Null terminated for asprintf
+            text += QString::asprintf(segment.text.constData(), arg.constData());
+            offset += 2 + length;
+            continue;
+        }
+
+        if (offset + segment.argSize > end)
+        {
+            text += "<missing argument>";
+            break;
+        }
+        if (segment.argSize == 8)
+        {
+            quint64 value = qFromLittleEndian<quint64>(data + offset);
+            if (strchr("fFeEgG", segment.conversion))
+            {
+                double real;
+                memcpy(&real, &value, sizeof(real));
+                text += QString::asprintf(segment.text.constData(), real);
+            }
+            else
+            {
+                text += QString::asprintf(segment.text.constData(), qint64(value));
+            }
+        }
+        else
+        {
+            quint32 value = qFromLittleEndian<quint32>(data + offset);
+            text += QString::asprintf(segment.text.constData(), value);
+        }
+        offset += segment.argSize;
+    }
+    return text;
+}
+
+///
+/// \brief TraceDictionary::lengthHint
+///        Estimate the length of the text of a record without formatting it, e.g. for
+///        the width of a view. Can be called from any thread
+/// \param record message id, argument size and arguments
+/// \param size
+/// \return about the length of format(record)
+///
+int TraceDictionary::lengthHint(const char* record, int size) const
+{
+    // Hexadecimal bytes and the longest integers, the widths of the format are ignored
+    const int hexLength = 3;
+    const int intLength = 11;
+    const int longLength = 20;
+    if (size < RECORD_HEADER_SIZE)
+    {
+        return 24 + size * hexLength;
+    }
+    quint32 id = qFromLittleEndian<quint32>(record);
+    QReadLocker lock(&m_lock);
+    auto message = m_messages.constFind(id);
+    if (message == m_messages.constEnd())
+    {
+        return 48 + (size - RECORD_HEADER_SIZE) * hexLength;
+    }
+
+    // "#<id> <level> - "
+    int length = 4 + intLength + message->level.size();
+    int offset = RECORD_HEADER_SIZE;
+    foreach (const auto& segment, message->segments)
+    {
+        if (!segment.conversion)
+        {
+            length += segment.text.size();
+        }
+        else if (segment.conversion == 's')
+        {
+            int argLength = offset + 2 <= size ? qFromLittleEndian<quint16>(record + offset) : 0;
+            length += argLength;
+            offset += 2 + argLength;
+        }
+        else
+        {
+            length += segment.argSize == 8 ? longLength : intLength;
+            offset += segment.argSize;
+        }
+    }
+    return length;
+}
@@ -1,6 +1,5 @@
 #include "inc\tracehighlighter.h"
 #include "inc/constants.h"
-#include <QTextDocument>
 #include <QDebug>
 #include <QSettings>
 
@@ -11,8 +10,7 @@ static const QString containPattern = QStringLiteral("\\b.*?%1.*(?=\n|$)");
 
 QList<TraceHighlighter::HighlightingRule> TraceHighlighter::highlightingRules = {};
 
-TraceHighlighter::TraceHighlighter(QTextDocument *parent)
-    : QSyntaxHighlighter(parent)
+TraceHighlighter::TraceHighlighter()
 {
     HighlightingRule rule;
     QTextCharFormat format;
@@ -31,16 +29,21 @@ TraceHighlighter::TraceHighlighter(QTextDocument *parent)
 }
 
 ///
-/// \brief TraceHighlighter::highlightBlock override method
-/// \param text
+/// \brief TraceHighlighter::highlight
+/// \param text line to color
+/// \param formats the formats of the rules matching the line are appended, the last ones take precedence
 ///
-void TraceHighlighter::highlightBlock(const QString& text)
+void TraceHighlighter::highlight(const QString& text, QVector<QTextLayout::FormatRange>& formats) const
 {
     foreach (const auto& rule, highlightingRules) {
         QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
         while (matchIterator.hasNext()) {
             QRegularExpressionMatch match = matchIterator.next();
-            setFormat(match.capturedStart(), match.capturedLength(), rule.format);
+            QTextLayout::FormatRange range;
+            range.start = match.capturedStart();
+            range.length = match.capturedLength();
+            range.format = rule.format;
+            formats.append(range);
         }
     }
 }
@@ -0,0 +1,76 @@
+#include "inc/traceloader.h"
+#include <QtConcurrent/QtConcurrentRun>
+
+namespace
+{
+// Parts read ahead of the gui thread
+const int MAX_PENDING_PARTS = 4;
+}
+
+TraceLoader::TraceLoader()
+    : m_freeParts(MAX_PENDING_PARTS)
+{
+}
+
+TraceLoader::~TraceLoader()
+{
+    stop();
+}
+
+///
+/// \brief TraceLoader::start
+///
+void TraceLoader::start()
+{
+    m_loader = QtConcurrent::run(this, &TraceLoader::load);
+}
+
+///
+/// \brief TraceLoader::stop
+///        Cancel the loading and wait for the worker, the parts not taken yet are dropped
+///
+void TraceLoader::stop()
+{
+    m_stop = true;
+    // Wakes the worker up if it waits for a part to be taken
+    m_freeParts.release(MAX_PENDING_PARTS);
+    m_loader.waitForFinished();
+}
+
+///
+/// \brief TraceLoader::handOver
+///        Run by the worker, wait until the gui thread takes a part if too many are pending
+/// \param lines
+/// \param bytesRead
+/// \param size
+/// \return false if the loading is cancelled
+///
+bool TraceLoader::handOver(const LineBlock& lines, qint64 bytesRead, qint64 size)
+{
+    m_freeParts.acquire();
+    if (m_stop)
+    {
+        return false;
+    }
+    QMetaObject::invokeMethod(this, [=]() {
+        m_freeParts.release();
+        emit linesLoaded(lines, bytesRead, size);
+    }, Qt::QueuedConnection);
+    return true;
+}
+
+///
+/// \brief TraceLoader::finish
+///        Run by the worker at the end, unless the loading is cancelled
+/// \param errorString
+///
+void TraceLoader::finish(const QString& errorString)
+{
+    if (m_stop)
+    {
+        return;
+    }
+    QMetaObject::invokeMethod(this, [=]() {
+        emit finished(errorString);
+    }, Qt::QueuedConnection);
+}
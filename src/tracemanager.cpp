@@ -1,23 +1,56 @@
 #include "inc/tracemanager.h"
+#include "inc/slabring.h"
+#include "inc/traceclock.h"
+#include "inc/tracedictionary.h"
+#include "inc/sessionjournal.h"
 #include <QSettings>
-#include <QFile>
 #include <QDebug>
 #include <QThread>
+#include <climits>
+#include <algorithm>
 
 namespace
 {
-const int LOAD_TRACE_TIME = 10;
-const int TRACE_LINE_PER_TIME = 4;
+// One flush per display frame
+const int FRAME_INTERVAL = 16;
+// Part of a frame the view may spend on rendering new traces
+const int FRAME_RENDER_BUDGET = 8;
+const int MIN_LINES_PER_FRAME = 256;
+const int MAX_LINES_PER_FRAME = 100000;
+const int INITIAL_DISPLAY_RATE = 100000;
+// If the view does not acknowledge a batch in this time, send the next one anyway
+const int BATCH_ACK_TIMEOUT = 1000;
+// Reassembly state of a sender silent for that long is released
+const qint64 SENDER_IDLE_TIMEOUT = 60LL * 1000000000;
+const qint64 SENDER_EVICTION_INTERVAL = 5LL * 1000000000;
+const int MAX_SENDERS_PER_SOURCE = 1024;
+}
+
+///
+/// \brief SenderKey::fromRecord
+/// \param record
+/// \return the key of the sender of the record
+///
+SenderKey SenderKey::fromRecord(const IngestRecord& record)
+{
+    SenderKey key;
+    memcpy(&key.high, record.sender, sizeof(key.high));
+    memcpy(&key.low, record.sender + sizeof(key.high), sizeof(key.low));
+    key.port = record.senderPort;
+    return key;
 }
 
 TraceManager::TraceManager()
 {
     m_timer = new QTimer;
     m_timer->moveToThread(&m_sendTraceThread);
-    m_timer->setInterval(LOAD_TRACE_TIME);
+    m_timer->setInterval(FRAME_INTERVAL);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    m_displayRate.storeRelaxed(INITIAL_DISPLAY_RATE);
     connect(&m_sendTraceThread, SIGNAL(started()), m_timer, SLOT(start()));
     connect(&m_sendTraceThread, SIGNAL(finished()), m_timer, SLOT(stop()));
-    connect(m_timer, &QTimer::timeout, this, &TraceManager::processAndSendTraceToViewAsync);
+    // Process in the send trace thread, not in the thread the manager lives in
+    connect(m_timer, &QTimer::timeout, this, &TraceManager::processAndSendTraceToViewAsync, Qt::DirectConnection);
     m_sendTraceThread.start();
 }
 
@@ -25,6 +58,7 @@ TraceManager::~TraceManager()
 {
     m_sendTraceThread.quit();
     m_sendTraceThread.wait();
+    qDeleteAll(m_sources);
 }
 
 ///
@@ -38,13 +72,46 @@ TraceManager& TraceManager::instance()
 }
 
 ///
-/// \brief TraceManager::onNewDataReady
-/// \param raw
+/// \brief TraceManager::onIngestSourceAdded
+///        Consume the ring in the send trace thread, the manager is its only consumer
+/// \param ring
+/// \param sourceId tag of the lines framed from this ring
 ///
-void TraceManager::onNewDataReady(const QByteArray raw)
+void TraceManager::onIngestSourceAdded(SlabRing* ring, quint16 sourceId)
 {
-    // qDebug() << QString(raw);
-    m_rawData += QString(raw);
+    auto source = new IngestSource;
+    source->ring = ring;
+    source->sourceId = sourceId;
+    QMutexLocker lock(&m_mutex);
+    m_sources.append(source);
+}
+
+///
+/// \brief TraceManager::onIngestSourceRemoved
+///        The producer is stopped, what is left in the ring and the partial lines are
+///        taken before the source is removed, e.g. the end of a closed connection.
+///        Once returned, the ring is not accessed anymore and can be released
+/// \param ring
+///
+void TraceManager::onIngestSourceRemoved(SlabRing* ring)
+{
+    QMutexLocker lock(&m_mutex);
+    for (int i = 0; i < m_sources.size(); ++i)
+    {
+        IngestSource* source = m_sources[i];
+        if (source->ring != ring)
+        {
+            continue;
+        }
+        consumeSource(source);
+        for (auto& sender : source->senders)
+        {
+            releaseSender(source, sender);
+        }
+        mergeSourceLines();
+        delete m_sources.takeAt(i);
+        break;
+    }
 }
 
 ///
@@ -61,88 +128,290 @@ void TraceManager::processAndSendTraceToViewAsync()
 
 ///
 /// \brief TraceManager::filterIncompletedFromData
-/// Last incoming data is not always a complete sentence
-///
-/// \param data
+/// Last incoming data is not always a complete sentence, it is kept in the framer
+/// until its line terminator comes. The lines stay in raw bytes, they are only
+/// converted to text when displayed.
 ///
 void TraceManager::filterIncompletedFromRawData()
 {
-    if (m_rawData.isEmpty())
+    qint64 now = TraceClock::nowNs();
+    for (auto source : qAsConst(m_sources))
     {
-        //qDebug() << "Empty incoming data";
-        return;
-    }
+        consumeSource(source);
 
-    QString processedData;
+        if (now - source->lastEviction >= SENDER_EVICTION_INTERVAL ||
+            source->senders.size() > MAX_SENDERS_PER_SOURCE)
+        {
+            evictIdleSenders(source, now);
+        }
 
-    int length = m_rawData.length();
-    // Remove the last \r\n, it introduces a new blank line after apppending text
-    if (m_rawData.endsWith("\r\n"))
-    {
-        processedData = m_rawData.left(length - 2);
-        m_rawData.clear();
+        quint64 overflow = source->ring->overflowRecords();
+        if (overflow != source->reportedOverflow)
+        {
+            qDebug() << "Ingest ring full," << overflow - source->reportedOverflow << "records dropped";
+            source->reportedOverflow = overflow;
+        }
     }
-    else
-    {
-        int idx = m_rawData.lastIndexOf("\r\n");
-        if (idx != -1)
+
+    mergeSourceLines();
+}
+
+///
+/// \brief TraceManager::consumeSource
+///        Frame the records published in the ring of the source, per sender.
+///        A line takes the receive time of the record completing it.
+///        A datagram, or the start of a stream, tells the encoding of the sender until
+///        the next one. Each record of the binary traces is a line.
+/// \param source
+///
+void TraceManager::consumeSource(IngestSource* source)
+{
+    source->ring->consume([source](const IngestRecord& record, const char* payload){
+        Sender& sender = source->senders[SenderKey::fromRecord(record)];
+        sender.lastSeen = record.timestamp;
+        sender.inStream = record.flags & IngestRecord::Continued;
+        int payloadSize = int(record.size);
+        if (!(record.flags & IngestRecord::Continued))
+        {
+            // A record left incomplete by the previous datagram cannot be trusted
+            sender.records.clear();
+            sender.encoding = TraceLine::Text;
+            if (TraceDictionary::isBinaryDatagram(payload, payloadSize))
+            {
+                sender.encoding = TraceLine::Binary;
+                payload += TraceDictionary::MAGIC_SIZE;
+                payloadSize -= TraceDictionary::MAGIC_SIZE;
+            }
+        }
+        // The lines within the record share one copy of it, only a line spanning
+        // several records is copied on its own
+        QByteArray chunk;
+        auto appendLine = [&](const char* data, int size){
+            TraceLine line;
+            if (data >= payload && data + size <= payload + payloadSize)
+            {
+                if (chunk.isNull())
+                {
+                    chunk = QByteArray(payload, payloadSize);
+                }
+                line.chunk = chunk;
+                line.offset = int(data - payload);
+                line.size = size;
+            }
+            else
+            {
+                line.setText(QByteArray(data, size));
+            }
+            line.timestamp = record.timestamp;
+            line.sourceId = source->sourceId;
+            line.encoding = sender.encoding;
+            source->lines.append(line);
+        };
+        if (sender.encoding == TraceLine::Binary)
         {
-            processedData = m_rawData.left(idx);
-            m_rawData = m_rawData.right(length - (idx + 1) - 1);
+            sender.records.feed(payload, payloadSize, appendLine);
         }
         else
         {
-            // Keep m_rawData as it is
+            sender.framer.feed(payload, payloadSize, appendLine);
+        }
+    });
+}
+
+///
+/// \brief TraceManager::releaseSender
+///        The partial line of a sender which is released is sent as it is, not lost
+/// \param source
+/// \param sender
+///
+void TraceManager::releaseSender(IngestSource* source, Sender& sender)
+{
+    QByteArray partial = sender.framer.takePartialLine();
+    if (!partial.isEmpty())
+    {
+        TraceLine line;
+        line.setText(partial);
+        line.timestamp = sender.lastSeen;
+        line.sourceId = source->sourceId;
+        source->lines.append(line);
+    }
+}
+
+///
+/// \brief TraceManager::evictIdleSenders
+///        Release the reassembly state of the senders which went silent, so that the memory
+///        stays bounded when devices come and go. If there are still too many senders,
+///        the least recently seen ones are released too.
+///        The partial line of a released sender is sent as it is, not lost.
+///        A silent binary stream is kept otherwise, its encoding is only told at its start.
+/// \param source
+/// \param now
+///
+void TraceManager::evictIdleSenders(IngestSource* source, qint64 now)
+{
+    source->lastEviction = now;
+
+    qint64 idleBefore = now - SENDER_IDLE_TIMEOUT;
+    bool tooMany = source->senders.size() > MAX_SENDERS_PER_SOURCE;
+    if (tooMany)
+    {
+        QVector<qint64> lastSeen;
+        lastSeen.reserve(source->senders.size());
+        for (auto it = source->senders.cbegin(); it != source->senders.cend(); ++it)
+        {
+            lastSeen.append(it->lastSeen);
         }
+        // Keep the MAX_SENDERS_PER_SOURCE / 2 most recent ones, not to sort again at each record
+        auto nth = lastSeen.begin() + (lastSeen.size() - MAX_SENDERS_PER_SOURCE / 2);
+        std::nth_element(lastSeen.begin(), nth, lastSeen.end());
+        idleBefore = qMax(idleBefore, *nth);
     }
 
-    // Now append processedData into queue
-    if (!processedData.isEmpty())
+    for (auto it = source->senders.begin(); it != source->senders.end(); )
     {
-        QStringList pendingDataArr = processedData.split("\r\n");
-        for (auto& data : pendingDataArr)
+        if (it->lastSeen >= idleBefore || (!tooMany && it->inStream && it->encoding == TraceLine::Binary))
         {
-            // TraceView's search function use ExtraSelection to highlight the keyword, but if the highlighted word
-            // is at the end of line, 'QTextEdit::append' will unexpectedly add highlight also the following lines,
-            // to avoid it, add a space as a workaround
-            // @TODO: Find a better solution
-            data += " ";
-            m_pendingTraces.enqueue(data);
+            ++it;
+            continue;
         }
+        releaseSender(source, *it);
+        it = source->senders.erase(it);
     }
 }
 
-void TraceManager::sendPendingDataToView()
+///
+/// \brief TraceManager::mergeSourceLines
+///        Merge the lines framed from all the sources into one timeline, ordered by
+///        receive time. Each source is already in order, the readers never wait on
+///        each other, only the lines of the current frame are merged here.
+///
+void TraceManager::mergeSourceLines()
 {
-    QStringList tracesToSend;
-    for (int i = 0; i < TRACE_LINE_PER_TIME; ++i)
+    QVector<int> heads(m_sources.size(), 0);
+    forever
     {
-        if (m_pendingTraces.isEmpty())
+        int next = -1;
+        for (int i = 0; i < m_sources.size(); ++i)
+        {
+            const TraceLines& lines = m_sources[i]->lines;
+            if (heads[i] < lines.size() &&
+                (next < 0 || lines[heads[i]].timestamp < m_sources[next]->lines[heads[next]].timestamp))
+            {
+                next = i;
+            }
+        }
+        if (next < 0)
         {
             break;
         }
-        tracesToSend.append(m_pendingTraces.dequeue());
+        const TraceLine& line = m_sources[next]->lines[heads[next]++];
+        if (m_journal)
+        {
+            m_journalLines.append(line);
+        }
+        m_overloadPolicy.enqueue(m_pendingTraces, line);
+    }
+    if (!m_journalLines.isEmpty())
+    {
+        m_journal->append(m_journalLines);
+        m_journalLines.resize(0);
     }
-    if (!tracesToSend.isEmpty())
+
+    for (auto source : qAsConst(m_sources))
     {
-        emit newTracesReady(tracesToSend);
+        source->lines.resize(0);
     }
 }
 
 ///
-/// \brief TraceManager::readFile
-/// \param url
-/// \return
+/// \brief TraceManager::sendPendingDataToView
+///        Coalesce the pending traces into one batch per display frame.
+///        While the view is still rendering the previous batch, the traces are
+///        kept in queue and go out with the next frame.
 ///
-bool TraceManager::readFile(const QString& url, QString& data)
+void TraceManager::sendPendingDataToView()
 {
-    data.clear();
-    QFile file(url);
-    if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+    m_overloadPolicy.refill(m_pendingTraces);
+    if (m_overloadPolicy.stats() != m_lastOverloadStats)
+    {
+        m_lastOverloadStats = m_overloadPolicy.stats();
+        emit overloadStatsChanged(m_lastOverloadStats);
+    }
+
+    int backlog = m_pendingTraces.size();
+    if (backlog != m_lastBacklog)
     {
-        QTextStream in(&file);
-        data = in.readAll();
-        return true;
+        m_lastBacklog = backlog;
+        emit backlogChanged(backlog);
+    }
+
+    if (m_pendingTraces.isEmpty())
+    {
+        return;
+    }
+    if (m_batchInFlight.loadAcquire() && !m_lastBatchTimer.hasExpired(BATCH_ACK_TIMEOUT))
+    {
+        return;
+    }
+
+    int count = qMin(backlog, lineBudgetPerFrame());
+    TraceLines tracesToSend;
+    tracesToSend.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        tracesToSend.append(m_pendingTraces.dequeue());
     }
-    return false;
+
+    m_batchInFlight.storeRelease(true);
+    m_lastBatchTimer.start();
+    emit newTracesReady(tracesToSend);
+}
+
+///
+/// \brief TraceManager::lineBudgetPerFrame
+/// \return number of lines the view can render within the frame budget
+///
+int TraceManager::lineBudgetPerFrame() const
+{
+    qint64 lines = qint64(m_displayRate.loadRelaxed()) * FRAME_RENDER_BUDGET / 1000;
+    return int(qBound<qint64>(MIN_LINES_PER_FRAME, lines, MAX_LINES_PER_FRAME));
+}
+
+///
+/// \brief TraceManager::onTracesDisplayed
+///        Feedback of the view after rendering a batch, adapt the next batch size to it
+/// \param lines number of rendered lines
+/// \param elapsedNs time spent on rendering
+///
+void TraceManager::onTracesDisplayed(int lines, qint64 elapsedNs)
+{
+    if (lines > 0 && elapsedNs > 0)
+    {
+        qint64 measuredRate = qint64(lines) * 1000000000 / elapsedNs;
+        // Smooth the measurement so that a single slow frame does not collapse the budget
+        qint64 rate = (qint64(m_displayRate.loadRelaxed()) * 3 + measuredRate) / 4;
+        m_displayRate.storeRelaxed(int(qBound<qint64>(1, rate, INT_MAX)));
+    }
+    m_batchInFlight.storeRelease(false);
+}
+
+///
+/// \brief TraceManager::backlog
+/// \return number of traces waiting to be sent to the view
+///
+int TraceManager::backlog()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_pendingTraces.size();
+}
+
+///
+/// \brief TraceManager::setJournal
+///        Every framed line is journaled, even those dropped by the overload policy
+/// \param journal nullptr to stop journaling, it can be closed once returned
+///
+void TraceManager::setJournal(SessionJournal* journal)
+{
+    QMutexLocker lock(&m_mutex);
+    m_journal = journal;
 }
@@ -0,0 +1,7 @@
+#include "inc/tracereceiver.h"
+
+TraceReceiver::TraceReceiver(SlabRing* ring, QObject* parent)
+    : QObject(parent)
+    , m_ring(ring)
+{
+}
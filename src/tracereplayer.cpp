@@ -0,0 +1,203 @@
+#include "inc/tracereplayer.h"
+#include "inc/traceclock.h"
+#include <QTimer>
+#include <QDebug>
+#include <cstring>
+#include <climits>
+
+namespace
+{
+const int READ_CHUNK_SIZE = 64 * 1024;
+const int BATCH_SIZE = 16 * 1024;
+const int RING_FULL_RETRY_DELAY = 1;
+// Lines sent before going back to the event loop, to stay responsive when stopped
+const int LINES_PER_STEP = 50000;
+}
+
+TraceReplayer::TraceReplayer(const QString& path, double speed, SlabRing* ring)
+    : m_file(path)
+    , m_speed(speed)
+    , m_ring(ring)
+{
+    m_batch.reserve(BATCH_SIZE + READ_CHUNK_SIZE);
+
+    // Child of the replayer, moved to the replay thread with it
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &TraceReplayer::replay);
+}
+
+///
+/// \brief TraceReplayer::start
+///        Open the file in the replay thread and send the first lines
+///
+void TraceReplayer::start()
+{
+    m_elapsed.start();
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        finish(m_file.errorString());
+        return;
+    }
+    replay();
+}
+
+///
+/// \brief slot to send the lines which are due, until the next line has to wait
+///        for its time or the ring is full
+///
+void TraceReplayer::replay()
+{
+    for (int i = 0; i < LINES_PER_STEP; ++i)
+    {
+        if (!m_hasLine && !nextLine())
+        {
+            flushBatch();
+            if (!m_batch.isEmpty())
+            {
+                m_timer->start(RING_FULL_RETRY_DELAY);
+                return;
+            }
+            finish(m_file.error() != QFileDevice::NoError ? m_file.errorString() : QString());
+            return;
+        }
+
+        if (m_speed != AS_FAST_AS_POSSIBLE && m_lineTimestamp >= 0)
+        {
+            if (m_firstTimestamp < 0)
+            {
+                m_firstTimestamp = m_lineTimestamp;
+            }
+            qint64 dueNs = qint64((m_lineTimestamp - m_firstTimestamp) / m_speed);
+            qint64 waitMs = (dueNs - m_elapsed.nsecsElapsed()) / 1000000;
+            if (waitMs > 0)
+            {
+                flushBatch();
+                m_timer->start(int(qMin<qint64>(waitMs, INT_MAX)));
+                return;
+            }
+        }
+
+        if (m_batch.size() + m_line.size() + 1 > BATCH_SIZE && !m_batch.isEmpty())
+        {
+            flushBatch();
+            if (!m_batch.isEmpty())
+            {
+                // Trace manager lags behind, try again later
+                m_timer->start(RING_FULL_RETRY_DELAY);
+                return;
+            }
+        }
+        m_batch.append(m_line).append('\n');
+        m_hasLine = false;
+        ++m_lines;
+    }
+
+    flushBatch();
+    m_timer->start(m_batch.isEmpty() ? 0 : RING_FULL_RETRY_DELAY);
+}
+
+///
+/// \brief TraceReplayer::nextLine
+///        Take the next line of the file, and its timestamp if the file has them
+/// \return false at the end of the file
+///
+bool TraceReplayer::nextLine()
+{
+    const char* begin = m_input.constData() + m_inputOffset;
+    const char* newline = static_cast<const char*>(memchr(begin, '\n', size_t(m_input.size() - m_inputOffset)));
+    while (!newline && !m_endOfFile)
+    {
+        readChunk();
+        begin = m_input.constData() + m_inputOffset;
+        newline = static_cast<const char*>(memchr(begin, '\n', size_t(m_input.size() - m_inputOffset)));
+    }
+    const char* end = newline ? newline : m_input.constData() + m_input.size();
+    if (!newline && begin == end)
+    {
+        return false;
+    }
+    m_inputOffset = int(end - m_input.constData()) + (newline ? 1 : 0);
+
+    // The first line tells whether the file was saved with the timestamps
+    const char* tab = static_cast<const char*>(memchr(begin, '\t', size_t(end - begin)));
+    if (!m_formatKnown)
+    {
+        m_formatKnown = true;
+        if (tab)
+        {
+            bool ok = tab == begin;
+            if (!ok)
+            {
+                QByteArray(begin, int(tab - begin)).toDouble(&ok);
+            }
+            m_timestamped = ok;
+        }
+    }
+
+    m_lineTimestamp = -1;
+    if (m_timestamped && tab)
+    {
+        bool ok = false;
+        double seconds = QByteArray(begin, int(tab - begin)).toDouble(&ok);
+        if (ok)
+        {
+            m_lineTimestamp = qint64(seconds * 1e9);
+        }
+        begin = tab + 1;
+    }
+    m_line = QByteArray::fromRawData(begin, int(end - begin));
+    m_hasLine = true;
+    return true;
+}
+
+///
+/// \brief TraceReplayer::readChunk
+///        Append the next chunk of the file to the input, dropping what is parsed
+/// \return false at the end of the file
+///
+bool TraceReplayer::readChunk()
+{
+    // m_line may still point in the input, it is always copied to the batch before reading more
+    m_input.remove(0, m_inputOffset);
+    m_inputOffset = 0;
+
+    int size = m_input.size();
+    m_input.resize(size + READ_CHUNK_SIZE);
+    qint64 read = m_file.read(m_input.data() + size, READ_CHUNK_SIZE);
+    m_input.resize(size + int(qMax<qint64>(read, 0)));
+    if (read <= 0)
+    {
+        m_endOfFile = true;
+        return false;
+    }
+    return true;
+}
+
+///
+/// \brief TraceReplayer::flushBatch
+///        Publish the gathered lines, kept if the ring is full
+///
+void TraceReplayer::flushBatch()
+{
+    if (m_batch.isEmpty() || !m_ring->canWrite(m_batch.size()))
+    {
+        return;
+    }
+    IngestRecord record;
+    record.timestamp = TraceClock::nowNs();
+    m_ring->write(record, m_batch.constData(), m_batch.size());
+    m_ring->flush();
+    m_batch.resize(0);
+}
+
+///
+/// \brief TraceReplayer::finish
+/// \param errorString empty if the whole file is replayed
+///
+void TraceReplayer::finish(const QString& errorString)
+{
+    m_file.close();
+    emit finished(m_lines, m_elapsed.nsecsElapsed(), errorString);
+}
@@ -1,5 +1,11 @@
 #include "inc/traceserver.h"
 #include "inc/constants.h"
+#include "inc/udpreceiver.h"
+#include "inc/serialreceiver.h"
+#include "inc/streamreceiver.h"
+#include "inc/tracereplayer.h"
+#include "inc/slabring.h"
+#include "inc/traceclock.h"
 #include <QNetworkDatagram>
 #include <qDebug>
 #include <QSettings>
@@ -9,6 +15,16 @@
 namespace
 {
 const int BINDING_RETRY_TIME = 500;
+const int RING_SLAB_COUNT = 256;
+const int RING_SLAB_CAPACITY = 64 * 1024;
+const int DEFAULT_RECEIVE_BUFFER_SIZE = 8 * 1024 * 1024;
+const int STATS_INTERVAL = 1000;
+#ifdef Q_OS_WIN
+const QString DEFAULT_SERIAL_PORT = QStringLiteral("COM1");
+#else
+const QString DEFAULT_SERIAL_PORT = QStringLiteral("/dev/ttyUSB0");
+#endif
+const qint32 DEFAULT_SERIAL_BAUD_RATE = 115200; // Baud rate for the CAN converter
 }
 
 static QHostAddress toHostAddress(QString& addr, bool& retryOnFail)
@@ -30,7 +46,6 @@ static QHostAddress toHostAddress(QString& addr, bool& retryOnFail)
 
 TraceServer::TraceServer()
     : m_udpSocket(new QUdpSocket(this))
-    , m_serial(new QSerialPort(this))
 {
 #if 0
     foreach(const QHostAddress &laddr, QNetworkInterface::allAddresses())
@@ -60,11 +75,31 @@ TraceServer::TraceServer()
     QSettings settings(Config::CONFIG_DIR, QSettings::IniFormat);
     m_interface = settings.value(Config::INTERFACE, QHostAddress(QHostAddress::Any).toString()).toString();
     m_port = settings.value(Config::PORT, 911).toInt();
+    m_threadedReceive = settings.value(Config::THREADED_RECEIVE, true).toBool();
+    m_endpointSpecs = settings.value(Config::ENDPOINTS, QStringList()).toStringList();
+    m_receiveBufferSize = settings.value(Config::RECEIVE_BUFFER_SIZE, DEFAULT_RECEIVE_BUFFER_SIZE).toInt();
+    m_serialPortName = settings.value(Config::SERIAL_PORT, DEFAULT_SERIAL_PORT).toString();
+    m_serialBaudRate = settings.value(Config::SERIAL_BAUD_RATE, DEFAULT_SERIAL_BAUD_RATE).toInt();
 
     m_timer = new QTimer(this);
     connect(m_timer, &QTimer::timeout, this, &TraceServer::retryRemoteConnecting);
-    // Setup default value serial port
-    configSerialPort();
+    m_statsTimer = new QTimer(this);
+    connect(m_statsTimer, &QTimer::timeout, this, &TraceServer::updateStats);
+
+    // Both receivers write the receive ring, only one of them is open at a time
+    m_localRing = new SlabRing(RING_SLAB_COUNT, RING_SLAB_CAPACITY);
+    m_receiveRing = new SlabRing(RING_SLAB_COUNT, RING_SLAB_CAPACITY);
+    m_serialReceiver = new SerialReceiver(m_receiveRing);
+    m_serialReceiver->moveToThread(&m_receiveThread);
+    connect(&m_receiveThread, &QThread::finished, m_serialReceiver, &QObject::deleteLater);
+    if (m_threadedReceive)
+    {
+        m_udpReceiver = new UdpReceiver(m_receiveRing);
+        m_udpReceiver->setReceiveBufferSize(m_receiveBufferSize);
+        m_udpReceiver->moveToThread(&m_receiveThread);
+        connect(&m_receiveThread, &QThread::finished, m_udpReceiver, &QObject::deleteLater);
+    }
+    m_receiveThread.start();
 }
 
 TraceServer::~TraceServer()
@@ -72,6 +107,11 @@ TraceServer::~TraceServer()
     QSettings settings(Config::CONFIG_DIR, QSettings::IniFormat);
     settings.setValue(Config::INTERFACE, m_interface);
     settings.setValue(Config::PORT, m_port);
+    settings.setValue(Config::THREADED_RECEIVE, m_threadedReceive);
+    settings.setValue(Config::ENDPOINTS, m_endpointSpecs);
+    settings.setValue(Config::RECEIVE_BUFFER_SIZE, m_receiveBufferSize);
+    settings.setValue(Config::SERIAL_PORT, m_serialPortName);
+    settings.setValue(Config::SERIAL_BAUD_RATE, m_serialBaudRate);
 
     if (m_timer->isActive())
     {
@@ -79,6 +119,17 @@ TraceServer::~TraceServer()
     }
     delete m_timer;
     m_timer = nullptr;
+    delete m_statsTimer;
+    m_statsTimer = nullptr;
+
+    stopReplay();
+    closeEndpoints();
+
+    // Receive thread, the receivers are deleted when the thread finishes
+    m_receiveThread.quit();
+    m_receiveThread.wait();
+    m_udpReceiver = nullptr;
+    m_serialReceiver = nullptr;
 
     // UDP socket
     if (m_udpSocket->state() != QUdpSocket::UnconnectedState)
@@ -88,13 +139,11 @@ TraceServer::~TraceServer()
     delete m_udpSocket;
     m_udpSocket = nullptr;
 
-    // Serial port
-    if (m_serial->isOpen())
-    {
-        m_serial->close();
-    }
-    delete m_serial;
-    m_serial = nullptr;
+    // No producer is left
+    delete m_localRing;
+    m_localRing = nullptr;
+    delete m_receiveRing;
+    m_receiveRing = nullptr;
 }
 
 ///
@@ -112,11 +161,18 @@ TraceServer& TraceServer::instance()
 ///
 void TraceServer::init()
 {
+    // The main interface is the source 0, whichever thread receives it
+    emit ingestSourceAdded(m_localRing, 0, QString());
+    emit ingestSourceAdded(m_receiveRing, 0, QString());
+    openEndpoints();
+
     bool res = establishConnection();
     emit bindResult(m_interface, m_port, res);
 
     connect(m_udpSocket, &QUdpSocket::readyRead, this, &TraceServer::onReadyRead);
-    connect(m_serial, &QSerialPort::readyRead, this, &TraceServer::onReadyRead);
+
+    m_statsElapsed.start();
+    m_statsTimer->start(STATS_INTERVAL);
 }
 
 ///
@@ -128,31 +184,12 @@ void TraceServer::reinit()
     {
         m_timer->stop();
     }
-    if (m_serial->isOpen())
-    {
-        m_serial->close();
-    }
-    if (m_udpSocket->state() != QUdpSocket::UnconnectedState)
-    {
-        m_udpSocket->close();
-    }
+    closeConnection();
 
     bool res = establishConnection();
     emit bindResult(m_interface, m_port, res);
 }
 
-///
-/// \brief TraceServer::configSerialPort
-///
-void TraceServer::configSerialPort()
-{
-    m_serial->setPortName("COM1");
-    m_serial->setBaudRate(115200);              // Baud rate for the CAN converter
-    m_serial->setDataBits(QSerialPort::Data8);
-    m_serial->setStopBits(QSerialPort::OneStop);
-    m_serial->setParity(QSerialPort::NoParity);
-}
-
 ///
 /// \brief TraceServer::establishConnection
 /// \return
@@ -162,23 +199,46 @@ bool TraceServer::establishConnection()
     bool res = false;
     if (m_interface == SpecialInterface::SERIAL_INTERFACE)
     {
-        res = m_serial->open(QIODevice::ReadOnly);
+        IngestEndpoint config;
+        config.type = IngestEndpoint::Serial;
+        config.address = m_serialPortName;
+        config.baudRate = m_serialBaudRate;
+        QString errorString;
+        // The port must be opened in the receive thread
+        QMetaObject::invokeMethod(m_serialReceiver, [&](){
+            res = m_serialReceiver->open(config);
+            errorString = m_serialReceiver->errorString();
+        }, Qt::BlockingQueuedConnection);
         if (!res)
         {
-            qDebug() << "Open serial failed" << m_serial->errorString();
-            return res;
+            qDebug() << "Open serial failed" << m_serialPortName << errorString;
         }
-        m_serial->setDataTerminalReady(true); // Enables DTR line when opened, and leaves it on
-        m_serial->setRequestToSend(true);     // Enables RTS line when opened, and leaves it on
     }
     else
     {
         bool retryOnFail = false;
         auto host = toHostAddress(m_interface, retryOnFail);
-        res = m_udpSocket->bind(host, m_port, QAbstractSocket::DontShareAddress);
+        QString errorString;
+        if (m_udpReceiver)
+        {
+            // The socket must be created in the receive thread
+            QMetaObject::invokeMethod(m_udpReceiver, [&](){
+                res = m_udpReceiver->bind(host, m_port);
+                errorString = m_udpReceiver->errorString();
+            }, Qt::BlockingQueuedConnection);
+        }
+        else
+        {
+            res = m_udpSocket->bind(host, m_port, QAbstractSocket::DontShareAddress);
+            errorString = m_udpSocket->errorString();
+            if (res)
+            {
+                applyReceiveBufferSize();
+            }
+        }
         if (!res)
         {
-            qDebug() << "Bind udp failed" << m_udpSocket->errorString();
+            qDebug() << "Bind udp failed" << errorString;
             if (retryOnFail)
             {
                 m_timer->start(BINDING_RETRY_TIME);
@@ -189,25 +249,43 @@ bool TraceServer::establishConnection()
 }
 
 ///
-/// \brief slot to receive the new data and send it to trace manager
+/// \brief TraceServer::closeConnection
+///        Close the serial port and the UDP socket, whichever thread it lives in
 ///
-void TraceServer::onReadyRead()
+void TraceServer::closeConnection()
 {
-    QByteArray data;
-    if (m_interface == SpecialInterface::SERIAL_INTERFACE)
+    QMetaObject::invokeMethod(m_serialReceiver, [=](){
+        m_serialReceiver->close();
+        if (m_udpReceiver)
+        {
+            m_udpReceiver->close();
+        }
+    }, Qt::BlockingQueuedConnection);
+    if (m_udpSocket->state() != QUdpSocket::UnconnectedState)
     {
-        data = m_serial->readAll();
-        emit newDataReady(data);
+        m_udpSocket->close();
     }
-    else
+}
+
+///
+/// \brief slot to receive the new datagrams in non threaded mode and publish them to trace manager
+///
+void TraceServer::onReadyRead()
+{
+    IngestRecord record;
+    record.timestamp = TraceClock::nowNs();
+    while (m_udpSocket->hasPendingDatagrams())
     {
-        while (m_udpSocket->hasPendingDatagrams())
-        {
-            auto datagram = m_udpSocket->receiveDatagram();
-            data = datagram.data();
-            emit newDataReady(data);
-        }
+        auto datagram = m_udpSocket->receiveDatagram();
+        QByteArray data = datagram.data();
+        Q_IPV6ADDR sender = datagram.senderAddress().toIPv6Address();
+        memcpy(record.sender, &sender, sizeof(record.sender));
+        record.senderPort = quint16(datagram.senderPort());
+        m_localRing->write(record, data.constData(), data.size());
+        ++m_localDatagrams;
+        m_localBytes += quint64(data.size());
     }
+    m_localRing->flush();
 }
 
 ///
@@ -230,6 +308,263 @@ void TraceServer::onPortChangeRequested(quint16 port)
     reinit();
 }
 
+///
+/// \brief TraceServer::onEndpointsChangeRequested
+/// \param specs additional endpoints, see IngestEndpoint for the syntax
+///
+void TraceServer::onEndpointsChangeRequested(QStringList specs)
+{
+    closeEndpoints();
+    m_endpointSpecs = specs;
+    openEndpoints();
+}
+
+///
+/// \brief TraceServer::onSerialPortChangeRequested
+/// \param portName e.g. COM3, /dev/ttyACM0 or a pseudo-terminal
+/// \param baudRate
+///
+void TraceServer::onSerialPortChangeRequested(QString portName, qint32 baudRate)
+{
+    m_serialPortName = portName;
+    m_serialBaudRate = baudRate;
+    if (m_interface == SpecialInterface::SERIAL_INTERFACE)
+    {
+        reinit();
+    }
+}
+
+///
+/// \brief TraceServer::openEndpoints
+///        Start one receiver thread per additional endpoint
+///
+void TraceServer::openEndpoints()
+{
+    quint16 sourceId = 0;
+    foreach (const auto& spec, m_endpointSpecs)
+    {
+        ++sourceId;
+        IngestEndpoint config = IngestEndpoint::fromString(spec);
+        if (!config.isValid())
+        {
+            qDebug() << "Invalid endpoint" << spec;
+            emit endpointResult(spec, false);
+            continue;
+        }
+
+        auto endpoint = new Endpoint;
+        endpoint->config = config;
+        endpoint->sourceId = sourceId;
+        if (config.isStream())
+        {
+            // Every connection has its own ring, tagged as the endpoint
+            auto receiver = new StreamReceiver;
+            QString name = config.toString();
+            connect(receiver, &StreamReceiver::connectionOpened, this, [=](SlabRing* ring){
+                emit ingestSourceAdded(ring, sourceId, name);
+            }, Qt::DirectConnection);
+            connect(receiver, &StreamReceiver::connectionClosed, this, [=](SlabRing* ring){
+                emit ingestSourceRemoved(ring);
+            }, Qt::DirectConnection);
+            endpoint->receiver = receiver;
+        }
+        else if (config.type == IngestEndpoint::Serial)
+        {
+            endpoint->ring = new SlabRing(RING_SLAB_COUNT, RING_SLAB_CAPACITY);
+            endpoint->receiver = new SerialReceiver(endpoint->ring);
+        }
+        else
+        {
+            endpoint->ring = new SlabRing(RING_SLAB_COUNT, RING_SLAB_CAPACITY);
+            endpoint->receiver = new UdpReceiver(endpoint->ring);
+            endpoint->receiver->setReceiveBufferSize(m_receiveBufferSize);
+        }
+        endpoint->thread = new QThread(this);
+        endpoint->receiver->moveToThread(endpoint->thread);
+        connect(endpoint->thread, &QThread::finished, endpoint->receiver, &QObject::deleteLater);
+        endpoint->thread->start();
+        m_endpoints.append(endpoint);
+
+        if (endpoint->ring)
+        {
+            emit ingestSourceAdded(endpoint->ring, sourceId, config.toString());
+        }
+
+        bool res = false;
+        QString errorString;
+        QMetaObject::invokeMethod(endpoint->receiver, [&](){
+            res = endpoint->receiver->open(config);
+            errorString = endpoint->receiver->errorString();
+        }, Qt::BlockingQueuedConnection);
+        if (!res)
+        {
+            qDebug() << "Open endpoint failed" << spec << errorString;
+        }
+        emit endpointResult(config.toString(), res);
+    }
+}
+
+///
+/// \brief TraceServer::onReplayRequested
+///        Feed a saved trace back as if it was received on the main interface
+/// \param path saved trace file
+/// \param speed factor of the original pace, TraceReplayer::AS_FAST_AS_POSSIBLE to ignore it
+///
+void TraceServer::onReplayRequested(QString path, double speed)
+{
+    if (m_replayer)
+    {
+        emit replayFinished(path, 0, 0, QString("%1 is still being replayed").arg(m_replayPath));
+        return;
+    }
+
+    m_replayPath = path;
+    m_replayRing = new SlabRing(RING_SLAB_COUNT, RING_SLAB_CAPACITY);
+    m_replayer = new TraceReplayer(path, speed, m_replayRing);
+    m_replayThread = new QThread;
+    m_replayer->moveToThread(m_replayThread);
+    connect(m_replayThread, &QThread::started, m_replayer, &TraceReplayer::start);
+    connect(m_replayThread, &QThread::finished, m_replayer, &QObject::deleteLater);
+    connect(m_replayer, &TraceReplayer::finished, this, &TraceServer::onReplayFinished);
+
+    // A source of its own, so that the view tells the replayed lines from the live ones
+    emit ingestSourceAdded(m_replayRing, TraceReplayer::SOURCE_ID, "Replay");
+    m_replayThread->start();
+}
+
+///
+/// \brief TraceServer::onReplayFinished
+/// \param lines number of replayed lines
+/// \param elapsedNs time of the replay
+/// \param errorString empty if the whole file is replayed
+///
+void TraceServer::onReplayFinished(quint64 lines, qint64 elapsedNs, QString errorString)
+{
+    stopReplay();
+    emit replayFinished(m_replayPath, lines, elapsedNs, errorString);
+}
+
+///
+/// \brief TraceServer::stopReplay
+///        Stop the replayer before its ring is released
+///
+void TraceServer::stopReplay()
+{
+    if (!m_replayer)
+    {
+        return;
+    }
+    // The replayer is deleted when its thread finishes
+    m_replayThread->quit();
+    m_replayThread->wait();
+    emit ingestSourceRemoved(m_replayRing);
+    delete m_replayThread;
+    m_replayThread = nullptr;
+    m_replayer = nullptr;
+    delete m_replayRing;
+    m_replayRing = nullptr;
+}
+
+///
+/// \brief TraceServer::closeEndpoints
+///        Stop the receivers before their rings are released
+///
+void TraceServer::closeEndpoints()
+{
+    foreach (auto endpoint, m_endpoints)
+    {
+        QMetaObject::invokeMethod(endpoint->receiver, [=](){
+            endpoint->receiver->close();
+        }, Qt::BlockingQueuedConnection);
+        if (endpoint->ring)
+        {
+            emit ingestSourceRemoved(endpoint->ring);
+        }
+
+        // The receiver is deleted when its thread finishes
+        endpoint->thread->quit();
+        endpoint->thread->wait();
+        delete endpoint->thread;
+        delete endpoint->ring;
+        delete endpoint;
+    }
+    m_endpoints.clear();
+}
+
+///
+/// \brief TraceServer::applyReceiveBufferSize
+///        Enlarge the buffer of the socket in this thread, it only exists once bound
+///
+void TraceServer::applyReceiveBufferSize()
+{
+    if (m_receiveBufferSize > 0)
+    {
+        m_udpSocket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, m_receiveBufferSize);
+    }
+    int effective = m_udpSocket->socketOption(QAbstractSocket::ReceiveBufferSizeSocketOption).toInt();
+    if (effective < m_receiveBufferSize)
+    {
+        qDebug() << "Receive buffer limited to" << effective << "bytes";
+    }
+}
+
+///
+/// \brief TraceServer::updateStats
+///        Sum up the counters of all the receivers and rings, and derive the rates
+///
+void TraceServer::updateStats()
+{
+    IngestStats stats;
+    stats.receivedDatagrams = m_localDatagrams;
+    stats.receivedBytes = m_localBytes;
+    stats.ringDrops = m_localRing->overflowRecords();
+
+    QList<TraceReceiver*> receivers = { m_serialReceiver };
+    QList<SlabRing*> rings = { m_receiveRing };
+    if (m_udpReceiver)
+    {
+        receivers << m_udpReceiver;
+        stats.receiveBufferSize = m_udpReceiver->effectiveReceiveBufferSize();
+    }
+    else if (m_udpSocket->state() == QUdpSocket::BoundState)
+    {
+        stats.receiveBufferSize = m_udpSocket->socketOption(QAbstractSocket::ReceiveBufferSizeSocketOption).toInt();
+    }
+    foreach (auto endpoint, m_endpoints)
+    {
+        receivers << endpoint->receiver;
+        rings << endpoint->ring;
+    }
+    foreach (auto receiver, receivers)
+    {
+        stats.receivedDatagrams += receiver->receivedDatagrams();
+        stats.receivedBytes += receiver->receivedBytes();
+        stats.kernelDrops += receiver->kernelDrops();
+    }
+    rings.removeAll(nullptr);
+    foreach (auto ring, rings)
+    {
+        stats.ringDrops += ring->overflowRecords();
+    }
+
+    // The counters of the closed endpoints are gone, restart the rates from there
+    double seconds = m_statsElapsed.restart() / 1000.0;
+    if (seconds > 0
+            && stats.receivedDatagrams >= m_stats.receivedDatagrams
+            && stats.receivedBytes >= m_stats.receivedBytes)
+    {
+        stats.datagramsPerSecond = (stats.receivedDatagrams - m_stats.receivedDatagrams) / seconds;
+        stats.bytesPerSecond = (stats.receivedBytes - m_stats.receivedBytes) / seconds;
+    }
+    if (stats.kernelDrops > m_stats.kernelDrops || stats.ringDrops > m_stats.ringDrops)
+    {
+        qDebug() << "Ingest drops, kernel" << stats.kernelDrops << "ring" << stats.ringDrops;
+    }
+
+    m_stats = stats;
+    emit statsUpdated(m_stats);
+}
+
 ///
 /// \brief TraceServer::retryRemoteConnecting
 ///
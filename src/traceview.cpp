@@ -2,22 +2,48 @@
 #include "inc/mainwindow.h"
 #include "inc/customhighlightdialog.h"
 #include "inc/tracehighlighter.h"
+#include "inc/htmltraceloader.h"
+#include "inc/journalloader.h"
+#include "inc/htmltraceparser.h"
 #include "inc/constants.h"
 #include <QtWidgets>
 #include <QDialog>
 #include <QSettings>
-#include <QtConcurrent/QtConcurrentRun>
+#include <QTextStream>
 #include <QGuiApplication>
+#include <algorithm>
+
+namespace
+{
+const int TEXT_MARGIN = 4;
+const QString HTML_LINE_START = QStringLiteral("<p style=\" margin-top:0px; margin-bottom:0px; margin-left:0px; "
+                                               "margin-right:0px; -qt-block-indent:0; text-indent:0px;\">");
+const QString HTML_LINE_END = QStringLiteral("</p>\n");
+
+///
+/// \brief Helper function
+///        Lay out a line of the view, which is never wrapped
+/// \param layout
+/// \return the only line of the layout
+///
+QTextLine layoutLine(QTextLayout& layout)
+{
+    layout.beginLayout();
+    QTextLine line = layout.createLine();
+    layout.endLayout();
+    return line;
+}
+}
 
 TraceView::TraceView()
 {
-    setReadOnly(true);
-    setAcceptRichText(true);
-    setLineWrapMode(QTextEdit::NoWrap);
     QFont font("Consolas", 10, QFont::Medium);
     setFont(font);
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setCursor(Qt::IBeamCursor);
+    updateMetrics();
 
-    m_highlighter = new TraceHighlighter(this->document());
+    m_highlighter = new TraceHighlighter;
 
     createTraceActions();
     createNetworkActions();
@@ -25,25 +51,29 @@ TraceView::TraceView()
 
 TraceView::~TraceView()
 {
-    if (m_highlighter)
-    {
-        m_highlighter->deleteLater();
-        m_highlighter = nullptr;
-    }
+    delete m_loader;
+    m_loader = nullptr;
+    delete m_highlighter;
+    m_highlighter = nullptr;
 }
 
 #ifndef QT_NO_CONTEXTMENU
 void TraceView::contextMenuEvent(QContextMenuEvent *event)
 {
-    QMenu* menu = createStandardContextMenu();
+    QMenu* menu = new QMenu(this);
+    menu->addAction(m_copyAct);
+    menu->addAction(m_selectAllAct);
+    menu->addSeparator();
     menu->addAction(m_saveAct);
     menu->addAction(m_searchAct);
     menu->addAction(m_clearAct);
     menu->addAction(m_clearUntilHereAct);
     menu->addSeparator();
     menu->addAction(m_setAutoScrollAct);
+    menu->addAction(m_showTimestampsAct);
     menu->addSeparator();
     menu->addAction(m_setCustomHighlightAct);
+    menu->addAction(m_memoryReportAct);
     menu->addSeparator();
     menu->addAction(m_setAnyItfAct);
     menu->addAction(m_setAnyItfIpv6Act);
@@ -52,6 +82,10 @@ void TraceView::contextMenuEvent(QContextMenuEvent *event)
     menu->addAction(m_setSerialItfAct);
     menu->addSeparator();
     menu->addAction(m_setPortAct);
+    menu->addAction(m_setSerialPortAct);
+    menu->addAction(m_setEndpointsAct);
+    menu->addAction(m_loadDictionaryAct);
+    menu->addAction(m_replayAct);
 
     menu->exec(event->globalPos());
     delete menu;
@@ -66,11 +100,117 @@ void TraceView::mousePressEvent(QMouseEvent* event)
 {
     if (event->button() == Qt::RightButton)
     {
-        // Need to save the current cursor when right-click
+        // Need to save the line under the pointer when right-click
         // to use for action Clear until here
-        m_clearUntilCursor = cursorForPosition(event->pos());
+        m_clearUntilLine = qBound(-1, lineAt(event->pos().y()), lineCount() - 1);
+    }
+    else if (event->button() == Qt::LeftButton)
+    {
+        auto position = positionAt(event->pos());
+        if (event->modifiers() & Qt::ShiftModifier && m_hasSelection)
+        {
+            setSelection(m_selectionAnchor, position);
+        }
+        else
+        {
+            setSelection(position, position);
+        }
+        m_selecting = true;
+    }
+    event->accept();
+}
+
+///
+/// \brief TraceView::mouseMoveEvent override
+///        Extend the selection, scrolling when the pointer leaves the view
+/// \param event
+///
+void TraceView::mouseMoveEvent(QMouseEvent* event)
+{
+    if (!m_selecting || !(event->buttons() & Qt::LeftButton))
+    {
+        return;
+    }
+    if (event->pos().y() < 0)
+    {
+        verticalScrollBar()->triggerAction(QAbstractSlider::SliderSingleStepSub);
+    }
+    else if (event->pos().y() > viewport()->height())
+    {
+        verticalScrollBar()->triggerAction(QAbstractSlider::SliderSingleStepAdd);
+    }
+    setSelection(m_selectionAnchor, positionAt(event->pos()));
+}
+
+///
+/// \brief TraceView::mouseReleaseEvent override
+/// \param event
+///
+void TraceView::mouseReleaseEvent(QMouseEvent* event)
+{
+    if (event->button() == Qt::LeftButton)
+    {
+        m_selecting = false;
+    }
+}
+
+///
+/// \brief TraceView::mouseDoubleClickEvent override
+///        Select the word under the pointer
+/// \param event
+///
+void TraceView::mouseDoubleClickEvent(QMouseEvent* event)
+{
+    if (event->button() != Qt::LeftButton || m_lines.isEmpty())
+    {
+        return;
+    }
+    auto position = positionAt(event->pos());
+    QString text = m_lines.line(position.line);
+    auto isWordChar = [&](int column) {
+        return column >= 0 && column < text.size() && (text.at(column).isLetterOrNumber() || text.at(column) == '_');
+    };
+    TextPosition start = position;
+    TextPosition end = position;
+    while (isWordChar(start.column - 1))
+    {
+        --start.column;
+    }
+    while (isWordChar(end.column))
+    {
+        ++end.column;
     }
-    QTextEdit::mousePressEvent(event);
+    setSelection(start, end);
+}
+
+///
+/// \brief TraceView::keyPressEvent override
+/// \param event
+///
+void TraceView::keyPressEvent(QKeyEvent* event)
+{
+    if (event == QKeySequence::Copy)
+    {
+        copy();
+    }
+    else if (event == QKeySequence::SelectAll)
+    {
+        selectAll();
+    }
+    else if (event == QKeySequence::MoveToStartOfDocument)
+    {
+        verticalScrollBar()->triggerAction(QAbstractSlider::SliderToMinimum);
+    }
+    else if (event == QKeySequence::MoveToEndOfDocument)
+    {
+        scrollToEnd();
+    }
+    else
+    {
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+    event->accept();
 }
 
 ///
@@ -78,13 +218,25 @@ void TraceView::mousePressEvent(QMouseEvent* event)
 ///
 void TraceView::createTraceActions()
 {
+    m_copyAct = new QAction("Copy", this);
+    m_copyAct->setShortcuts(QKeySequence::Copy);
+    m_copyAct->setStatusTip("Copy the selected text");
+    m_copyAct->setEnabled(false);
+    connect(m_copyAct, &QAction::triggered, this, &TraceView::copy);
+    connect(this, &TraceView::copyAvailable, m_copyAct, &QAction::setEnabled);
+
+    m_selectAllAct = new QAction("Select All", this);
+    m_selectAllAct->setShortcuts(QKeySequence::SelectAll);
+    m_selectAllAct->setStatusTip("Select all the traces");
+    connect(m_selectAllAct, &QAction::triggered, this, &TraceView::selectAll);
+
     m_saveAct = new QAction("Save", this);
     m_saveAct->setShortcuts(QKeySequence::Save);
     m_saveAct->setStatusTip("Save the document to disk");
     m_saveAct->setEnabled(false);
     connect(m_saveAct, &QAction::triggered, this, &TraceView::save);
-    connect(this, &QTextEdit::textChanged, m_saveAct, [this](){
-        m_saveAct->setEnabled(!this->document()->isEmpty());
+    connect(this, &TraceView::linesChanged, m_saveAct, [this](){
+        m_saveAct->setEnabled(!m_lines.isEmpty());
     });
 
     m_searchAct = new QAction("Search...", this);
@@ -111,10 +263,21 @@ void TraceView::createTraceActions()
     m_setAutoScrollAct->setStatusTip("If false, the trace is not automatically scroll if new trace comes");
     m_setAutoScrollAct->setIcon(QIcon(":/img/checkmark.png"));
 
+    m_showTimestampsAct = new QAction("Timestamps", this);
+    m_showTimestampsAct->setEnabled(false);
+    m_showTimestampsAct->setIconVisibleInMenu(false);
+    m_showTimestampsAct->setStatusTip("Show the receive time of the traces, in seconds since the first trace");
+    m_showTimestampsAct->setIcon(QIcon(":/img/checkmark.png"));
+
     m_setCustomHighlightAct = new QAction("Custom Highlights", this);
     m_setCustomHighlightAct->setStatusTip("Set custom highlights for traces. Avoid changing custom highlight when "
                                           "receving traces, it can cause lagging to the tool.");
     connect(m_setCustomHighlightAct, &QAction::triggered, this, &TraceView::setCustomHighlights);
+
+    m_memoryReportAct = new QAction("Memory Usage...", this);
+    m_memoryReportAct->setStatusTip("Show the memory used by the traces of the view, and the part saved "
+                                    "by sharing their recurring tags");
+    connect(m_memoryReportAct, &QAction::triggered, this, &TraceView::showMemoryReport);
 }
 
 ///
@@ -150,6 +313,24 @@ void TraceView::createNetworkActions()
     m_setPortAct = new QAction("Configure Port", this);
     m_setPortAct->setEnabled(false);
     m_setPortAct->setStatusTip("Set port to connect to UDP connection. Default 911.");
+
+    m_setSerialPortAct = new QAction("Configure Serial Port...", this);
+    m_setSerialPortAct->setEnabled(false);
+    m_setSerialPortAct->setStatusTip("Set the serial port and baud rate used by the serial interface.");
+
+    m_setEndpointsAct = new QAction("Additional Endpoints...", this);
+    m_setEndpointsAct->setEnabled(false);
+    m_setEndpointsAct->setStatusTip("Listen to other UDP ports, serial ports, TCP ports or local sockets at the same time as the main interface. "
+                                    "Their traces are tagged with the endpoint name.");
+
+    m_loadDictionaryAct = new QAction("Load Trace Dictionary...", this);
+    m_loadDictionaryAct->setEnabled(false);
+    m_loadDictionaryAct->setStatusTip("Load the format strings of the binary traces.");
+
+    m_replayAct = new QAction("Replay Trace File...", this);
+    m_replayAct->setEnabled(false);
+    m_replayAct->setStatusTip("Feed a saved plain text trace back through the live view, at its original pace "
+                              "if it was saved with the timestamps shown, or as fast as possible.");
 }
 
 ///
@@ -189,6 +370,40 @@ void TraceView::setCustomHighlights()
     mainWindow->setCustomHighlights(highlights);
 }
 
+///
+/// \brief TraceView::showMemoryReport
+///
+void TraceView::showMemoryReport()
+{
+    auto report = m_lines.memoryReport();
+    auto megabytes = [](qint64 bytes){
+        return QString::number(bytes / (1024.0 * 1024.0), 'f', 1);
+    };
+    qint64 saved = report.decodedTextSize - report.textSize;
+    QString msg = QString("Lines: %1, %2 of them on disk\n"
+                          "Memory: %3 MB\n"
+                          "Disk: %4 MB\n\n"
+                          "Text in memory: %5 MB, %6 MB once the shared tags are expanded\n"
+                          "Shared tags: %7, %8 MB\n"
+                          "Saved: %9 MB (%10%)\n\n"
+                          "Compressed: %11 lines in %12 MB, %13 MB uncompressed")
+                      .arg(report.lines)
+                      .arg(report.linesOnDisk)
+                      .arg(megabytes(report.memoryUsage))
+                      .arg(megabytes(report.diskUsage))
+                      .arg(megabytes(report.textSize))
+                      .arg(megabytes(report.decodedTextSize))
+                      .arg(report.tokens)
+                      .arg(megabytes(report.dictionarySize))
+                      .arg(megabytes(saved - report.dictionarySize))
+                      .arg(report.decodedTextSize ? 100.0 * (saved - report.dictionarySize) / report.decodedTextSize : 0.0,
+                           0, 'f', 1)
+                      .arg(report.compressedLines)
+                      .arg(megabytes(report.compressedSize))
+                      .arg(megabytes(report.uncompressedSize));
+    QMessageBox::information(this, "Memory Usage", msg);
+}
+
 ///
 /// \brief TraceView::save
 ///
@@ -211,14 +426,16 @@ void TraceView::save()
         QMessageBox::critical(this, "ERROR!!!", "Cannot creating the file");
         return;
     }
+    // The lines are written one by one, never as a whole document
     QTextStream out(&file);
+    out.setCodec("UTF-8");
     if (filename.endsWith(".html"))
     {
-        out << toHtmlWithAdditionalFormats();
+        writeHtml(out);
     }
     else
     {
-        out << toPlainText();
+        writePlainText(out);
     }
     file.close();
 
@@ -228,57 +445,75 @@ void TraceView::save()
 }
 
 ///
-/// \brief get the formatted string of the text in the layout
-///        QSyntaxHighlighter add additional formats to the text layout
-///        that a simple QTextEdit::toHtml() cannot save it
-/// \return text formatted html string
+/// \brief TraceView::writeHtml
+///        Write the lines with their colors and the colors of the highlighting rules,
+///        one paragraph per line as a rich text document does, so that the file opens
+///        the same in the tool and in a browser
+/// \param out
 ///
-QString TraceView::toHtmlWithAdditionalFormats()
+void TraceView::writeHtml(QTextStream& out)
 {
-    auto text = toPlainText();
-
-    // Create a new document from all the selected text document.
-    QTextCursor cursor(document());
-    cursor.select(QTextCursor::Document);
-    QTextDocument* tempDocument(new QTextDocument);
-    Q_ASSERT(tempDocument);
-    QTextCursor tempCursor(tempDocument);
+    out << "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.0//EN\" \"http://www.w3.org/TR/REC-html40/strict.dtd\">\n"
+        << "<html><head><meta name=\"qrichtext\" content=\"1\" />"
+        << "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\" />"
+        << "<style type=\"text/css\">\np, li { white-space: pre-wrap; }\n</style></head>"
+        << QString("<body style=\" font-family:'%1'; font-size:%2pt;\">\n").arg(font().family()).arg(font().pointSize());
 
-    tempCursor.insertFragment(cursor.selection());
-    tempCursor.select(QTextCursor::Document);
+    for (int line = 0; line < m_lines.size(); ++line)
+    {
+        QString text = m_lines.line(line);
+        out << HTML_LINE_START;
+        if (text.isEmpty())
+        {
+            out << "<br />" << HTML_LINE_END;
+            continue;
+        }
 
-    // Apply the additional formats set by the syntax highlighter
-    QTextBlock start = document()->findBlock(cursor.selectionStart());
-    QTextBlock end = document()->findBlock(cursor.selectionEnd());
-    end = end.next();
-    int selectionStart = cursor.selectionStart();
-    int endOfDocument = tempDocument->characterCount() - 1;
-    for (QTextBlock current = start; current.isValid() and current != end; current = current.next()) {
-        const QTextLayout* layout(current.layout());
+        // Resolve the overlapping formats to one color per character
+        QVector<QRgb> colors(text.size(), 0);
+        foreach (const auto& range, lineFormats(line, text))
+        {
+            QRgb color = range.format.foreground().color().rgba();
+            int end = qMin(range.start + range.length, text.size());
+            for (int i = qMax(range.start, 0); i < end; ++i)
+            {
+                colors[i] = color;
+            }
+        }
 
-        foreach (const QTextLayout::FormatRange &range, layout->formats()) {
-            int start = current.position() + range.start - selectionStart;
-            int end = start + range.length;
-            if (end <= 0 || start >= endOfDocument)
+        int runStart = 0;
+        for (int i = 1; i <= text.size(); ++i)
+        {
+            if (i < text.size() && colors[i] == colors[runStart])
+            {
                 continue;
-            tempCursor.setPosition(qMax(start, 0));
-            tempCursor.setPosition(qMin(end, endOfDocument), QTextCursor::KeepAnchor);
-            tempCursor.setCharFormat(range.format);
+            }
+            QString run = text.mid(runStart, i - runStart).toHtmlEscaped();
+            if (qAlpha(colors[runStart]) == 0)
+            {
+                out << run;
+            }
+            else
+            {
+                out << "<span style=\" color:" << QColor(colors[runStart]).name() << ";\">" << run << "</span>";
+            }
+            runStart = i;
         }
+        out << HTML_LINE_END;
     }
+    out << "</body></html>";
+}
 
-    // Reset the user states since they are not interesting
-    for(QTextBlock block = tempDocument->begin(); block.isValid(); block = block.next())
-        block.setUserState(-1);
-
-    // Make sure the text appears pre-formatted, and set the background we want.
-    tempCursor.select(QTextCursor::Document);
-
-    // Finally retreive the syntax higlighted and formatted html.
-    text = tempCursor.selection().toHtml();
-    delete tempDocument;
-
-    return text;
+///
+/// \brief TraceView::writePlainText
+/// \param out stream of the saved plain text file
+///
+void TraceView::writePlainText(QTextStream& out)
+{
+    for (int line = 0; line < m_lines.size(); ++line)
+    {
+        out << m_lines.line(line) << '\n';
+    }
 }
 
 ///
@@ -286,23 +521,37 @@ QString TraceView::toHtmlWithAdditionalFormats()
 ///
 void TraceView::clear()
 {
-    QTextEdit::clear();
+    bool loading = m_loader || m_lines.isLoading();
+    delete m_loader;
+    m_loader = nullptr;
+    m_lines.clear();
+    m_matches.clear();
+    m_currentMatch = TextRange();
+    m_markedLine = -1;
+    m_clearUntilLine = -1;
+    setSelection(TextPosition(), TextPosition());
+    updateScrollBars();
+    viewport()->update();
+    emit linesChanged();
+    if (loading)
+    {
+        // The loading stops with the lines
+        emit loadFinished(QString());
+    }
 }
 
 ///
 /// \brief TraceView::clearUntilHere
+///        Remove the lines until the one right-clicked, included
 ///
 void TraceView::clearUntilHere()
 {
-    auto cursor = textCursor();
-    int mousePos = m_clearUntilCursor.position();
-
-    // Select the text block from start to the end of this line (including line break)
-    cursor.movePosition(QTextCursor::Start);
-    cursor.setPosition(mousePos, QTextCursor::KeepAnchor);
-    cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-    cursor.movePosition(QTextCursor::NextCharacter, QTextCursor::KeepAnchor);
-    cursor.removeSelectedText();
+    if (m_clearUntilLine < 0)
+    {
+        return;
+    }
+    removeFirstLines(m_clearUntilLine + 1);
+    m_clearUntilLine = -1;
 }
 
 ///
@@ -311,34 +560,705 @@ void TraceView::clearUntilHere()
 void TraceView::onHighlightingChanged()
 {
     m_highlightUpdated = false;
-    m_highlightUpdateRequested = false;
 }
 
 ///
 /// \brief TraceView::updateHighlighting
+///        The lines are highlighted when painted, only the visible ones are repainted
 ///
 void TraceView::updateHighlighting()
 {
-    if (!m_highlighter) return;
-
     m_highlightUpdated = true;
-    m_highlightUpdateRequested = true;
-    m_highlighter->rehighlight();
+    viewport()->update();
 }
 
 ///
-/// \brief TraceView::setHighlightUpdateRequested
+/// \brief TraceView::disableCustomHighlighting
+///        Only the colors of the lines themselves are shown
 ///
-void TraceView::setHighlightUpdateRequested()
+void TraceView::disableCustomHighlighting()
 {
-    m_highlightUpdateRequested = true;
+    delete m_highlighter;
+    m_highlighter = nullptr;
+    viewport()->update();
 }
 
 ///
-/// \brief TraceView::disableCustomHighlighting
+/// \brief TraceView::appendLine
+/// \param text
+/// \param spans color runs of the line, empty for the default color
+/// \param timestamp receive time of the line, 0 if none
 ///
-void TraceView::disableCustomHighlighting()
+void TraceView::appendLine(const QString& text, const QVector<ColorSpan>& spans, qint64 timestamp)
 {
-    delete m_highlighter;
-    m_highlighter = nullptr;
+    m_lines.append(text, spans, timestamp);
+    takeDroppedLines();
+    scheduleLinesAppended();
+}
+
+///
+/// \brief TraceView::appendLine
+/// \param text UTF-8 text of the line, stored without decoding
+/// \param spans color runs of the line, empty for the default color
+/// \param timestamp receive time of the line, 0 if none
+///
+void TraceView::appendLine(const QByteArray& text, const QVector<ColorSpan>& spans, qint64 timestamp)
+{
+    m_lines.append(text, spans, timestamp);
+    takeDroppedLines();
+    scheduleLinesAppended();
+}
+
+///
+/// \brief TraceView::appendLine
+/// \param data UTF-8 text of the line, stored without decoding
+/// \param size
+/// \param timestamp receive time of the line, 0 if none
+///
+void TraceView::appendLine(const char* data, int size, qint64 timestamp)
+{
+    m_lines.append(data, size, nullptr, 0, timestamp);
+    takeDroppedLines();
+    scheduleLinesAppended();
+}
+
+///
+/// \brief TraceView::appendRecord
+/// \param record binary record, stored as received and formatted when shown
+/// \param size
+/// \param tag UTF-8 text shown before the record, empty if none
+/// \param timestamp receive time of the line, 0 if none
+///
+void TraceView::appendRecord(const char* record, int size, const QByteArray& tag, qint64 timestamp)
+{
+    m_lines.appendRecord(record, size, tag, timestamp);
+    takeDroppedLines();
+    scheduleLinesAppended();
+}
+
+///
+/// \brief TraceView::appendMessage
+///        Append a message of the tool, in one color
+/// \param text
+/// \param color
+///
+void TraceView::appendMessage(const QString& text, const QColor& color)
+{
+    appendLine(text, { ColorSpan{ 0, color.rgba() } });
+}
+
+///
+/// \brief TraceView::setPlainText
+/// \param text replaces all the lines
+///
+void TraceView::setPlainText(const QString& text)
+{
+    clear();
+    int start = 0;
+    while (start < text.size())
+    {
+        int end = text.indexOf('\n', start);
+        if (end < 0)
+        {
+            end = text.size();
+        }
+        int length = end - start;
+        if (length > 0 && text.at(end - 1) == '\r')
+        {
+            --length;
+        }
+        m_lines.append(text.midRef(start, length).toUtf8());
+        start = end + 1;
+    }
+    onLinesAppended();
+}
+
+///
+/// \brief TraceView::openFile
+///        Show a plain text file without reading it, its lines appear while it is indexed
+/// \param path
+/// \return false if the file cannot be opened
+///
+bool TraceView::openFile(const QString& path)
+{
+    clear();
+    auto file = new MappedTraceFile(path);
+    if (!file->open())
+    {
+        qDebug() << "Open trace file failed" << path << file->errorString();
+        delete file;
+        return false;
+    }
+    connect(file, &MappedTraceFile::linesIndexed, this, [=]() {
+        scheduleLinesAppended();
+        emit loadProgress(file->indexedSize(), file->size());
+        if (file->isIndexed())
+        {
+            emit loadFinished(QString());
+        }
+    });
+    m_lines.setFile(file);
+    scheduleLinesAppended();
+    if (file->isIndexed())
+    {
+        emit loadFinished(QString());
+    }
+    return true;
+}
+
+///
+/// \brief TraceView::openHtmlFile
+///        Load a saved html file in the background, its lines appear part by part
+/// \param path
+///
+void TraceView::openHtmlFile(const QString& path)
+{
+    clear();
+    startLoader(new HtmlTraceLoader(path));
+}
+
+///
+/// \brief TraceView::openJournal
+///        Load the journal of a capture in the background, its lines appear part by part
+/// \param sessionPath
+///
+void TraceView::openJournal(const QString& sessionPath)
+{
+    clear();
+    startLoader(new JournalLoader(sessionPath));
+}
+
+///
+/// \brief TraceView::startLoader
+///        The view owns the loader until it finishes, or until the lines are cleared
+/// \param loader
+///
+void TraceView::startLoader(TraceLoader* loader)
+{
+    m_loader = loader;
+    connect(loader, &TraceLoader::linesLoaded, this, [=](const LineBlock& lines, qint64 bytesRead, qint64 size) {
+        m_lines.append(lines);
+        takeDroppedLines();
+        scheduleLinesAppended();
+        emit loadProgress(bytesRead, size);
+    });
+    connect(loader, &TraceLoader::finished, this, [=](const QString& errorString) {
+        m_loader->deleteLater();
+        m_loader = nullptr;
+        emit loadFinished(errorString);
+    });
+    loader->start();
+}
+
+///
+/// \brief TraceView::setHtml
+/// \param html replaces all the lines
+///
+void TraceView::setHtml(const QString& html)
+{
+    clear();
+    HtmlTraceParser parser;
+    LineBlock lines;
+    parser.parse(html.toUtf8(), lines);
+    parser.finish(lines);
+    m_lines.append(lines);
+    onLinesAppended();
+}
+
+///
+/// \brief TraceView::removeLastLine
+///        Used to replace the last message
+///
+void TraceView::removeLastLine()
+{
+    if (m_lines.isEmpty())
+    {
+        return;
+    }
+    takeDroppedLines();
+    int line = lineCount() - 1;
+    m_lines.removeLast();
+    while (!m_matches.isEmpty() && m_matches.last().line == line)
+    {
+        m_matches.removeLast();
+    }
+    if (m_currentMatch.line == line)
+    {
+        m_currentMatch = TextRange();
+    }
+    if (m_markedLine == line)
+    {
+        m_markedLine = -1;
+    }
+    if (m_hasSelection && qMax(m_selectionAnchor, m_selectionCursor).line >= line)
+    {
+        setSelection(TextPosition(), TextPosition());
+    }
+    scheduleLinesAppended();
+}
+
+///
+/// \brief TraceView::removeFirstLines
+///        The search results, the selection and the scroll position follow their lines
+/// \param count
+///
+void TraceView::removeFirstLines(int count)
+{
+    count = qMin(count, lineCount());
+    if (count <= 0)
+    {
+        return;
+    }
+    m_lines.removeFirst(count);
+    onFirstLinesRemoved(count);
+    viewport()->update();
+    emit linesChanged();
+}
+
+///
+/// \brief TraceView::onFirstLinesRemoved
+///        Move the search results, the selection and the scroll position with their lines
+/// \param count number of lines removed from the start of the store
+///
+void TraceView::onFirstLinesRemoved(int count)
+{
+    QVector<TextRange> matches;
+    foreach (auto match, m_matches)
+    {
+        if (match.line >= count)
+        {
+            match.line -= count;
+            matches.append(match);
+        }
+    }
+    m_matches = matches;
+    m_currentMatch.line -= count;
+    if (m_currentMatch.line < 0)
+    {
+        m_currentMatch = TextRange();
+    }
+    m_markedLine = m_markedLine >= count ? m_markedLine - count : -1;
+    m_clearUntilLine = qMax(-1, m_clearUntilLine - count);
+
+    if (m_hasSelection)
+    {
+        TextPosition anchor = m_selectionAnchor;
+        TextPosition cursor = m_selectionCursor;
+        for (auto position : { &anchor, &cursor })
+        {
+            position->line -= count;
+            if (position->line < 0)
+            {
+                *position = TextPosition();
+            }
+        }
+        setSelection(anchor, cursor);
+    }
+
+    int scroll = verticalScrollBar()->value();
+    updateScrollBars();
+    verticalScrollBar()->setValue(scroll - count);
+}
+
+///
+/// \brief TraceView::takeDroppedLines
+///        The oldest lines left with the retention of the store, the lines of the view
+///        follow at once after each append, before the matches are read or extended
+///
+void TraceView::takeDroppedLines()
+{
+    int dropped = m_lines.takeDroppedLines();
+    if (dropped > 0)
+    {
+        onFirstLinesRemoved(dropped);
+    }
+}
+
+///
+/// \brief TraceView::scheduleLinesAppended
+///        The view is updated once for all the lines appended in the same event
+///
+void TraceView::scheduleLinesAppended()
+{
+    if (m_linesAppendedPending)
+    {
+        return;
+    }
+    m_linesAppendedPending = true;
+    QMetaObject::invokeMethod(this, &TraceView::onLinesAppended, Qt::QueuedConnection);
+}
+
+///
+/// \brief TraceView::onLinesAppended
+///
+void TraceView::onLinesAppended()
+{
+    m_linesAppendedPending = false;
+    takeDroppedLines();
+    updateScrollBars();
+    if (isAutoScrollEnabled())
+    {
+        scrollToEnd();
+    }
+    viewport()->update();
+    emit linesChanged();
+}
+
+///
+/// \brief TraceView::scrollToEnd
+///
+void TraceView::scrollToEnd()
+{
+    updateScrollBars();
+    verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+}
+
+///
+/// \brief TraceView::updateMetrics
+///        The rows have the height of the font, the width of the longest line is
+///        estimated from its length, the font being a fixed pitch one
+///
+void TraceView::updateMetrics()
+{
+    QFontMetrics metrics(font());
+    m_lineHeight = qMax(1, metrics.lineSpacing());
+    m_charWidth = qMax(1, metrics.horizontalAdvance(QLatin1Char('M')));
+    updateScrollBars();
+    viewport()->update();
+}
+
+///
+/// \brief TraceView::updateScrollBars
+///        The vertical scroll bar counts the lines, the horizontal one the pixels
+///
+void TraceView::updateScrollBars()
+{
+    int rows = qMax(1, viewport()->height() / m_lineHeight);
+    verticalScrollBar()->setRange(0, qMax(0, lineCount() - rows));
+    verticalScrollBar()->setPageStep(rows);
+    verticalScrollBar()->setSingleStep(1);
+
+    int width = m_lines.maxLineLength() * m_charWidth + 2 * TEXT_MARGIN;
+    horizontalScrollBar()->setRange(0, qMax(0, width - viewport()->width()));
+    horizontalScrollBar()->setPageStep(viewport()->width());
+    horizontalScrollBar()->setSingleStep(m_charWidth);
+}
+
+///
+/// \brief TraceView::resizeEvent override
+/// \param event
+///
+void TraceView::resizeEvent(QResizeEvent* event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+///
+/// \brief TraceView::changeEvent override
+/// \param event
+///
+void TraceView::changeEvent(QEvent* event)
+{
+    QAbstractScrollArea::changeEvent(event);
+    if (event->type() == QEvent::FontChange)
+    {
+        updateMetrics();
+    }
+}
+
+///
+/// \brief TraceView::scrollContentsBy override
+///        Nothing is cached, the visible rows are painted again
+///
+void TraceView::scrollContentsBy(int /*dx*/, int /*dy*/)
+{
+    viewport()->update();
+}
+
+///
+/// \brief TraceView::lineAt
+/// \param y position in the viewport
+/// \return the line shown at that height, it may be out of the lines
+///
+int TraceView::lineAt(int y) const
+{
+    int row = y >= 0 ? y / m_lineHeight : -1 - (-y - 1) / m_lineHeight;
+    return verticalScrollBar()->value() + row;
+}
+
+///
+/// \brief TraceView::positionAt
+/// \param point position in the viewport
+/// \return the nearest character of the lines
+///
+TraceView::TextPosition TraceView::positionAt(const QPoint& point) const
+{
+    TextPosition position;
+    if (m_lines.isEmpty())
+    {
+        return position;
+    }
+    int line = lineAt(point.y());
+    if (line < 0)
+    {
+        return position;
+    }
+    if (line >= lineCount())
+    {
+        position.line = lineCount() - 1;
+        position.column = m_lines.line(position.line).size();
+        return position;
+    }
+
+    QTextLayout layout(m_lines.line(line), font(), viewport());
+    QTextLine textLine = layoutLine(layout);
+    position.line = line;
+    position.column = textLine.xToCursor(point.x() - TEXT_MARGIN + horizontalScrollBar()->value());
+    return position;
+}
+
+///
+/// \brief TraceView::paintEvent override
+///        Lay out and paint the visible rows only
+/// \param event
+///
+void TraceView::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(viewport());
+    painter.setPen(palette().text().color());
+
+    int first = verticalScrollBar()->value();
+    int x = TEXT_MARGIN - horizontalScrollBar()->value();
+    int firstLine = first + event->rect().top() / m_lineHeight;
+    int lastLine = qMin(lineCount() - 1, first + event->rect().bottom() / m_lineHeight);
+    for (int line = firstLine; line <= lastLine; ++line)
+    {
+        int y = (line - first) * m_lineHeight;
+        if (line == m_markedLine)
+        {
+            painter.fillRect(QRect(0, y, viewport()->width(), m_lineHeight), QColor(Qt::gray).lighter(140));
+        }
+        QString text = m_lines.line(line);
+        QTextLayout layout(text, font(), viewport());
+        layout.setFormats(lineFormats(line, text));
+        layoutLine(layout);
+        layout.draw(&painter, QPointF(x, y), lineSelections(line, text.size()));
+    }
+}
+
+///
+/// \brief TraceView::lineFormats
+/// \param line
+/// \param text decoded text of the line
+/// \return the colors of the line, then the colors of the highlighting rules
+///
+QVector<QTextLayout::FormatRange> TraceView::lineFormats(int line, const QString& text) const
+{
+    QVector<QTextLayout::FormatRange> formats;
+    auto spans = m_lines.spans(line);
+    for (int i = 0; i < spans.size(); ++i)
+    {
+        if (qAlpha(spans[i].color) == 0)
+        {
+            continue;
+        }
+        QTextLayout::FormatRange range;
+        range.start = spans[i].start;
+        range.length = (i + 1 < spans.size() ? spans[i + 1].start : text.size()) - range.start;
+        range.format.setForeground(QColor::fromRgba(spans[i].color));
+        formats.append(range);
+    }
+    if (m_highlighter)
+    {
+        m_highlighter->highlight(text, formats);
+    }
+    return formats;
+}
+
+///
+/// \brief TraceView::lineSelections
+/// \param line
+/// \param length length of the decoded line
+/// \return the search results of the line, then the selected text
+///
+QVector<QTextLayout::FormatRange> TraceView::lineSelections(int line, int length) const
+{
+    QVector<QTextLayout::FormatRange> selections;
+    auto match = std::lower_bound(m_matches.begin(), m_matches.end(), line, [](const TextRange& range, int value) {
+        return range.line < value;
+    });
+    for (; match != m_matches.end() && match->line == line; ++match)
+    {
+        QTextLayout::FormatRange range;
+        range.start = match->start;
+        range.length = match->length;
+        range.format.setBackground(*match == m_currentMatch ? QColor(Qt::green).lighter()
+                                                            : QColor(Qt::yellow).lighter(140));
+        selections.append(range);
+    }
+    if (m_currentMatch.line == line && !std::binary_search(m_matches.begin(), m_matches.end(), m_currentMatch))
+    {
+        QTextLayout::FormatRange range;
+        range.start = m_currentMatch.start;
+        range.length = m_currentMatch.length;
+        range.format.setBackground(QColor(Qt::green).lighter());
+        selections.append(range);
+    }
+
+    if (m_hasSelection)
+    {
+        TextPosition start = qMin(m_selectionAnchor, m_selectionCursor);
+        TextPosition end = qMax(m_selectionAnchor, m_selectionCursor);
+        if (start.line <= line && line <= end.line)
+        {
+            QTextLayout::FormatRange range;
+            range.start = line == start.line ? start.column : 0;
+            range.length = (line == end.line ? end.column : length) - range.start;
+            range.format.setBackground(palette().highlight());
+            range.format.setForeground(palette().highlightedText());
+            selections.append(range);
+        }
+    }
+    return selections;
+}
+
+///
+/// \brief TraceView::setSelection
+/// \param anchor where the selection started
+/// \param cursor where the selection ends, may be before the anchor
+///
+void TraceView::setSelection(const TextPosition& anchor, const TextPosition& cursor)
+{
+    bool hadSelection = m_hasSelection;
+    m_selectionAnchor = anchor;
+    m_selectionCursor = cursor;
+    m_hasSelection = !(anchor == cursor);
+    if (hadSelection != m_hasSelection)
+    {
+        emit copyAvailable(m_hasSelection);
+    }
+    viewport()->update();
+}
+
+///
+/// \brief TraceView::hasSelection
+/// \return
+///
+bool TraceView::hasSelection() const
+{
+    return m_hasSelection;
+}
+
+///
+/// \brief TraceView::selectedText
+/// \return the selected text, with a line break between the lines
+///
+QString TraceView::selectedText() const
+{
+    if (!m_hasSelection)
+    {
+        return QString();
+    }
+    TextPosition start = qMin(m_selectionAnchor, m_selectionCursor);
+    TextPosition end = qMax(m_selectionAnchor, m_selectionCursor);
+    QString text;
+    for (int line = start.line; line <= end.line; ++line)
+    {
+        QString lineText = m_lines.line(line);
+        int from = line == start.line ? start.column : 0;
+        int to = line == end.line ? end.column : lineText.size();
+        text += lineText.midRef(from, to - from);
+        if (line != end.line)
+        {
+            text += '\n';
+        }
+    }
+    return text;
+}
+
+///
+/// \brief TraceView::copy
+///
+void TraceView::copy()
+{
+    if (m_hasSelection)
+    {
+        QGuiApplication::clipboard()->setText(selectedText());
+    }
+}
+
+///
+/// \brief TraceView::selectAll
+///
+void TraceView::selectAll()
+{
+    if (m_lines.isEmpty())
+    {
+        return;
+    }
+    TextPosition end;
+    end.line = lineCount() - 1;
+    end.column = m_lines.line(end.line).size();
+    setSelection(TextPosition(), end);
+}
+
+///
+/// \brief TraceView::setMatches
+/// \param matches search results highlighted in the view, sorted
+///
+void TraceView::setMatches(const QVector<TextRange>& matches)
+{
+    m_matches = matches;
+    viewport()->update();
+}
+
+///
+/// \brief TraceView::setCurrentMatch
+/// \param match search result shown in green, null for none
+///
+void TraceView::setCurrentMatch(const TextRange& match)
+{
+    m_currentMatch = match;
+    viewport()->update();
+}
+
+///
+/// \brief TraceView::setMarkedLine
+/// \param line line shown in gray, -1 for none
+///
+void TraceView::setMarkedLine(int line)
+{
+    m_markedLine = line;
+    viewport()->update();
+}
+
+///
+/// \brief TraceView::ensureVisible
+///        Scroll the range to the middle of the view if it is not visible
+/// \param range
+///
+void TraceView::ensureVisible(const TextRange& range)
+{
+    if (range.isNull() || range.line >= lineCount())
+    {
+        return;
+    }
+    int rows = qMax(1, viewport()->height() / m_lineHeight);
+    int first = verticalScrollBar()->value();
+    if (range.line < first || range.line >= first + rows)
+    {
+        verticalScrollBar()->setValue(range.line - rows / 2);
+    }
+
+    QTextLayout layout(m_lines.line(range.line), font(), viewport());
+    QTextLine textLine = layoutLine(layout);
+    int start = qRound(textLine.cursorToX(range.start));
+    int end = qRound(textLine.cursorToX(range.end()));
+    int left = horizontalScrollBar()->value();
+    int width = viewport()->width() - 2 * TEXT_MARGIN;
+    if (start < left || end > left + width)
+    {
+        horizontalScrollBar()->setValue(start - width / 2);
+    }
 }
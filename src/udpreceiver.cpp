@@ -0,0 +1,515 @@
+#include "inc/udpreceiver.h"
+#include "inc/slabring.h"
+#include "inc/traceclock.h"
+#include <QDebug>
+#include <QUdpSocket>
+#include <QSocketNotifier>
+#include <QTimer>
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#endif
+
+namespace
+{
+const int MAX_DATAGRAM_SIZE = 65536;
+const int DATAGRAMS_PER_READ = 32;
+const int MAX_DATAGRAMS_PER_BATCH = 1024;
+// Delay before publishing the open slab while trace manager has not consumed the previous ones
+const int BATCH_DELAY = 2;
+const int RING_FULL_RETRY_DELAY = 1;
+}
+
+#ifdef Q_OS_LINUX
+///
+/// \brief Helper function
+///        Copy the sender of a datagram into the record, IPv4 is mapped to IPv6
+/// \param record
+/// \param addr sender address filled by recvmmsg
+///
+static void setSender(IngestRecord& record, const sockaddr_storage& addr)
+{
+    memset(record.sender, 0, sizeof(record.sender));
+    if (addr.ss_family == AF_INET)
+    {
+        auto addrIpv4 = reinterpret_cast<const sockaddr_in*>(&addr);
+        record.sender[10] = 0xff;
+        record.sender[11] = 0xff;
+        memcpy(record.sender + 12, &addrIpv4->sin_addr, 4);
+        record.senderPort = ntohs(addrIpv4->sin_port);
+    }
+    else if (addr.ss_family == AF_INET6)
+    {
+        auto addrIpv6 = reinterpret_cast<const sockaddr_in6*>(&addr);
+        memcpy(record.sender, &addrIpv6->sin6_addr, sizeof(record.sender));
+        record.senderPort = ntohs(addrIpv6->sin6_port);
+    }
+}
+
+///
+/// \brief Helper function
+///        The kernel stamps the datagrams with the realtime clock, TraceClock is monotonic
+/// \param msg datagram header filled by recvmmsg
+/// \param realtimeOffset realtime clock minus TraceClock, in ns
+/// \param now TraceClock time of the read
+/// \return the TraceClock time the kernel received the datagram, now if unknown
+///
+static qint64 receiveTime(msghdr& msg, qint64 realtimeOffset, qint64 now)
+{
+#ifdef SO_TIMESTAMPNS
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            timespec stamp;
+            memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+            qint64 time = qint64(stamp.tv_sec) * 1000000000 + stamp.tv_nsec - realtimeOffset;
+            // A step of the realtime clock between the two must not reorder the traces
+            return qMin(time, now);
+        }
+    }
+#else
+    Q_UNUSED(msg)
+    Q_UNUSED(realtimeOffset)
+#endif
+    return now;
+}
+#endif
+
+UdpReceiver::UdpReceiver(SlabRing* ring, QObject* parent)
+    : TraceReceiver(ring, parent)
+{
+    // One slot per datagram of a single read, allocated once for the receiver lifetime
+    m_buffer.resize(MAX_DATAGRAM_SIZE * DATAGRAMS_PER_READ);
+
+    // Child of the receiver, moved to the receive thread with it
+    m_flushTimer = new QTimer(this);
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_flushTimer, &QTimer::timeout, this, &UdpReceiver::flushBatch);
+
+    m_retryTimer = new QTimer(this);
+    m_retryTimer->setSingleShot(true);
+    m_retryTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_retryTimer, &QTimer::timeout, this, &UdpReceiver::resumeReading);
+}
+
+UdpReceiver::~UdpReceiver()
+{
+    close();
+}
+
+///
+/// \brief UdpReceiver::open
+/// \param endpoint
+/// \return true if the socket is bound
+///
+bool UdpReceiver::open(const IngestEndpoint& endpoint)
+{
+    return bind(QHostAddress(endpoint.address), endpoint.port);
+}
+
+#ifdef Q_OS_LINUX
+///
+/// \brief UdpReceiver::bind
+///        Use a native socket so that the whole pending queue can be drained with recvmmsg
+/// \param host
+/// \param port
+/// \return true if the socket is bound
+///
+bool UdpReceiver::bind(const QHostAddress& host, quint16 port)
+{
+    close();
+    m_errorString.clear();
+
+    sockaddr_storage addr;
+    socklen_t addrLen = 0;
+    memset(&addr, 0, sizeof(addr));
+    int family = AF_INET6;
+    if (host.protocol() == QAbstractSocket::IPv4Protocol)
+    {
+        auto addrIpv4 = reinterpret_cast<sockaddr_in*>(&addr);
+        addrIpv4->sin_family = AF_INET;
+        addrIpv4->sin_port = htons(port);
+        addrIpv4->sin_addr.s_addr = htonl(host.toIPv4Address());
+        addrLen = sizeof(sockaddr_in);
+        family = AF_INET;
+    }
+    else
+    {
+        auto addrIpv6 = reinterpret_cast<sockaddr_in6*>(&addr);
+        addrIpv6->sin6_family = AF_INET6;
+        addrIpv6->sin6_port = htons(port);
+        Q_IPV6ADDR ipv6 = host.toIPv6Address();
+        memcpy(&addrIpv6->sin6_addr, &ipv6, sizeof(ipv6));
+        addrLen = sizeof(sockaddr_in6);
+    }
+
+    m_fd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_fd < 0)
+    {
+        m_errorString = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+    if (family == AF_INET6)
+    {
+        // Same as QUdpSocket: "Any" is dual stack, any other IPv6 address is IPv6 only
+        int v6Only = host.protocol() == QAbstractSocket::AnyIPProtocol ? 0 : 1;
+        ::setsockopt(m_fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6Only, sizeof(v6Only));
+    }
+    applyReceiveBufferSize();
+    int enable = 1;
+#ifdef SO_RXQ_OVFL
+    // Ask the kernel to report its drop counter along with the datagrams
+    ::setsockopt(m_fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+#endif
+#ifdef SO_TIMESTAMPNS
+    // And the time it received each datagram, a read takes several of them
+    ::setsockopt(m_fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+#endif
+    if (::bind(m_fd, reinterpret_cast<sockaddr*>(&addr), addrLen) < 0)
+    {
+        m_errorString = QString::fromLocal8Bit(strerror(errno));
+        close();
+        return false;
+    }
+
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, SIGNAL(activated(int)), this, SLOT(onReadyRead()));
+    return true;
+}
+
+///
+/// \brief UdpReceiver::close
+///
+void UdpReceiver::close()
+{
+    flushBatch();
+    m_retryTimer->stop();
+    m_kernelDropsBase = m_kernelDrops.loadRelaxed();
+    if (m_notifier)
+    {
+        m_notifier->setEnabled(false);
+        delete m_notifier;
+        m_notifier = nullptr;
+    }
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+///
+/// \brief UdpReceiver::applyReceiveBufferSize
+///        A large buffer absorbs the bursts while the receive thread is not scheduled
+///
+void UdpReceiver::applyReceiveBufferSize()
+{
+    int size = m_receiveBufferSize;
+    if (size > 0)
+    {
+#ifdef SO_RCVBUFFORCE
+        // SO_RCVBUFFORCE is not limited by net.core.rmem_max but needs CAP_NET_ADMIN
+        if (::setsockopt(m_fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) == 0)
+        {
+            size = 0;
+        }
+#endif
+        if (size > 0)
+        {
+            ::setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+    }
+
+    int effective = 0;
+    socklen_t length = sizeof(effective);
+    if (::getsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &effective, &length) == 0)
+    {
+        m_effectiveReceiveBufferSize.storeRelaxed(effective);
+        // Linux doubles the value for its bookkeeping overhead
+        if (effective < m_receiveBufferSize)
+        {
+            qDebug() << "Receive buffer limited to" << effective << "bytes, raise net.core.rmem_max";
+        }
+    }
+}
+
+///
+/// \brief UdpReceiver::readBatch
+///        Read up to maxDatagrams datagrams with a single system call. Each
+///        datagram is stamped with the time the kernel received it.
+/// \param maxDatagrams at most DATAGRAMS_PER_READ
+/// \return number of datagrams read
+///
+int UdpReceiver::readBatch(int maxDatagrams)
+{
+    mmsghdr msgs[DATAGRAMS_PER_READ];
+    iovec iovecs[DATAGRAMS_PER_READ];
+    sockaddr_storage senders[DATAGRAMS_PER_READ];
+    char controls[DATAGRAMS_PER_READ][CMSG_SPACE(sizeof(quint32)) + CMSG_SPACE(sizeof(timespec))];
+    memset(msgs, 0, sizeof(msgs));
+
+    char* base = m_buffer.data();
+    for (int i = 0; i < DATAGRAMS_PER_READ; ++i)
+    {
+        iovecs[i].iov_base = base + i * MAX_DATAGRAM_SIZE;
+        iovecs[i].iov_len = MAX_DATAGRAM_SIZE;
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &senders[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        msgs[i].msg_hdr.msg_control = controls[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+    }
+
+    int count = ::recvmmsg(m_fd, msgs, uint(maxDatagrams), MSG_DONTWAIT, nullptr);
+    if (count < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            qDebug() << "Receive udp failed" << strerror(errno);
+        }
+        return 0;
+    }
+
+    IngestRecord record;
+    qint64 now = TraceClock::nowNs();
+    timespec realtime;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    qint64 realtimeOffset = qint64(realtime.tv_sec) * 1000000000 + realtime.tv_nsec - now;
+    quint64 bytes = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        setSender(record, senders[i]);
+        record.timestamp = receiveTime(msgs[i].msg_hdr, realtimeOffset, now);
+        writeDatagram(record, base + i * MAX_DATAGRAM_SIZE, int(msgs[i].msg_len));
+        bytes += msgs[i].msg_len;
+    }
+    m_receivedDatagrams.fetchAndAddRelaxed(quint64(count));
+    m_receivedBytes.fetchAndAddRelaxed(bytes);
+
+#ifdef SO_RXQ_OVFL
+    // The counter is cumulative, the last datagram has the most recent value
+    msghdr& last = msgs[count - 1].msg_hdr;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&last); cmsg; cmsg = CMSG_NXTHDR(&last, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+        {
+            quint32 drops = 0;
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            m_kernelDrops.storeRelaxed(m_kernelDropsBase + drops);
+        }
+    }
+#endif
+    return count;
+}
+#else
+///
+/// \brief UdpReceiver::bind
+/// \param host
+/// \param port
+/// \return true if the socket is bound
+///
+bool UdpReceiver::bind(const QHostAddress& host, quint16 port)
+{
+    close();
+    m_errorString.clear();
+
+    m_socket = new QUdpSocket(this);
+    if (!m_socket->bind(host, port, QAbstractSocket::DontShareAddress))
+    {
+        m_errorString = m_socket->errorString();
+        close();
+        return false;
+    }
+    applyReceiveBufferSize();
+    connect(m_socket, &QUdpSocket::readyRead, this, &UdpReceiver::onReadyRead);
+    return true;
+}
+
+///
+/// \brief UdpReceiver::close
+///
+void UdpReceiver::close()
+{
+    flushBatch();
+    m_retryTimer->stop();
+    if (m_socket)
+    {
+        m_socket->close();
+        delete m_socket;
+        m_socket = nullptr;
+    }
+}
+
+///
+/// \brief UdpReceiver::applyReceiveBufferSize
+///        A large buffer absorbs the bursts while the receive thread is not scheduled.
+///        The kernel drop counter is not available on this platform.
+///
+void UdpReceiver::applyReceiveBufferSize()
+{
+    if (m_receiveBufferSize > 0)
+    {
+        m_socket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, m_receiveBufferSize);
+    }
+    m_effectiveReceiveBufferSize.storeRelaxed(
+        m_socket->socketOption(QAbstractSocket::ReceiveBufferSizeSocketOption).toInt());
+}
+
+///
+/// \brief UdpReceiver::readBatch
+///        Read up to maxDatagrams datagrams into the preallocated buffer
+/// \param maxDatagrams
+/// \return number of datagrams read
+///
+int UdpReceiver::readBatch(int maxDatagrams)
+{
+    IngestRecord record;
+    int count = 0;
+    while (count < maxDatagrams && m_socket->hasPendingDatagrams())
+    {
+        QHostAddress sender;
+        qint64 size = m_socket->readDatagram(m_buffer.data(), MAX_DATAGRAM_SIZE, &sender, &record.senderPort);
+        if (size < 0)
+        {
+            break;
+        }
+        record.timestamp = TraceClock::nowNs();
+        Q_IPV6ADDR senderIpv6 = sender.toIPv6Address();
+        memcpy(record.sender, &senderIpv6, sizeof(record.sender));
+        m_receivedDatagrams.fetchAndAddRelaxed(1);
+        m_receivedBytes.fetchAndAddRelaxed(quint64(size));
+        writeDatagram(record, m_buffer.constData(), int(size));
+        ++count;
+    }
+    return count;
+}
+#endif
+
+///
+/// \brief UdpReceiver::writeDatagram
+///        A compressed datagram is one complete LZ4 frame, e.g. sent by a gateway batching
+///        the traces of several boards. Its blocks are written as they are decoded,
+///        the rest of the datagram is dropped once the ring is full.
+/// \param record
+/// \param data
+/// \param size
+///
+void UdpReceiver::writeDatagram(const IngestRecord& record, const char* data, int size)
+{
+    if (!Lz4FrameDecoder::isFrame(data, size))
+    {
+        m_ring->write(record, data, size);
+        return;
+    }
+
+    m_decoder.reset();
+    m_decoder.append(data, size);
+    const char* output = nullptr;
+    int outputSize = 0;
+    IngestRecord block = record;
+    Lz4FrameDecoder::Status status;
+    while ((status = m_decoder.decodeBlock(output, outputSize)) == Lz4FrameDecoder::Decoded)
+    {
+        if (!m_ring->write(block, output, outputSize))
+        {
+            // The next blocks would continue a block which is lost, the datagram is dropped
+            return;
+        }
+        block.flags |= IngestRecord::Continued;
+    }
+    if (status == Lz4FrameDecoder::Error || !m_decoder.isIdle())
+    {
+        qDebug() << "Invalid compressed datagram" << m_decoder.errorString();
+    }
+}
+
+///
+/// \brief slot to drain the socket into the ring. The batch is published at once if
+///        trace manager has consumed everything, else the next datagrams are packed in the
+///        same slab for up to BATCH_DELAY ms. Publishing a slab per wake-up would fill the
+///        ring with a few datagrams per slab at high rates, long before the next frame.
+///
+void UdpReceiver::onReadyRead()
+{
+    int count = 0;
+    while (count < MAX_DATAGRAMS_PER_BATCH)
+    {
+        int room = datagramRoom();
+        if (room == 0)
+        {
+            // Leave the datagrams in the socket buffer until trace manager catches up,
+            // the kernel drops them only once that buffer is full too
+            flushBatch();
+#ifdef Q_OS_LINUX
+            m_notifier->setEnabled(false);
+#endif
+            m_retryTimer->start(RING_FULL_RETRY_DELAY);
+            return;
+        }
+        int read = readBatch(room);
+        count += read;
+        if (read < room)
+        {
+            break;
+        }
+    }
+
+    if (m_ring->usedSlabs() == 0)
+    {
+        flushBatch();
+    }
+    else if (count > 0 && !m_flushTimer->isActive())
+    {
+        m_flushTimer->start(BATCH_DELAY);
+    }
+}
+
+///
+/// \brief UdpReceiver::resumeReading
+///        Drain the datagrams left in the socket while the ring was full
+///
+void UdpReceiver::resumeReading()
+{
+#ifdef Q_OS_LINUX
+    if (m_notifier)
+    {
+        m_notifier->setEnabled(true);
+    }
+#endif
+    onReadyRead();
+}
+
+///
+/// \brief UdpReceiver::datagramRoom
+///        The ring has no room for a datagram once trace manager lags behind, the
+///        datagrams are then better kept by the socket buffer than dropped
+/// \return number of datagrams of the largest size that the ring can take now,
+///         up to DATAGRAMS_PER_READ
+///
+int UdpReceiver::datagramRoom() const
+{
+    int room = DATAGRAMS_PER_READ;
+    while (room > 0 && !m_ring->canWrite(room * MAX_DATAGRAM_SIZE))
+    {
+        room /= 2;
+    }
+    return room;
+}
+
+///
+/// \brief UdpReceiver::flushBatch
+///        Publish the open slab to trace manager
+///
+void UdpReceiver::flushBatch()
+{
+    m_flushTimer->stop();
+    m_ring->flush();
+}
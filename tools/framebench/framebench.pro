@@ -0,0 +1,23 @@
+QT       = core
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = framebench
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../src/lineframer.cpp \
+    ../../src/slabring.cpp
+
+HEADERS += \
+    ../../inc/lineframer.h \
+    ../../inc/slabring.h \
+    ../../inc/traceline.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
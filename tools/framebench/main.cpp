@@ -0,0 +1,345 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QRandomGenerator>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+#include "inc/lineframer.h"
+#include "inc/slabring.h"
+#include "inc/traceline.h"
+
+///
+/// \brief framebench measures the receive path of trace manager without network nor display:
+///        datagrams like those of tracegen are written to an ingest ring, read back, framed
+///        into trace lines, queued and handed over by batch, as trace manager does every frame.
+///        The lines are built either as a copy each, or as slices of one copy of the datagram.
+///        The path before the line framer, a QString cut with lastIndexOf and split, is the
+///        reference.
+///
+
+namespace
+{
+const int RING_SLABS = 256;
+const int SLAB_SIZE = 64 * 1024;
+// Datagrams handed over by one read of the receive thread, before the ingest ring
+const int DATAGRAMS_PER_READ = 32;
+const int MAX_LINE_LENGTH = 65000;
+const char* const WORDS[] = {
+    "sensor", "timeout", "frame", "retry", "buffer", "state", "value", "queue", "overflow", "ack",
+    "request", "response", "handler", "init", "done", "channel", "offset", "config", "update", "event"
+};
+const int WORD_COUNT = int(sizeof(WORDS) / sizeof(WORDS[0]));
+const char* const LEVELS[] = { "ERROR", "WARNG", "PRINT", "PRINT", "PRINT", "PRINT" };
+const int LEVEL_COUNT = int(sizeof(LEVELS) / sizeof(LEVELS[0]));
+}
+
+enum class Mode
+{
+    QStringSplit,   // Before the line framer
+    CopyPerLine,
+    SharedDatagram
+};
+
+struct Config
+{
+    qint64 lines{5000000};
+    int    minLength{80};
+    int    maxLength{160};
+    int    datagramSize{1400};
+    int    batchLines{100000};  // Lines handed over per frame
+    int    rounds{3};
+};
+
+struct Result
+{
+    qint64 lines{0};
+    qint64 bytes{0};
+    qint64 ns{0};
+};
+
+///
+/// \brief Helper function
+///        Datagrams of complete lines in the tracegen format
+/// \param config
+/// \return the datagrams, and the number of lines in them
+///
+static QVector<QByteArray> makeDatagrams(const Config& config, qint64& lines)
+{
+    QVector<QByteArray> datagrams;
+    auto random = QRandomGenerator::global();
+    QByteArray datagram;
+    QByteArray line;
+    lines = 0;
+    while (lines < config.lines)
+    {
+        int length = config.minLength + int(random->bounded(config.maxLength - config.minLength + 1));
+        line = QByteArray("12:34:56.789 ") + LEVELS[random->bounded(LEVEL_COUNT)] + " - [s0] #"
+                + QByteArray::number(lines) + " ";
+        while (line.size() < length)
+        {
+            line.append(WORDS[random->bounded(WORD_COUNT)]).append(' ');
+        }
+        line.resize(length);
+        if (!datagram.isEmpty() && datagram.size() + line.size() + 2 > config.datagramSize)
+        {
+            datagrams.append(datagram);
+            datagram.clear();
+        }
+        // The path before the line framer only splits on "\r\n"
+        datagram.append(line).append("\r\n");
+        ++lines;
+    }
+    if (!datagram.isEmpty())
+    {
+        datagrams.append(datagram);
+    }
+    return datagrams;
+}
+
+///
+/// \brief Helper function
+///        The receive path before the line framer, as TraceManager::onNewDataBatchReady and
+///        filterIncompletedFromRawData were: the datagrams of each read are decoded into a
+///        QString, the complete lines are cut out every frame and split on "\r\n"
+/// \param datagrams
+/// \param frameDatagrams datagrams received during one frame
+/// \return the lines handed over and the time spent
+///
+static Result runQString(const QVector<QByteArray>& datagrams, int frameDatagrams)
+{
+    QString rawData;
+    QQueue<QString> pendingTraces;
+    Result result;
+
+    auto filterIncompletedFromRawData = [&](){
+        QString processedData;
+        int length = rawData.length();
+        if (rawData.endsWith("\r\n"))
+        {
+            processedData = rawData.left(length - 2);
+            rawData.clear();
+        }
+        else
+        {
+            int idx = rawData.lastIndexOf("\r\n");
+            if (idx != -1)
+            {
+                processedData = rawData.left(idx);
+                rawData = rawData.right(length - (idx + 1) - 1);
+            }
+        }
+        if (!processedData.isEmpty())
+        {
+            QStringList pendingDataArr = processedData.split("\r\n");
+            for (auto& data : pendingDataArr)
+            {
+                data += " ";
+                pendingTraces.enqueue(data);
+            }
+        }
+    };
+    auto handOver = [&](){
+        filterIncompletedFromRawData();
+        QStringList tracesToSend;
+        tracesToSend.reserve(pendingTraces.size());
+        while (!pendingTraces.isEmpty())
+        {
+            tracesToSend.append(pendingTraces.dequeue());
+        }
+        result.lines += tracesToSend.size();
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int first = 0; first < datagrams.size(); first += DATAGRAMS_PER_READ)
+    {
+        QString data;
+        int last = qMin(first + DATAGRAMS_PER_READ, datagrams.size());
+        for (int i = first; i < last; ++i)
+        {
+            data += QString(datagrams.at(i));
+            result.bytes += datagrams.at(i).size();
+        }
+        rawData += data;
+        if (last / frameDatagrams != first / frameDatagrams)
+        {
+            handOver();
+        }
+    }
+    handOver();
+    result.ns = timer.nsecsElapsed();
+    return result;
+}
+
+///
+/// \brief Helper function
+///        Write the datagrams into the ring, frame them and hand the lines over by batch
+/// \param datagrams
+/// \param batchLines
+/// \param shared slices of one copy of the datagram, instead of a copy per line
+/// \return the lines handed over and the time spent
+///
+static Result runFramer(const QVector<QByteArray>& datagrams, int batchLines, bool shared)
+{
+    SlabRing ring(RING_SLABS, SLAB_SIZE);
+    LineFramer framer;
+    TraceLines lines;            // As the lines of an ingest source
+    QQueue<TraceLine> pending;   // As the lines waiting for the view
+    Result result;
+
+    // Same as TraceManager::consumeSource
+    auto consume = [&](const IngestRecord& record, const char* payload){
+        int payloadSize = int(record.size);
+        QByteArray chunk;
+        framer.feed(payload, payloadSize, [&](const char* data, int size){
+            TraceLine line;
+            if (shared && data >= payload && data + size <= payload + payloadSize)
+            {
+                if (chunk.isNull())
+                {
+                    chunk = QByteArray(payload, payloadSize);
+                }
+                line.chunk = chunk;
+                line.offset = int(data - payload);
+                line.size = size;
+            }
+            else
+            {
+                line.setText(QByteArray(data, size));
+            }
+            line.timestamp = record.timestamp;
+            lines.append(line);
+        });
+    };
+    // The lines are queued, then the batch goes to the view
+    auto handOver = [&](){
+        for (const auto& line : qAsConst(lines))
+        {
+            pending.enqueue(line);
+        }
+        lines.resize(0);
+        TraceLines batch;
+        batch.reserve(pending.size());
+        while (!pending.isEmpty())
+        {
+            batch.append(pending.dequeue());
+        }
+        result.lines += batch.size();
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    IngestRecord record;
+    for (const auto& datagram : datagrams)
+    {
+        record.timestamp = timer.nsecsElapsed();
+        if (!ring.write(record, datagram.constData(), datagram.size()))
+        {
+            ring.flush();
+            ring.consume(consume);
+            ring.write(record, datagram.constData(), datagram.size());
+        }
+        result.bytes += datagram.size();
+        if (lines.size() >= batchLines)
+        {
+            handOver();
+        }
+    }
+    ring.flush();
+    ring.consume(consume);
+    handOver();
+    result.ns = timer.nsecsElapsed();
+    return result;
+}
+
+///
+/// \brief Helper function
+/// \param text "<length>" or "<min>-<max>"
+/// \param min
+/// \param max
+/// \return false if the length cannot be parsed
+///
+static bool parseRange(const QString& text, int& min, int& max)
+{
+    auto parts = text.split('-');
+    bool minOk = false;
+    bool maxOk = false;
+    min = parts.first().toInt(&minOk);
+    max = parts.size() == 2 ? parts.last().toInt(&maxOk) : min;
+    if (parts.size() == 1)
+    {
+        maxOk = minOk;
+    }
+    return minOk && maxOk && min > 0 && max >= min && max <= MAX_LINE_LENGTH && parts.size() <= 2;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("framebench");
+    app.setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Framing benchmark of the TraceTerminal++ receive path.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "lines", "Number of lines.", "lines", "5000000" },
+        { "line-length", "Line length in bytes, fixed or random in a range.", "length|min-max", "80-160" },
+        { "datagram-size", "Maximum datagram size in bytes, 1 puts one line per datagram.", "bytes", "1400" },
+        { "batch", "Lines handed over at once, as in one display frame.", "lines", "100000" },
+        { "rounds", "Runs of each way, the best one is kept.", "count", "3" },
+    });
+    parser.process(app);
+
+    Config config;
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    config.lines = qMax<qint64>(parser.value("lines").toLongLong(), 1);
+    if (!parseRange(parser.value("line-length"), config.minLength, config.maxLength))
+    {
+        err << "Invalid line length " << parser.value("line-length") << Qt::endl;
+        return 1;
+    }
+    config.datagramSize = qBound(1, parser.value("datagram-size").toInt(), SLAB_SIZE / 2);
+    config.batchLines = qMax(parser.value("batch").toInt(), 1);
+    config.rounds = qMax(parser.value("rounds").toInt(), 1);
+
+    qint64 lineCount = 0;
+    QVector<QByteArray> datagrams = makeDatagrams(config, lineCount);
+    out << lineCount << " lines in " << datagrams.size() << " datagrams" << Qt::endl;
+
+    // As many datagrams per frame as the framer gets lines per frame
+    int frameDatagrams = int(qMax<qint64>(1, qint64(config.batchLines) * datagrams.size() / lineCount));
+    const struct
+    {
+        Mode        mode;
+        const char* name;
+    } modes[] = {
+        { Mode::QStringSplit,   "before, QString split" },
+        { Mode::CopyPerLine,    "framer, copy per line" },
+        { Mode::SharedDatagram, "framer, shared chunk " },
+    };
+    for (const auto& mode : modes)
+    {
+        Result best;
+        for (int i = 0; i < config.rounds; ++i)
+        {
+            Result result = mode.mode == Mode::QStringSplit
+                            ? runQString(datagrams, frameDatagrams)
+                            : runFramer(datagrams, config.batchLines, mode.mode == Mode::SharedDatagram);
+            if (best.ns == 0 || result.ns < best.ns)
+            {
+                best = result;
+            }
+        }
+        out << QString("%1: %2 MB/s, %3 lines/s, %4 ns/line")
+                   .arg(mode.name)
+                   .arg(best.bytes * 1e3 / best.ns, 0, 'f', 1)
+                   .arg(qRound64(best.lines * 1e9 / best.ns))
+                   .arg(double(best.ns) / best.lines, 0, 'f', 1)
+            << Qt::endl;
+    }
+    return 0;
+}
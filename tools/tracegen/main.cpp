@@ -0,0 +1,428 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QUdpSocket>
+#include <QHostAddress>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QTime>
+#include <QTextStream>
+#include <QVector>
+#include <QLocale>
+
+///
+/// \brief tracegen sends realistic trace lines over UDP, to reproduce a production load
+///        on a developer box and to measure the drops of the receive path.
+///        Every line carries its sender and a per sender sequence number, so that the
+///        gaps can be found in a saved trace:
+///            hh:mm:ss.zzz <LEVEL> - [s<sender>] #<sequence> <text>
+///
+
+namespace
+{
+const int TICK_INTERVAL = 1;            // ms
+const int REPORT_INTERVAL = 1000;       // ms
+// Lines sent in one tick at most, keeps the event loop alive when the rate is unlimited
+const qint64 MAX_LINES_PER_TICK = 20000;
+// A line must fit in a UDP datagram
+const int MAX_LINE_LENGTH = 65000;
+const int MAX_DATAGRAM_SIZE = 65507;
+const char* const WORDS[] = {
+    "sensor", "timeout", "frame", "retry", "buffer", "state", "value", "queue", "overflow", "ack",
+    "request", "response", "handler", "init", "done", "channel", "offset", "config", "update", "event"
+};
+const int WORD_COUNT = int(sizeof(WORDS) / sizeof(WORDS[0]));
+}
+
+struct Level
+{
+    QByteArray name;
+    int        weight{0};
+};
+
+///
+/// \brief The TraceGenerator class paces the lines over the senders. The rate applies
+///        while a burst is on, nothing is sent while it is off.
+///
+class TraceGenerator
+{
+public:
+    struct Config
+    {
+        QHostAddress   host;
+        quint16        port{911};
+        qint64         rate{0};          // Lines per second, 0 is unlimited
+        int            minLength{80};
+        int            maxLength{160};
+        int            datagramSize{1400};
+        int            senders{1};
+        int            burstOn{0};       // ms, 0 sends continuously
+        int            burstOff{0};      // ms
+        qint64         duration{0};      // ms, 0 runs until stopped
+        QVector<Level> levels;
+    };
+
+    explicit TraceGenerator(const Config& config)
+        : m_config(config)
+        , m_out(stdout)
+    {
+        for (const auto& level : qAsConst(m_config.levels))
+        {
+            m_totalWeight += level.weight;
+        }
+    }
+
+    bool open(QString& errorString);
+    void start();
+
+private:
+    void tick();
+    void report(bool final);
+    QByteArray makeLine(int sender) const;
+    void sendDatagram(int sender);
+
+    struct Sender
+    {
+        QUdpSocket* socket{nullptr};
+        QByteArray  datagram;
+        quint64     sequence{0};
+    };
+
+    Config          m_config;
+    QVector<Sender> m_senders;
+    int             m_nextSender{0};
+    int             m_totalWeight{0};
+    QByteArray      m_timeText;          // Time of the current tick, shared by its lines
+    QTimer          m_timer;
+    QTimer          m_reportTimer;
+    QElapsedTimer   m_elapsed;
+    qint64          m_lastTickNs{0};
+    qint64          m_activeNs{0};       // Time spent in bursts
+
+    quint64         m_lines{0};
+    quint64         m_datagrams{0};
+    quint64         m_bytes{0};
+    quint64         m_sendErrors{0};     // e.g. the socket buffer of the sender is full
+    quint64         m_lastLines{0};
+    quint64         m_lastDatagrams{0};
+    quint64         m_lastBytes{0};
+    QTextStream     m_out;
+};
+
+///
+/// \brief TraceGenerator::open
+///        One socket per sender, each one has its own source port
+/// \param errorString
+/// \return false if a socket cannot be bound
+///
+bool TraceGenerator::open(QString& errorString)
+{
+    m_senders.resize(m_config.senders);
+    for (auto& sender : m_senders)
+    {
+        sender.socket = new QUdpSocket(QCoreApplication::instance());
+        if (!sender.socket->bind(m_config.host.protocol() == QAbstractSocket::IPv6Protocol
+                                 ? QHostAddress::AnyIPv6 : QHostAddress::AnyIPv4))
+        {
+            errorString = sender.socket->errorString();
+            return false;
+        }
+        sender.datagram.reserve(m_config.datagramSize + m_config.maxLength + 64);
+    }
+    return true;
+}
+
+///
+/// \brief TraceGenerator::start
+///
+void TraceGenerator::start()
+{
+    m_out << "Sending to " << m_config.host.toString() << ":" << m_config.port << " from "
+          << m_config.senders << " sender(s), "
+          << (m_config.rate > 0 ? QString("%1 lines/s").arg(m_config.rate) : QString("unlimited rate"))
+          << Qt::endl;
+
+    m_timer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&m_timer, &QTimer::timeout, [this](){
+        tick();
+    });
+    QObject::connect(&m_reportTimer, &QTimer::timeout, [this](){
+        report(false);
+    });
+    m_elapsed.start();
+    m_timer.start(TICK_INTERVAL);
+    m_reportTimer.start(REPORT_INTERVAL);
+}
+
+///
+/// \brief TraceGenerator::tick
+///        Send the lines due since the last tick, the partial datagrams are sent at
+///        the end of the tick as a device would do
+///
+void TraceGenerator::tick()
+{
+    qint64 now = m_elapsed.nsecsElapsed();
+    if (m_config.duration > 0 && now >= m_config.duration * 1000000)
+    {
+        m_timer.stop();
+        m_reportTimer.stop();
+        report(true);
+        QCoreApplication::quit();
+        return;
+    }
+
+    bool burstOn = m_config.burstOff <= 0 ||
+                   (now / 1000000) % (m_config.burstOn + m_config.burstOff) < m_config.burstOn;
+    if (burstOn)
+    {
+        m_activeNs += now - m_lastTickNs;
+    }
+    m_lastTickNs = now;
+    if (!burstOn)
+    {
+        return;
+    }
+
+    qint64 due = MAX_LINES_PER_TICK;
+    if (m_config.rate > 0)
+    {
+        // In double, the product in nanoseconds overflows after a few hours at 1M lines/s
+        qint64 expected = qint64(double(m_activeNs) * double(m_config.rate) / 1e9);
+        due = qBound<qint64>(0, expected - qint64(m_lines), MAX_LINES_PER_TICK);
+    }
+    if (due == 0)
+    {
+        return;
+    }
+
+    m_timeText = QTime::currentTime().toString("hh:mm:ss.zzz").toLatin1();
+    for (qint64 i = 0; i < due; ++i)
+    {
+        QByteArray line = makeLine(m_nextSender);
+        const QByteArray& datagram = m_senders[m_nextSender].datagram;
+        if (!datagram.isEmpty() && datagram.size() + line.size() > m_config.datagramSize)
+        {
+            // The datagram is full, the next one goes out from the next sender
+            sendDatagram(m_nextSender);
+            if (m_senders.size() > 1)
+            {
+                m_nextSender = (m_nextSender + 1) % m_senders.size();
+                line = makeLine(m_nextSender);
+            }
+        }
+        Sender& sender = m_senders[m_nextSender];
+        sender.datagram.append(line);
+        ++sender.sequence;
+        ++m_lines;
+    }
+    for (int sender = 0; sender < m_senders.size(); ++sender)
+    {
+        sendDatagram(sender);
+    }
+}
+
+///
+/// \brief TraceGenerator::makeLine
+/// \param sender
+/// \return the next line of the sender, with a random level and text
+///
+QByteArray TraceGenerator::makeLine(int sender) const
+{
+    auto random = QRandomGenerator::global();
+    const QByteArray* level = &m_config.levels.first().name;
+    int pick = int(random->bounded(m_totalWeight));
+    for (const auto& candidate : m_config.levels)
+    {
+        if (pick < candidate.weight)
+        {
+            level = &candidate.name;
+            break;
+        }
+        pick -= candidate.weight;
+    }
+
+    QByteArray line;
+    line.reserve(m_config.maxLength + 1);
+    line.append(m_timeText).append(' ').append(*level).append(" - [s")
+        .append(QByteArray::number(sender)).append("] #")
+        .append(QByteArray::number(m_senders[sender].sequence));
+    int headerSize = line.size();
+    int length = m_config.minLength + int(random->bounded(m_config.maxLength - m_config.minLength + 1));
+    while (line.size() < length)
+    {
+        line.append(' ').append(WORDS[random->bounded(WORD_COUNT)]);
+    }
+    line.truncate(qMax(length, headerSize));
+    line.append('\n');
+    return line;
+}
+
+///
+/// \brief TraceGenerator::sendDatagram
+/// \param sender
+///
+void TraceGenerator::sendDatagram(int sender)
+{
+    Sender& target = m_senders[sender];
+    if (target.datagram.isEmpty())
+    {
+        return;
+    }
+    if (target.socket->writeDatagram(target.datagram, m_config.host, m_config.port) < 0)
+    {
+        ++m_sendErrors;
+    }
+    else
+    {
+        ++m_datagrams;
+        m_bytes += quint64(target.datagram.size());
+    }
+    target.datagram.resize(0);
+}
+
+///
+/// \brief TraceGenerator::report
+/// \param final totals of the run instead of the rates of the last second
+///
+void TraceGenerator::report(bool final)
+{
+    QLocale locale;
+    if (final)
+    {
+        m_out << QString("Total: %1 lines, %2 datagrams, %3, %4 send errors in %5 s")
+                     .arg(m_lines).arg(m_datagrams)
+                     .arg(locale.formattedDataSize(qint64(m_bytes)))
+                     .arg(m_sendErrors)
+                     .arg(m_elapsed.elapsed() / 1000.0, 0, 'f', 1)
+              << Qt::endl;
+        return;
+    }
+
+    double seconds = REPORT_INTERVAL / 1000.0;
+    m_out << QString("%1 lines/s, %2 datagrams/s, %3/s, %4 send errors")
+                 .arg(qRound64((m_lines - m_lastLines) / seconds))
+                 .arg(qRound64((m_datagrams - m_lastDatagrams) / seconds))
+                 .arg(locale.formattedDataSize(qint64((m_bytes - m_lastBytes) / seconds)))
+                 .arg(m_sendErrors)
+          << Qt::endl;
+    m_lastLines = m_lines;
+    m_lastDatagrams = m_datagrams;
+    m_lastBytes = m_bytes;
+}
+
+///
+/// \brief Helper function
+/// \param text e.g. "ERROR=5,WARNG=15,PRINT=80"
+/// \param levels
+/// \return false if the mix cannot be parsed
+///
+static bool parseLevels(const QString& text, QVector<Level>& levels)
+{
+    levels.clear();
+    for (const auto& item : text.split(',', Qt::SkipEmptyParts))
+    {
+        auto parts = item.split('=');
+        bool ok = false;
+        Level level;
+        level.name = parts.first().trimmed().toLatin1();
+        level.weight = parts.size() == 2 ? parts.last().toInt(&ok) : 0;
+        if (!ok || level.name.isEmpty() || level.weight < 0)
+        {
+            return false;
+        }
+        if (level.weight > 0)
+        {
+            levels.append(level);
+        }
+    }
+    return !levels.isEmpty();
+}
+
+///
+/// \brief Helper function
+/// \param text "<length>" or "<min>-<max>"
+/// \param min
+/// \param max
+/// \return false if the length cannot be parsed
+///
+static bool parseRange(const QString& text, int& min, int& max)
+{
+    auto parts = text.split('-');
+    bool minOk = false;
+    bool maxOk = false;
+    min = parts.first().toInt(&minOk);
+    max = parts.size() == 2 ? parts.last().toInt(&maxOk) : min;
+    if (parts.size() == 1)
+    {
+        maxOk = minOk;
+    }
+    return minOk && maxOk && min > 0 && max >= min && max <= MAX_LINE_LENGTH && parts.size() <= 2;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("tracegen");
+    app.setApplicationVersion("1.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("UDP trace load generator for TraceTerminal++.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "host", "Destination address.", "address", "127.0.0.1" },
+        { "port", "Destination port.", "port", "911" },
+        { "rate", "Lines per second while a burst is on, 0 is unlimited.", "lines", "100000" },
+        { "line-length", "Line length in bytes, fixed or random in a range.", "length|min-max", "80-160" },
+        { "datagram-size", "Maximum datagram size in bytes, 1 sends one line per datagram.", "bytes", "1400" },
+        { "senders", "Number of senders, each one has its own source port.", "count", "1" },
+        { "burst", "Burst pattern, on and off time in ms. Sends continuously by default.", "on:off" },
+        { "mix", "Level weights.", "LEVEL=weight,...", "ERROR=5,WARNG=15,PRINT=80" },
+        { "duration", "Stop after this time, in seconds. Runs until Ctrl+C by default.", "seconds" },
+    });
+    parser.process(app);
+
+    TraceGenerator::Config config;
+    QTextStream err(stderr);
+    config.host = QHostAddress(parser.value("host"));
+    if (config.host.isNull())
+    {
+        err << "Invalid host " << parser.value("host") << Qt::endl;
+        return 1;
+    }
+    config.port = quint16(parser.value("port").toUInt());
+    config.rate = qMax<qint64>(parser.value("rate").toLongLong(), 0);
+    if (!parseRange(parser.value("line-length"), config.minLength, config.maxLength))
+    {
+        err << "Invalid line length " << parser.value("line-length") << Qt::endl;
+        return 1;
+    }
+    config.datagramSize = qBound(1, parser.value("datagram-size").toInt(), MAX_DATAGRAM_SIZE);
+    config.senders = qBound(1, parser.value("senders").toInt(), 1024);
+    if (parser.isSet("burst"))
+    {
+        auto parts = parser.value("burst").split(':');
+        config.burstOn = parts.first().toInt();
+        config.burstOff = parts.size() == 2 ? parts.last().toInt() : 0;
+        if (parts.size() != 2 || config.burstOn <= 0 || config.burstOff < 0)
+        {
+            err << "Invalid burst pattern " << parser.value("burst") << Qt::endl;
+            return 1;
+        }
+    }
+    if (!parseLevels(parser.value("mix"), config.levels))
+    {
+        err << "Invalid level mix " << parser.value("mix") << Qt::endl;
+        return 1;
+    }
+    config.duration = qMax<qint64>(parser.value("duration").toLongLong(), 0) * 1000;
+
+    TraceGenerator generator(config);
+    QString errorString;
+    if (!generator.open(errorString))
+    {
+        err << "Open socket failed: " << errorString << Qt::endl;
+        return 1;
+    }
+    generator.start();
+    return app.exec();
+}
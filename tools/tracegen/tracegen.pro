@@ -0,0 +1,14 @@
+QT       = core network
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = tracegen
+
+SOURCES += \
+    main.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target